@@ -265,6 +265,9 @@ class input_format {
   %rename(newInputFormat) new_input_format;
   %newobject new_input_format;
   static input_format* new_input_format(const std::string& name);
+  %rename(newBinaryInputFormat) new_binary_input_format;
+  %newobject new_binary_input_format;
+  static input_format* new_binary_input_format(const std::string& options = std::string());
   %rename(newConlluInputFormat) new_conllu_input_format;
   %newobject new_conllu_input_format;
   static input_format* new_conllu_input_format(const std::string& options = std::string());
@@ -299,22 +302,25 @@ class output_format {
   %extend {
     %rename(writeSentence) write_sentence;
     virtual std::string write_sentence(const sentence& s) {
-      std::ostringstream ostr;
-      $self->write_sentence(s, ostr);
-      return ostr.str();
+      std::string output;
+      $self->write_sentence(s, output);
+      return output;
     }
 
     %rename(finishDocument) finish_document;
     virtual std::string finish_document() {
-      std::ostringstream ostr;
-      $self->finish_document(ostr);
-      return ostr.str();
+      std::string output;
+      $self->finish_document(output);
+      return output;
     }
   }
 
   %rename(newOutputFormat) new_output_format;
   %newobject new_output_format;
   static output_format* new_output_format(const std::string& name);
+  %rename(newBinaryOutputFormat) new_binary_output_format;
+  %newobject new_binary_output_format;
+  static output_format* new_binary_output_format(const std::string& options = std::string());
   %rename(newConlluOutputFormat) new_conllu_output_format;
   %newobject new_conllu_output_format;
   static output_format* new_conllu_output_format(const std::string& options = std::string());
@@ -448,6 +454,8 @@ class evaluator {
   void set_tagger(const std::string& tagger);
   %rename(setParser) set_parser;
   void set_parser(const std::string& parser);
+  %rename(setThreads) set_threads;
+  void set_threads(unsigned threads);
 
   %extend {
     std::string evaluate(const std::string& data, ProcessingError* error = nullptr) const {
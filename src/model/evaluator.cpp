@@ -8,11 +8,14 @@
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include <algorithm>
+#include <atomic>
+#include <thread>
 
 #include "evaluator.h"
 #include "sentence/input_format.h"
 #include "unilib/unicode.h"
 #include "unilib/utf8.h"
+#include "utils/utf8_ascii.h"
 
 namespace ufal {
 namespace udpipe {
@@ -20,11 +23,15 @@ namespace udpipe {
 const string evaluator::DEFAULT;
 const string evaluator::NONE = "none";
 
+// Number of gold sentences evaluated together.
+static const size_t batch_sentences = 512;
+
 evaluator::evaluator(const model* m, const string& tokenizer, const string& tagger, const string& parser) {
   set_model(m);
   set_tokenizer(tokenizer);
   set_tagger(tagger);
   set_parser(parser);
+  set_threads(1);
 }
 
 void evaluator::set_model(const model* m) {
@@ -43,112 +50,247 @@ void evaluator::set_parser(const string& parser) {
   this->parser = parser;
 }
 
+void evaluator::set_threads(unsigned threads) {
+  this->threads = threads;
+}
+
+// Run job(index, thread) for all indices smaller than jobs using the given number of threads.
+template <class Job>
+static void run_jobs(size_t jobs, unsigned threads, Job job) {
+  if (threads <= 1 || jobs <= 1) {
+    for (size_t i = 0; i < jobs; i++)
+      job(i, 0U);
+    return;
+  }
+
+  atomic<size_t> next_job(0);
+  vector<thread> workers;
+  for (unsigned t = 0; t < threads && t < jobs; t++)
+    workers.emplace_back([&next_job, &job, jobs, t]() {
+      for (size_t i; (i = next_job++) < jobs; )
+        job(i, t);
+    });
+  for (auto&& worker : workers)
+    worker.join();
+}
+
 bool evaluator::evaluate(istream& is, ostream& os, string& error) const {
   error.clear();
 
   unique_ptr<input_format> conllu_input(input_format::new_conllu_input_format());
   if (!conllu_input) return error.assign("Cannot allocate CoNLL-U input format instance!"), false;
 
-  vector<string> plain_text_paragraphs(1); unsigned space_after_nos = 0;
-  sentence system, gold;
-  evaluation_data gold_data, system_goldtok_data, system_goldtok_goldtags_data, system_plaintext_data;
+  unsigned workers = max(threads, 1U);
+  vector<unique_ptr<input_format>> tokenizers;
+  for (unsigned i = 0; tokenizer != NONE && i < workers; i++) {
+    tokenizers.emplace_back(m->new_tokenizer(tokenizer));
+    if (!tokenizers.back()) return error.assign("Cannot allocate new tokenizer!"), false;
+  }
+
+  // The gold sentences are read and evaluated in batches. Without a tokenizer,
+  // the sentences of a batch are tagged and parsed in parallel; with
+  // a tokenizer, the plain text paragraphs (separated by newdoc and newpar)
+  // are tokenized, tagged and parsed in parallel. Only the counts needed
+  // for the final scores are kept after a batch is evaluated.
+  struct paragraph {
+    string text;
+    size_t gold_begin, gold_end;
+    vector<sentence> system;
+    string error;
+
+    paragraph(size_t gold_begin) : gold_begin(gold_begin), gold_end(gold_begin) {}
+  };
+  vector<sentence> golds, systems;
+  vector<string> errors;
+  vector<paragraph> paragraphs(1, paragraph(0));
+  size_t golds_read = 0;
+  unsigned space_after_nos = 0;
+
+  evaluation_counts counts;
+  evaluation_data gold_data, system_data, gold_paragraph, system_paragraph;
+  bool different_chars = false;
+  size_t chars_compared = 0;
+
+  auto evaluate_gold_tokenization = [&]() -> bool {
+    systems.resize(max(systems.size(), golds_read));
+    errors.assign(golds_read, string());
+    run_jobs(golds_read, workers, [&](size_t index, unsigned) {
+      const sentence& gold = golds[index];
+      sentence& system = systems[index];
+      string& error = errors[index];
+
+      system.clear();
+      for (size_t i = 1; i < gold.words.size(); i++) {
+        system.add_word(gold.words[i].form);
+        if (tagger == NONE) {
+          system.words[i].upostag = gold.words[i].upostag;
+          system.words[i].xpostag = gold.words[i].xpostag;
+          system.words[i].feats = gold.words[i].feats;
+          system.words[i].lemma = gold.words[i].lemma;
+        }
+      }
+
+      if (tagger != NONE)
+        if (!m->tag(system, tagger, error))
+          return;
+      if (parser != NONE)
+        if (!m->parse(system, parser, error))
+          return;
+    });
+
+    for (size_t i = 0; i < golds_read; i++) {
+      if (!errors[i].empty()) return error.assign(errors[i]), false;
+      gold_data.add_sentence(golds[i]);
+      system_data.add_sentence(systems[i]);
+    }
+    golds_read = 0;
+
+    word_alignment alignment;
+    if (!word_alignment::perfect_alignment(system_data, gold_data, alignment))
+      return error.assign(tagger != NONE ? "Internal UDPipe error (the words of the gold data do not match)!" :
+                          "Internal UDPipe error (the words of the goldtok data do not match)!"), false;
+    counts.add_words(alignment);
+
+    gold_data.restart(gold_data.chars_end(), gold_data.words_end());
+    system_data.restart(system_data.chars_end(), system_data.words_end());
+    return true;
+  };
+
+  // The plain text data are aligned in shards consisting of whole paragraphs.
+  // A shard can end only when the system and gold characters are the same and
+  // there is no token without characters at the shard boundary, in which case
+  // the alignment and all the counts are the same as on the whole data.
+  auto evaluate_shard = [&]() {
+    word_alignment alignment;
+    word_alignment::best_alignment(system_data, gold_data, alignment);
+    counts.add_spans(system_data, gold_data);
+    counts.add_words(alignment);
+  };
+
+  auto evaluate_plain_text = [&](size_t paragraphs_size) -> bool {
+    run_jobs(paragraphs_size, workers, [&](size_t p, unsigned worker) {
+      paragraph& paragraph = paragraphs[p];
+      input_format* t = tokenizers[worker].get();
+
+      t->set_text(paragraph.text);
+      for (paragraph.system.emplace_back(); t->next_sentence(paragraph.system.back(), paragraph.error); paragraph.system.emplace_back()) {
+        sentence& system = paragraph.system.back();
+        if (tagger != NONE) {
+          if (!m->tag(system, tagger, paragraph.error))
+            return;
+
+          if (parser != NONE)
+            if (!m->parse(system, parser, paragraph.error))
+              return;
+        }
+      }
+      paragraph.system.pop_back();
+    });
+
+    for (size_t p = 0; p < paragraphs_size; p++) {
+      paragraph& paragraph = paragraphs[p];
+      if (!paragraph.error.empty()) return error.assign(paragraph.error), false;
+      if (different_chars) continue;
+
+      gold_paragraph.restart(gold_data.chars_end(), gold_data.words_end());
+      for (size_t i = paragraph.gold_begin; i < paragraph.gold_end; i++)
+        gold_paragraph.add_sentence(golds[i]);
+      system_paragraph.restart(system_data.chars_end(), system_data.words_end());
+      for (auto&& system : paragraph.system)
+        system_paragraph.add_sentence(system);
+
+      size_t boundary = gold_data.chars_end();
+      if (system_data.chars.size() == gold_data.chars.size() &&
+          !gold_data.empty_span_at(boundary) && !system_data.empty_span_at(boundary) &&
+          !gold_paragraph.empty_span_at(boundary) && !system_paragraph.empty_span_at(boundary)) {
+        evaluate_shard();
+        swap(gold_data, gold_paragraph);
+        swap(system_data, system_paragraph);
+        chars_compared = 0;
+      } else {
+        gold_data.append(gold_paragraph);
+        system_data.append(system_paragraph);
+      }
+
+      for (; chars_compared < gold_data.chars.size() && chars_compared < system_data.chars.size(); chars_compared++)
+        if (gold_data.chars[chars_compared] != system_data.chars[chars_compared]) {
+          different_chars = true;
+          break;
+        }
+    }
+
+    // Keep the sentences of the unprocessed paragraphs
+    size_t gold_offset = paragraphs_size < paragraphs.size() ? paragraphs[paragraphs_size].gold_begin : golds_read;
+    for (size_t i = gold_offset; i < golds_read; i++)
+      swap(golds[i - gold_offset], golds[i]);
+    golds_read -= gold_offset;
+    paragraphs.erase(paragraphs.begin(), paragraphs.begin() + paragraphs_size);
+    for (auto&& paragraph : paragraphs)
+      paragraph.gold_begin -= gold_offset, paragraph.gold_end -= gold_offset;
+    return true;
+  };
 
   string block;
   while (conllu_input->read_block(is, block)) {
     conllu_input->set_text(block);
-    while (conllu_input->next_sentence(gold, error)) {
-      gold_data.add_sentence(gold);
+    while (true) {
+      if (golds_read == golds.size()) golds.emplace_back();
+      if (!conllu_input->next_sentence(golds[golds_read], error)) break;
+      const sentence& gold = golds[golds_read++];
 
       // Detokenize the input when tokenizing
       if (tokenizer != NONE) {
         if (gold.get_new_doc() || gold.get_new_par()) {
-          plain_text_paragraphs.back().append("\n\n");
-          plain_text_paragraphs.emplace_back();
+          paragraphs.back().text.append("\n\n");
+          paragraphs.back().gold_end = golds_read - 1;
+          paragraphs.emplace_back(golds_read - 1);
         }
 
         for (size_t i = 1, j = 0; i < gold.words.size(); i++) {
           const token& tok = j < gold.multiword_tokens.size() && gold.multiword_tokens[j].id_first == int(i) ? (const token&)gold.multiword_tokens[j] : (const token&)gold.words[i];
-          plain_text_paragraphs.back().append(tok.form);
+          paragraphs.back().text.append(tok.form);
           if (tok.get_space_after())
-            plain_text_paragraphs.back().push_back(' ');
+            paragraphs.back().text.push_back(' ');
           else
             space_after_nos += 1;
           if (j < gold.multiword_tokens.size() && gold.multiword_tokens[j].id_first == int(i))
             i = gold.multiword_tokens[j++].id_last;
         }
-      }
-
-      // Goldtok data
-      if (tokenizer == NONE && tagger != NONE) {
-        system.clear();
-        for (size_t i = 1; i < gold.words.size(); i++)
-          system.add_word(gold.words[i].form);
-
-        if (tagger != NONE) {
-          if (!m->tag(system, tagger, error))
-            return false;
-          if (parser != NONE)
-            if (!m->parse(system, parser, error))
-              return false;
-        }
-        system_goldtok_data.add_sentence(system);
-      }
 
-      // Goldtok_goldtags data
-      if (tokenizer == NONE && tagger == NONE && parser != NONE) {
-        system.clear();
-        for (size_t i = 1; i < gold.words.size(); i++) {
-          system.add_word(gold.words[i].form);
-          system.words[i].upostag = gold.words[i].upostag;
-          system.words[i].xpostag = gold.words[i].xpostag;
-          system.words[i].feats = gold.words[i].feats;
-          system.words[i].lemma = gold.words[i].lemma;
-        }
-        if (parser != NONE)
-          if (!m->parse(system, parser, error))
+        // Evaluate the completed paragraphs
+        if (paragraphs.back().gold_begin >= batch_sentences)
+          if (!evaluate_plain_text(paragraphs.size() - 1))
             return false;
-        system_goldtok_goldtags_data.add_sentence(system);
+      } else if (golds_read >= batch_sentences) {
+        if (!evaluate_gold_tokenization())
+          return false;
       }
     }
     if (!error.empty()) return false;
   }
 
-  // Tokenize, tag and parse plaintext input
+  // Evaluate the remaining sentences
   if (tokenizer != NONE) {
-    unique_ptr<input_format> t(m->new_tokenizer(tokenizer));
-    if (!t) return error.assign("Cannot allocate new tokenizer!"), false;
-
-    for (auto&& plain_text : plain_text_paragraphs) {
-      t->set_text(plain_text);
-      while (t->next_sentence(system, error)) {
-        if (tagger != NONE) {
-          if (!m->tag(system, tagger, error))
-            return false;
-
-          if (parser != NONE)
-            if (!m->parse(system, parser, error))
-              return false;
-        }
-        system_plaintext_data.add_sentence(system);
-      }
-      if (!error.empty()) return false;
-    }
+    paragraphs.back().gold_end = golds_read;
+    if (!evaluate_plain_text(paragraphs.size()))
+      return false;
+    if (!different_chars && system_data.chars.size() == gold_data.chars.size())
+      evaluate_shard();
+    else
+      different_chars = true;
+  } else if (tagger != NONE || parser != NONE) {
+    if (!evaluate_gold_tokenization())
+      return false;
   }
 
   // Evaluate from plain text
   if (tokenizer != NONE) {
-    if (system_plaintext_data.chars != gold_data.chars) {
+    if (different_chars) {
       os << "Cannot evaluate tokenizer, it returned different sequence of token characters!" << endl;
     } else {
-      word_alignment plaintext_alignment;
-      word_alignment::best_alignment(system_plaintext_data, gold_data, plaintext_alignment);
-
       os << "Number of SpaceAfter=No features in gold data: " << space_after_nos << endl;
 
-      auto tokens = evaluate_f1(system_plaintext_data.tokens, gold_data.tokens);
-      auto multiwords = evaluate_f1(system_plaintext_data.multiwords, gold_data.multiwords);
-      auto sentences = evaluate_f1(system_plaintext_data.sentences, gold_data.sentences);
-      auto words = plaintext_alignment.evaluate_f1([](const word&, const word&) {return true;});
+      f1_info tokens(counts.tokens), multiwords(counts.multiwords), sentences(counts.sentences), words(counts.words);
       if (multiwords.total_gold || multiwords.total_system)
         os << "Tokenizer tokens - system: " << tokens.total_system << ", gold: " << tokens.total_gold
            << ", precision: " << fixed << setprecision(2) << 100. * tokens.precision
@@ -164,11 +306,7 @@ bool evaluator::evaluate(istream& is, ostream& os, string& error) const {
          << "%, recall: " << 100. * sentences.recall << "%, f1: " << 100. * sentences.f1 << "%" << endl;
 
       if (tagger != NONE) {
-        auto upostags = plaintext_alignment.evaluate_f1([](const word& w, const word& u) { return w.upostag == u.upostag; });
-        auto xpostags = plaintext_alignment.evaluate_f1([](const word& w, const word& u) { return w.xpostag == u.xpostag; });
-        auto feats = plaintext_alignment.evaluate_f1([](const word& w, const word& u) { return w.feats == u.feats; });
-        auto alltags = plaintext_alignment.evaluate_f1([](const word& w, const word& u) { return w.upostag == u.upostag && w.xpostag == u.xpostag && w.feats == u.feats; });
-        auto lemmas = plaintext_alignment.evaluate_f1([](const word& w, const word& u) { return w.lemma == u.lemma; });
+        f1_info upostags(counts.upostags), xpostags(counts.xpostags), feats(counts.feats), alltags(counts.alltags), lemmas(counts.lemmas);
         os << "Tagging from plain text (CoNLL17 F1 score) - gold forms: " << upostags.total_gold << ", upostag: "
            << fixed << setprecision(2) << 100. * upostags.f1 << "%, xpostag: "
            << 100. * xpostags.f1 << "%, feats: " << 100. * feats.f1 << "%, alltags: "
@@ -176,8 +314,7 @@ bool evaluator::evaluate(istream& is, ostream& os, string& error) const {
       }
 
       if (tagger != NONE && parser != NONE) {
-        auto uas = plaintext_alignment.evaluate_f1([](const word& w, const word& u) { return w.head == u.head; });
-        auto las = plaintext_alignment.evaluate_f1([](const word& w, const word& u) { return w.head == u.head && w.deprel == u.deprel; });
+        f1_info uas(counts.uas), las(counts.las);
         os << "Parsing from plain text with computed tags (CoNLL17 F1 score) - gold forms: " << uas.total_gold
            << ", UAS: " << fixed << setprecision(2) << 100. * uas.f1 << "%, LAS: " << 100. * las.f1 << '%' << endl;
       }
@@ -186,23 +323,14 @@ bool evaluator::evaluate(istream& is, ostream& os, string& error) const {
 
   // Evaluate tagger from gold tokenization
   if (tokenizer == NONE && tagger != NONE) {
-    word_alignment goldtok_alignment;
-    if (!word_alignment::perfect_alignment(system_goldtok_data, gold_data, goldtok_alignment))
-      return error.assign("Internal UDPipe error (the words of the gold data do not match)!"), false;
-
-    auto upostags = goldtok_alignment.evaluate_f1([](const word& w, const word& u) { return w.upostag == u.upostag; });
-    auto xpostags = goldtok_alignment.evaluate_f1([](const word& w, const word& u) { return w.xpostag == u.xpostag; });
-    auto feats = goldtok_alignment.evaluate_f1([](const word& w, const word& u) { return w.feats == u.feats; });
-    auto alltags = goldtok_alignment.evaluate_f1([](const word& w, const word& u) { return w.upostag == u.upostag && w.xpostag == u.xpostag && w.feats == u.feats; });
-    auto lemmas = goldtok_alignment.evaluate_f1([](const word& w, const word& u) { return w.lemma == u.lemma; });
+    f1_info upostags(counts.upostags), xpostags(counts.xpostags), feats(counts.feats), alltags(counts.alltags), lemmas(counts.lemmas);
     os << "Tagging from gold tokenization - forms: " << upostags.total_gold << ", upostag: "
        << fixed << setprecision(2) << 100. * upostags.f1 << "%, xpostag: "
        << 100. * xpostags.f1 << "%, feats: " << 100. * feats.f1 << "%, alltags: "
        << 100. * alltags.f1 << "%, lemmas: " << 100. * lemmas.f1 << '%' << endl;
 
     if (parser != NONE) {
-      auto uas = goldtok_alignment.evaluate_f1([](const word& w, const word& u) { return w.head == u.head; });
-      auto las = goldtok_alignment.evaluate_f1([](const word& w, const word& u) { return w.head == u.head && w.deprel == u.deprel; });
+      f1_info uas(counts.uas), las(counts.las);
       os << "Parsing from gold tokenization with computed tags - forms: " << uas.total_gold
          << ", UAS: " << fixed << setprecision(2) << 100. * uas.f1 << "%, LAS: " << 100. * las.f1 << '%' << endl;
     }
@@ -210,12 +338,7 @@ bool evaluator::evaluate(istream& is, ostream& os, string& error) const {
 
   // Evaluate parser from gold tokenization
   if (tokenizer == NONE && tagger == NONE && parser != NONE) {
-    word_alignment goldtok_goldtags_alignment;
-    if (!word_alignment::perfect_alignment(system_goldtok_goldtags_data, gold_data, goldtok_goldtags_alignment))
-      return error.assign("Internal UDPipe error (the words of the goldtok data do not match)!"), false;
-
-    auto uas = goldtok_goldtags_alignment.evaluate_f1([](const word& w, const word& u) { return w.head == u.head; });
-    auto las = goldtok_goldtags_alignment.evaluate_f1([](const word& w, const word& u) { return w.head == u.head && w.deprel == u.deprel; });
+    f1_info uas(counts.uas), las(counts.las);
     os << "Parsing from gold tokenization with gold tags - forms: " << uas.total_gold
        << ", UAS: " << fixed << setprecision(2) << 100. * uas.f1 << "%, LAS: " << 100. * las.f1 << '%' << endl;
   }
@@ -223,71 +346,114 @@ bool evaluator::evaluate(istream& is, ostream& os, string& error) const {
   return true;
 }
 
+evaluator::f1_counts& evaluator::f1_counts::operator+=(const f1_counts& other) {
+  total_system += other.total_system;
+  total_gold += other.total_gold;
+  both += other.both;
+  return *this;
+}
+
+evaluator::f1_info::f1_info(const f1_counts& counts)
+  : total_system(counts.total_system), total_gold(counts.total_gold),
+    precision(total_system ? counts.both / double(total_system) : 0.),
+    recall(total_gold ? counts.both / double(total_gold) : 0.),
+    f1(total_system+total_gold ? 2 * counts.both / double(total_system + total_gold) : 0.) {}
+
 template <class T>
-evaluator::f1_info evaluator::evaluate_f1(const vector<pair<size_t, T>>& system, const vector<pair<size_t, T>>& gold) {
-  size_t both = 0;
+evaluator::f1_counts evaluator::evaluate_f1(const vector<pair<size_t, T>>& system, const vector<pair<size_t, T>>& gold) {
+  f1_counts counts;
   for (size_t si = 0, gi = 0; si < system.size() || gi < gold.size(); )
     if (si < system.size() && (gi == gold.size() || system[si].first < gold[gi].first))
       si++;
     else if (gi < gold.size() && (si == system.size() || gold[gi].first < system[si].first))
       gi++;
     else
-      both += system[si++].second == gold[gi++].second;
+      counts.both += system[si++].second == gold[gi++].second;
 
-  return {system.size(), gold.size(), system.size() ? both / double(system.size()) : 0.,
-    gold.size() ? both / double(gold.size()) : 0., system.size()+gold.size() ? 2 * both / double(system.size() + gold.size()) : 0. };
+  counts.total_system = system.size();
+  counts.total_gold = gold.size();
+  return counts;
 }
 
 evaluator::evaluation_data::word_data::word_data(size_t start, size_t end, int id, bool is_multiword, const word& w)
-  : start(start), end(end), is_multiword(is_multiword), w(w)
+  : start(start), end(end), is_multiword(is_multiword), w(id, w.form)
 {
-  // Use absolute ids for words and heads
-  this->w.id = id;
+  // Only the evaluated fields are stored, using absolute ids for heads.
+  this->w.lemma = w.lemma;
+  this->w.upostag = w.upostag;
+  this->w.xpostag = w.xpostag;
+  this->w.feats = w.feats;
   this->w.head = w.head ? id + (w.head - w.id) : 0;
 
-  // Forms in MWTs are compares case-insensitively in LCS, therefore
-  // we lowercase them here.
-  unilib::utf8::map(unilib::unicode::lowercase, w.form, this->w.form);
-
   // During evaluation, only universal part of DEPREL (up to a colon) is used.
-  auto colon = w.deprel.find(':');
-  if (colon != string::npos)
-    this->w.deprel.erase(colon);
+  this->w.deprel.assign(w.deprel, 0, w.deprel.find(':'));
 }
 
 void evaluator::evaluation_data::add_sentence(const sentence& s) {
-  sentences.emplace_back(chars.size(), chars.size());
+  string lowercased;
+  sentences.emplace_back(chars_end(), chars_end());
   for (size_t i = 1, j = 0; i < s.words.size(); i++) {
-    tokens.emplace_back(chars.size(), chars.size());
+    tokens.emplace_back(chars_end(), chars_end());
     const string& form = j < s.multiword_tokens.size() && s.multiword_tokens[j].id_first == int(i) ? s.multiword_tokens[j].form : s.words[i].form;
-    for (auto&& chr : unilib::utf8::decoder(form))
+    for (auto&& chr : form)
       if (chr != ' ')
         chars.push_back(chr);
-    tokens.back().second = chars.size();
+    tokens.back().second = chars_end();
 
     if (j < s.multiword_tokens.size() && s.multiword_tokens[j].id_first == int(i)) {
       multiwords.emplace_back(tokens.back().first, form);
       for (size_t k = i; int(k) <= s.multiword_tokens[j].id_last; k++) {
-        words.emplace_back(tokens.back().first, tokens.back().second, (int)words.size() + 1, true, s.words[k]);
-        multiwords.back().second.append(" ").append(words.back().w.form);
+        words.emplace_back(tokens.back().first, tokens.back().second, (int)words_end() + 1, true, s.words[k]);
+        // Forms in MWTs are compared case-insensitively.
+        utf8_ascii::lowercase(s.words[k].form, lowercased);
+        multiwords.back().second.append(" ").append(lowercased);
       }
       i = s.multiword_tokens[j++].id_last;
     } else {
-      words.emplace_back(tokens.back().first, tokens.back().second, (int)words.size() + 1, false, s.words[i]);
+      words.emplace_back(tokens.back().first, tokens.back().second, (int)words_end() + 1, false, s.words[i]);
     }
   }
-  sentences.back().second = chars.size();
+  sentences.back().second = chars_end();
+}
+
+void evaluator::evaluation_data::append(const evaluation_data& other) {
+  chars.append(other.chars);
+  sentences.insert(sentences.end(), other.sentences.begin(), other.sentences.end());
+  tokens.insert(tokens.end(), other.tokens.begin(), other.tokens.end());
+  multiwords.insert(multiwords.end(), other.multiwords.begin(), other.multiwords.end());
+  words.insert(words.end(), other.words.begin(), other.words.end());
+}
+
+void evaluator::evaluation_data::restart(size_t chars_offset, size_t words_offset) {
+  this->chars_offset = chars_offset;
+  this->words_offset = words_offset;
+  chars.clear();
+  sentences.clear();
+  tokens.clear();
+  multiwords.clear();
+  words.clear();
+}
+
+bool evaluator::evaluation_data::empty_span_at(size_t position) const {
+  // Empty tokens and sentences at the given position must be either
+  // the first or the last ones, given that the data are contiguous.
+  for (auto&& spans : {&sentences, &tokens})
+    if (!spans->empty() && ((spans->front().first == position && spans->front().second == position) ||
+                            (spans->back().first == position && spans->back().second == position)))
+      return true;
+  return false;
 }
 
 template <class Equals>
-evaluator::f1_info evaluator::word_alignment::evaluate_f1(Equals equals) {
-  size_t both = 0;
+evaluator::f1_counts evaluator::word_alignment::evaluate_f1(Equals equals) const {
+  f1_counts counts;
   for (auto&& match : matched)
-    if (equals(match.system, match.gold))
-      both++;
+    if (equals(match))
+      counts.both++;
 
-  return {total_system, total_gold, total_system ? both / double(total_system) : 0.,
-    total_gold ? both / double(total_gold) : 0., total_system+total_gold ? 2 * both / double(total_system + total_gold) : 0. };
+  counts.total_system = total_system;
+  counts.total_gold = total_gold;
+  return counts;
 }
 
 bool evaluator::word_alignment::perfect_alignment(const evaluation_data& system, const evaluation_data& gold, word_alignment& alignment) {
@@ -300,7 +466,7 @@ bool evaluator::word_alignment::perfect_alignment(const evaluation_data& system,
   for (size_t i = 0; i < system.words.size(); i++) {
     if (system.words[i].w.form != gold.words[i].w.form)
       return false;
-    alignment.matched.emplace_back(system.words[i].w, gold.words[i].w);
+    alignment.matched.emplace_back(system.words[i].w, gold.words[i].w, system.words[i].w.head);
   }
 
   return true;
@@ -311,12 +477,21 @@ void evaluator::word_alignment::best_alignment(const evaluation_data& system, co
   alignment.total_gold = gold.words.size();
   alignment.matched.clear();
 
+  // Map system word ids to aligned gold word ids, used to reindex system heads.
+  vector<int> gold_aligned(system.words.size(), -1);
+  auto match = [&](size_t si, size_t gi) {
+    alignment.matched.emplace_back(system.words[si].w, gold.words[gi].w, system.words[si].w.head);
+    gold_aligned[si] = gold.words[gi].w.id;
+  };
+
+  vector<unsigned> lcs;
+  vector<string> system_forms, gold_forms;
   for (size_t si = 0, gi = 0; si < system.words.size() && gi < gold.words.size(); )
     if ((system.words[si].start > gold.words[gi].start || !system.words[si].is_multiword) &&
         (gold.words[gi].start > system.words[si].start || !gold.words[gi].is_multiword)) {
       // No multiword, align using start+end indices
       if (system.words[si].start == gold.words[gi].start && system.words[si].end == gold.words[gi].end)
-        alignment.matched.emplace_back(system.words[si++].w, gold.words[gi++].w);
+        match(si++, gi++);
       else if (system.words[si].start <= gold.words[gi].start)
         si++;
       else
@@ -340,35 +515,54 @@ void evaluator::word_alignment::best_alignment(const evaluation_data& system, co
         }
       }
 
-      // LCS on the chosen words
-      vector<vector<unsigned>> lcs(si - ss);
-      for (unsigned s = si - ss; s--; ) {
-        lcs[s].resize(gi - gs);
-        for (unsigned g = gi - gs; g--; ) {
-          lcs[s][g] = max(lcs[s][g], s+1 < lcs.size() ? lcs[s+1][g] : 0);
-          lcs[s][g] = max(lcs[s][g], g+1 < lcs[s].size() ? lcs[s][g+1] : 0);
-          if (system.words[ss + s].w.form == gold.words[gs + g].w.form)
-            lcs[s][g] = max(lcs[s][g], 1 + (s+1 < lcs.size() && g+1 < lcs[s].size() ? lcs[s+1][g+1] : 0));
-        }
-      }
-
-      for (unsigned s = 0, g = 0; s < si - ss && g < gi - gs; ) {
-        if (system.words[ss + s].w.form == gold.words[gs + g].w.form)
-          alignment.matched.emplace_back(system.words[ss + s++].w, gold.words[gs + g++].w);
-        else if (lcs[s][g] == (s+1 < lcs.size() ? lcs[s+1][g] : 0))
+      // LCS on the chosen words, comparing the forms case-insensitively;
+      // lcs[s * gn + g] is the LCS length of system words from s and gold words from g.
+      size_t sn = si - ss, gn = gi - gs;
+      system_forms.resize(max(system_forms.size(), sn));
+      for (size_t s = 0; s < sn; s++)
+        utf8_ascii::lowercase(system.words[ss + s].w.form, system_forms[s]);
+      gold_forms.resize(max(gold_forms.size(), gn));
+      for (size_t g = 0; g < gn; g++)
+        utf8_ascii::lowercase(gold.words[gs + g].w.form, gold_forms[g]);
+
+      lcs.assign(sn * gn, 0);
+      auto lcs_at = [&lcs, sn, gn](size_t s, size_t g) { return s < sn && g < gn ? lcs[s * gn + g] : 0U; };
+      for (size_t s = sn; s--; )
+        for (size_t g = gn; g--; )
+          lcs[s * gn + g] = system_forms[s] == gold_forms[g] ? 1 + lcs_at(s + 1, g + 1) : max(lcs_at(s + 1, g), lcs_at(s, g + 1));
+
+      for (size_t s = 0, g = 0; s < sn && g < gn; ) {
+        if (system_forms[s] == gold_forms[g])
+          match(ss + s++, gs + g++);
+        else if (lcs_at(s, g) == lcs_at(s + 1, g))
           s++;
-        else /* if (lcs[s][g] == (g+1 < lcs[s].size() ? lcs[s][g+1] : 0)) */
+        else
           g++;
       }
     }
 
   // Reindex HEAD pointers in system to use gold indices
-  vector<int> gold_aligned(system.words.size(), -1);
-  for (auto&& match : alignment.matched)
-    gold_aligned[match.system.id - 1] = match.gold.id;
   for (auto&& match : alignment.matched)
-    if (match.system.head > 0)
-      match.system.head = gold_aligned[match.system.head - 1];
+    if (match.system_head > 0)
+      match.system_head = gold_aligned[match.system_head - 1 - system.words_offset];
+}
+
+void evaluator::evaluation_counts::add_spans(const evaluation_data& system, const evaluation_data& gold) {
+  tokens += evaluate_f1(system.tokens, gold.tokens);
+  multiwords += evaluate_f1(system.multiwords, gold.multiwords);
+  sentences += evaluate_f1(system.sentences, gold.sentences);
+}
+
+void evaluator::evaluation_counts::add_words(const word_alignment& alignment) {
+  typedef word_alignment::pair_system_gold pair;
+  words += alignment.evaluate_f1([](const pair&) { return true; });
+  upostags += alignment.evaluate_f1([](const pair& p) { return p.system.upostag == p.gold.upostag; });
+  xpostags += alignment.evaluate_f1([](const pair& p) { return p.system.xpostag == p.gold.xpostag; });
+  feats += alignment.evaluate_f1([](const pair& p) { return p.system.feats == p.gold.feats; });
+  alltags += alignment.evaluate_f1([](const pair& p) { return p.system.upostag == p.gold.upostag && p.system.xpostag == p.gold.xpostag && p.system.feats == p.gold.feats; });
+  lemmas += alignment.evaluate_f1([](const pair& p) { return p.system.lemma == p.gold.lemma; });
+  uas += alignment.evaluate_f1([](const pair& p) { return p.system_head == p.gold.head; });
+  las += alignment.evaluate_f1([](const pair& p) { return p.system_head == p.gold.head && p.system.deprel == p.gold.deprel; });
 }
 
 } // namespace udpipe
@@ -25,6 +25,7 @@ class evaluator {
   void set_tokenizer(const string& tokenizer);
   void set_tagger(const string& tagger);
   void set_parser(const string& parser);
+  void set_threads(unsigned threads);
 
   bool evaluate(istream& is, ostream& os, string& error) const;
 
@@ -34,11 +35,25 @@ class evaluator {
  private:
   const model* m;
   string tokenizer, tagger, parser;
+  unsigned threads;
 
-  struct f1_info { size_t total_system, total_gold; double precision, recall, f1; };
+  struct f1_counts {
+    size_t total_system, total_gold, both;
+
+    f1_counts() : total_system(0), total_gold(0), both(0) {}
+    f1_counts& operator+=(const f1_counts& other);
+  };
+  struct f1_info {
+    size_t total_system, total_gold; double precision, recall, f1;
+
+    f1_info(const f1_counts& counts);
+  };
   template <class T>
-  static f1_info evaluate_f1(const vector<pair<size_t, T>>& system, const vector<pair<size_t, T>>& gold);
+  static f1_counts evaluate_f1(const vector<pair<size_t, T>>& system, const vector<pair<size_t, T>>& gold);
 
+  // The evaluation data store a contiguous part of the evaluated sentences,
+  // using absolute positions in the UTF-8 bytes of the non-space token
+  // characters and absolute word ids.
   class evaluation_data {
    public:
     struct word_data {
@@ -49,9 +64,17 @@ class evaluator {
       word_data(size_t start, size_t end, int id, bool is_multiword, const word& w);
     };
 
-    void add_sentence(const sentence& s);
+    evaluation_data() : chars_offset(0), words_offset(0) {}
 
-    u32string chars;
+    void add_sentence(const sentence& s);
+    void append(const evaluation_data& other);
+    void restart(size_t chars_offset, size_t words_offset);
+    size_t chars_end() const { return chars_offset + chars.size(); }
+    size_t words_end() const { return words_offset + words.size(); }
+    bool empty_span_at(size_t position) const;
+
+    size_t chars_offset, words_offset;
+    string chars;
     vector<pair<size_t, size_t>> sentences, tokens;
     vector<pair<size_t, string>> multiwords;
     vector<word_data> words;
@@ -60,18 +83,25 @@ class evaluator {
   class word_alignment {
    public:
     struct pair_system_gold {
-      word system; const word& gold;
-      pair_system_gold(const word& system, const word& gold) : system(system), gold(gold) {}
+      const word& system; const word& gold; int system_head;
+      pair_system_gold(const word& system, const word& gold, int system_head) : system(system), gold(gold), system_head(system_head) {}
     };
     vector<pair_system_gold> matched;
     size_t total_system, total_gold;
 
     template <class Equals>
-    f1_info evaluate_f1(Equals equals);
+    f1_counts evaluate_f1(Equals equals) const;
 
     static bool perfect_alignment(const evaluation_data& system, const evaluation_data& gold, word_alignment& alignment);
     static void best_alignment(const evaluation_data& system, const evaluation_data& gold, word_alignment& alignment);
   };
+
+  struct evaluation_counts {
+    f1_counts tokens, multiwords, sentences, words, upostags, xpostags, feats, alltags, lemmas, uas, las;
+
+    void add_spans(const evaluation_data& system, const evaluation_data& gold);
+    void add_words(const word_alignment& alignment);
+  };
 };
 
 } // namespace udpipe
@@ -8,6 +8,9 @@
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
 
 #include "model_morphodita_parsito.h"
 #include "morphodita/tagger/tagger_ids.h"
@@ -17,6 +20,7 @@
 #include "utils/getpara.h"
 #include "utils/parse_double.h"
 #include "utils/parse_int.h"
+#include "utils/utf8_ascii.h"
 
 namespace ufal {
 namespace udpipe {
@@ -38,8 +42,15 @@ input_format* model_morphodita_parsito::new_tokenizer(const string& options) con
   bool normalized_spaces = parsed_options.count("normalized_spaces");
   bool token_ranges = parsed_options.count("ranges");
 
+  int threads = 1;
+  if (parsed_options.count("threads") && !parse_int(parsed_options["threads"], "tokenizer threads", threads, parse_error))
+    return nullptr;
+
   const auto* morpho = !taggers.empty() ? taggers[0].tagger->get_morpho() : nullptr;
-  unique_ptr<input_format> result(new morphodita_tokenizer_wrapper(tokenizer_factory->new_tokenizer(morpho), splitter.get(), normalized_spaces, token_ranges));
+  vector<morphodita::tokenizer*> parallel_tokenizers;
+  for (int i = 1; i < threads; i++)
+    parallel_tokenizers.push_back(tokenizer_factory->new_tokenizer(morpho));
+  unique_ptr<input_format> result(new morphodita_tokenizer_wrapper(tokenizer_factory->new_tokenizer(morpho), splitter.get(), normalized_spaces, token_ranges, parallel_tokenizers));
 
   // Presegmented
   if (parsed_options.count("presegmented") && result)
@@ -59,7 +70,7 @@ input_format* model_morphodita_parsito::new_tokenizer(const string& options) con
     if (parsed_options.count("joint_sentence_logprob") && !parse_double(parsed_options["joint_sentence_logprob"], "joint sentence logprob", sentence_logprob, parse_error))
       return nullptr;
 
-    result.reset(new joint_with_parsing_tokenizer(result.release(), *this, max_sentence_len, change_boundary_logprob, sentence_logprob));
+    result.reset(new joint_with_parsing_tokenizer(result.release(), *this, max_sentence_len, change_boundary_logprob, sentence_logprob, threads));
   }
 
   return result.release();
@@ -130,20 +141,30 @@ bool model_morphodita_parsito::parse(sentence& s, const string& options, string&
   if (c->options.count("beam_search"))
     if (!parse_int(c->options["beam_search"], "beam_search", beam_search, error))
       return false;
+  bool quantized = c->options.count("quantized");
 
+  // The parser uses the words through node views, only the normalized forms
+  // and lemmas are stored separately.
   c->tree.clear();
+  if (c->views.size() < s.words.size()) c->views.resize(s.words.size());
+  if (c->forms_normalized.size() < s.words.size()) c->forms_normalized.resize(s.words.size());
+  if (c->lemmas_normalized.size() < s.words.size()) c->lemmas_normalized.resize(s.words.size());
+
+  auto& root = c->views[0];
+  root.form = root.lemma = root.upostag = root.xpostag = root.feats = parsito::tree::root_form;
+  root.misc = string_piece();
   for (size_t i = 1; i < s.words.size(); i++) {
     c->tree.add_node(string());
-    normalize_form(s.words[i].form, c->tree.nodes.back().form);
-    normalize_lemma(s.words[i].lemma, c->tree.nodes.back().lemma);
-    c->tree.nodes.back().upostag.assign(s.words[i].upostag);
-    c->tree.nodes.back().xpostag.assign(s.words[i].xpostag);
-    c->tree.nodes.back().feats.assign(s.words[i].feats);
-    c->tree.nodes.back().deps.assign(s.words[i].deps);
-    c->tree.nodes.back().misc.assign(s.words[i].misc);
+    auto& view = c->views[i];
+    view.form = normalize_form(s.words[i].form, c->forms_normalized[i]);
+    view.lemma = normalize_lemma(s.words[i].lemma, c->lemmas_normalized[i]);
+    view.upostag = s.words[i].upostag;
+    view.xpostag = s.words[i].xpostag;
+    view.feats = s.words[i].feats;
+    view.misc = s.words[i].misc;
   }
 
-  parser->parse(c->tree, beam_search, cost);
+  parser->parse(c->tree, beam_search, cost, quantized, &c->views);
   for (size_t i = 1; i < s.words.size(); i++)
     s.set_head(i, c->tree.nodes[i].head, c->tree.nodes[i].deprel);
 
@@ -151,6 +172,17 @@ bool model_morphodita_parsito::parse(sentence& s, const string& options, string&
   return true;
 }
 
+void model_morphodita_parsito::set_parser_cache_size(unsigned cache) {
+  if (parser) parser->set_cache_size(cache);
+}
+
+bool model_morphodita_parsito::parser_cache_statistics(parsito::parser::cache_statistics& statistics) const {
+  if (!parser) return false;
+
+  parser->get_cache_statistics(statistics);
+  return true;
+}
+
 model* model_morphodita_parsito::load(istream& is) {
   char version;
   if (!is.get(version)) return nullptr;
@@ -239,22 +271,41 @@ bool model_morphodita_parsito::joint_with_parsing_tokenizer::next_sentence(sente
     tokenizer->set_text(text, false);
 
     sentence input;
-    vector<sentence> paragraph;
+    vector<vector<sentence>> paragraphs;
     while (tokenizer->next_sentence(input, error)) {
-      if (input.get_new_par() && !paragraph.empty()) {
-        if (!parse_paragraph(paragraph, error)) return false;
-        for (auto&& sentence : paragraph)
-          sentences.push_back(sentence);
-        paragraph.clear();
-      }
-      paragraph.push_back(input);
+      if (paragraphs.empty() || input.get_new_par())
+        paragraphs.emplace_back();
+      paragraphs.back().push_back(input);
     }
     if (!error.empty()) return false;
 
-    if (!paragraph.empty()) {
-      if (!parse_paragraph(paragraph, error)) return false;
-      for (auto&& sentence : paragraph)
-        sentences.push_back(sentence);
+    // The paragraphs are segmented independently, possibly in parallel
+    atomic<size_t> next_paragraph(0);
+    vector<string> errors(paragraphs.size());
+    auto parse = [this, &paragraphs, &next_paragraph, &errors]() {
+      for (size_t i; (i = next_paragraph++) < paragraphs.size(); )
+        parse_paragraph(paragraphs[i], errors[i]);
+    };
+
+    vector<thread> workers;
+    for (int i = 1; i < threads && size_t(i) < paragraphs.size(); i++)
+      workers.emplace_back(parse);
+    parse();
+    for (auto&& worker : workers)
+      worker.join();
+
+    for (size_t i = 0; i < paragraphs.size(); i++) {
+      if (!errors[i].empty()) return error.assign(errors[i]), false;
+      if (paragraphs[i].empty()) continue;
+
+      if (new_document) {
+        paragraphs[i].front().set_new_doc(true, document_id);
+        new_document = false;
+      }
+      paragraphs[i].front().set_new_par(true);
+
+      for (auto&& sentence : paragraphs[i])
+        sentences.push_back(std::move(sentence));
     }
 
     text.len = 0;
@@ -294,23 +345,28 @@ bool model_morphodita_parsito::joint_with_parsing_tokenizer::parse_paragraph(vec
   vector<double> best_logprob(all_words.words.size(), -numeric_limits<double>::infinity()); best_logprob[0] = 0.;
   vector<unsigned> best_length(all_words.words.size(), 0);
   sentence s;
+  string key;
 
   for (unsigned start = 1; start < all_words.words.size(); start++) {
     if (!token_boundary[start - 1]) continue;
     s.clear();
+    key.clear();
     for (unsigned end = start + 1; end <= all_words.words.size() && (end - start) <= unsigned(max_sentence_len); end++) {
       s.words.push_back(all_words.words[end - 1]);
       s.words.back().id -= start - 1;
+      for (auto* field : {&s.words.back().form, &s.words.back().lemma, &s.words.back().upostag,
+                          &s.words.back().xpostag, &s.words.back().feats, &s.words.back().misc})
+        key.append(*field).push_back('\0');
       if (!token_boundary[end - 1]) continue;
 
-      for (unsigned i = 1; i < s.words.size(); i++) {
-        s.words[i].head = -1;
-        s.words[i].children.clear();
-      }
+      // The parser cost is a log probability and therefore nonpositive,
+      // so the span cannot be used if it is not better even with zero cost.
+      double span_logprob = sentence_logprob + change_boundary_logprob * (2 - int(sentence_boundary[start - 1]) - int(sentence_boundary[end - 1]));
+      if (!(best_logprob[start - 1] + span_logprob > best_logprob[end - 1])) continue;
 
       double cost;
-      if (!model.parse(s, DEFAULT, error, &cost)) return false;
-      cost += sentence_logprob + change_boundary_logprob * (2 - int(sentence_boundary[start - 1]) - int(sentence_boundary[end - 1]));
+      if (!span_cost(s, key, cost, error)) return false;
+      cost += span_logprob;
       if (best_logprob[start - 1] + cost > best_logprob[end - 1]) {
         best_logprob[end - 1] = best_logprob[start - 1] + cost;
         best_length[end - 1] = end - start;
@@ -345,15 +401,25 @@ bool model_morphodita_parsito::joint_with_parsing_tokenizer::parse_paragraph(vec
     }
   }
 
-  if (!paragraph.empty()) {
-    if (new_document) {
-      paragraph.front().set_new_doc(true, document_id);
-      new_document = false;
-    }
+  return true;
+}
+
+bool model_morphodita_parsito::joint_with_parsing_tokenizer::span_cost(sentence& s, const string& key, double& cost, string& error) {
+  {
+    lock_guard<mutex> lock(costs_mutex);
+    auto it = costs.find(key);
+    if (it != costs.end()) return cost = it->second, true;
+  }
 
-    paragraph.front().set_new_par(true);
+  for (unsigned i = 1; i < s.words.size(); i++) {
+    s.words[i].head = -1;
+    s.words[i].children.clear();
   }
+  if (!model.parse(s, DEFAULT, error, &cost)) return false;
 
+  lock_guard<mutex> lock(costs_mutex);
+  if (costs.size() >= COSTS_CACHE_SIZE) costs.clear();
+  costs.emplace(key, cost);
   return true;
 }
 
@@ -462,6 +528,10 @@ const string& model_morphodita_parsito::normalize_form(string_piece form, string
   //    (some "weak" words would become even more ambiguous or appear as if
   //    with a first-person pronoun clitic)
 
+  // ASCII forms without spaces are not modified
+  if (utf8_ascii::prefix(form.str, form.len) == form.len && !memchr(form.str, ' ', form.len))
+    return output.assign(form.str, form.len);
+
   output.clear();
   for (auto&& chr : utf8::decoder(form.str, form.len)) {
     // Arabic normalization
@@ -9,6 +9,9 @@
 
 #pragma once
 
+#include <mutex>
+#include <unordered_map>
+
 #include "common.h"
 #include "model.h"
 #include "morphodita/tokenizer/tokenizer_factory.h"
@@ -29,6 +32,11 @@ class model_morphodita_parsito : public model {
 
   static model* load(istream& is);
 
+  // The parser embeddings cache size in megabytes, which should be set
+  // after loading the model; parsito::parser::DEFAULT_CACHE is used otherwise.
+  void set_parser_cache_size(unsigned cache);
+  bool parser_cache_statistics(parsito::parser::cache_statistics& statistics) const;
+
  private:
   model_morphodita_parsito(unsigned version);
   unsigned version;
@@ -55,6 +63,8 @@ class model_morphodita_parsito : public model {
 
   struct parser_cache {
     parsito::tree tree;
+    vector<parsito::node_view> views;
+    vector<string> forms_normalized, lemmas_normalized;
     named_values::map options;
   };
   mutable threadsafe_stack<parser_cache> parser_caches;
@@ -64,9 +74,9 @@ class model_morphodita_parsito : public model {
   class joint_with_parsing_tokenizer : public input_format {
    public:
     joint_with_parsing_tokenizer(input_format* tokenizer, const model_morphodita_parsito& model,
-                                 int max_sentence_len, double change_boundary_logprob, double sentence_logprob)
+                                 int max_sentence_len, double change_boundary_logprob, double sentence_logprob, int threads)
         : tokenizer(tokenizer), model(model), max_sentence_len(max_sentence_len),
-          change_boundary_logprob(change_boundary_logprob), sentence_logprob(sentence_logprob) {}
+          change_boundary_logprob(change_boundary_logprob), sentence_logprob(sentence_logprob), threads(threads) {}
 
     virtual bool read_block(istream& is, string& block) const override;
     virtual void reset_document(string_piece id) override;
@@ -75,12 +85,19 @@ class model_morphodita_parsito : public model {
 
    private:
     bool parse_paragraph(vector<sentence>& paragraph, string& error);
+    bool span_cost(sentence& s, const string& key, double& cost, string& error);
 
     unique_ptr<input_format> tokenizer;
     const model_morphodita_parsito& model;
     int max_sentence_len;
     double change_boundary_logprob;
     double sentence_logprob;
+    int threads;
+
+    // Parser costs of the already parsed spans, keyed by their words.
+    enum { COSTS_CACHE_SIZE = 1 << 14 };
+    unordered_map<string, double> costs;
+    mutex costs_mutex;
 
     string_piece text;
     string text_copy;
@@ -83,6 +83,7 @@ bool pipeline::process(istream& is, ostream& os, string& error) const {
 
   unique_ptr<output_format> writer(output_format::new_output_format(output));
   if (!writer) return error.assign("The requested output format '").append(output).append("' does not exist!"), false;
+  writer->set_buffer_size(1 << 16); // write the output in 64kB chunks
 
   string block;
   while (immediate ? reader->read_block(is, block) : bool(getwhole(is, block))) {
@@ -90,15 +91,16 @@ bool pipeline::process(istream& is, ostream& os, string& error) const {
     while (reader->next_sentence(s, error)) {
       if (tagger != NONE)
         if (!m->tag(s, tagger, error))
-          return false;
+          return writer->flush(os), false;
 
       if (parser != NONE)
         if (!m->parse(s, parser, error))
-          return false;
+          return writer->flush(os), false;
 
       writer->write_sentence(s, os);
     }
-    if (!error.empty()) return false;
+    if (!error.empty()) return writer->flush(os), false;
+    if (immediate) writer->flush(os), os.flush();
   }
   writer->finish_document(os);
 
@@ -68,8 +68,10 @@ const morpho* perceptron_tagger<FeatureSequences>::get_morpho() const {
 
 template<class FeatureSequences>
 void perceptron_tagger<FeatureSequences>::tag(const vector<string_piece>& forms, vector<tagged_lemma>& tags, morpho::guesser_mode guesser) const {
-  tags.clear();
-  if (!dict) return;
+  if (!dict) {
+    tags.clear();
+    return;
+  }
 
   cache* c = caches.pop();
   if (!c) c = new cache(*this);
@@ -85,8 +87,10 @@ void perceptron_tagger<FeatureSequences>::tag(const vector<string_piece>& forms,
   if (c->tags.size() < forms.size()) c->tags.resize(forms.size() * 2);
   decoder.tag(c->forms, c->analyses, c->decoder_cache, c->tags);
 
+  // Assign the results to the existing elements to reuse their strings
+  tags.resize(forms.size());
   for (unsigned i = 0; i < forms.size(); i++)
-    tags.emplace_back(c->analyses[i][c->tags[i]]);
+    tags[i] = c->analyses[i][c->tags[i]];
 
   caches.push(c);
 }
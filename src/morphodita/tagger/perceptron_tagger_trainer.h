@@ -9,6 +9,9 @@
 
 #pragma once
 
+#include <atomic>
+#include <sstream>
+#include <thread>
 #include <unordered_map>
 
 #include "common.h"
@@ -31,35 +34,33 @@ class perceptron_tagger_trainer {
  public:
   typedef typename tagger_trainer<perceptron_tagger_trainer<FeatureSequences>>::sentence sentence;
 
-  static void train(int decoding_order, int window_size, int iterations, const vector<sentence>& train, const vector<sentence>& heldout, bool early_stopping, bool prune_features, istream& in_feature_templates, ostream& out_tagger);
+  static void train(int decoding_order, int window_size, int iterations, const vector<sentence>& train, const vector<sentence>& heldout, bool early_stopping, unsigned heldout_threads, bool heldout_overlap, bool prune_features, istream& in_feature_templates, ostream& out_tagger);
 
  private:
-  static void train_viterbi(int decoding_order, int window_size, int iterations, const vector<sentence>& train, const vector<sentence>& heldout, bool early_stopping, bool prune_features, FeatureSequences& features);
+  typedef feature_sequences_optimizer<FeatureSequences> optimizer;
+  static void train_viterbi(int decoding_order, int window_size, int iterations, const vector<sentence>& train, const vector<sentence>& heldout, bool early_stopping, unsigned heldout_threads, bool heldout_overlap, bool prune_features, FeatureSequences& features, typename optimizer::optimized_feature_sequences& optimized_features);
 };
 
 
 // Definitions
 template <class FeatureSequences>
-void perceptron_tagger_trainer<FeatureSequences>::train(int decoding_order, int window_size, int iterations, const vector<sentence>& train, const vector<sentence>& heldout, bool early_stopping, bool prune_features, istream& in_feature_templates, ostream& out_tagger) {
+void perceptron_tagger_trainer<FeatureSequences>::train(int decoding_order, int window_size, int iterations, const vector<sentence>& train, const vector<sentence>& heldout, bool early_stopping, unsigned heldout_threads, bool heldout_overlap, bool prune_features, istream& in_feature_templates, ostream& out_tagger) {
   FeatureSequences features;
 
 //  cerr << "Parsing feature templates..." << endl;
   features.parse(window_size, in_feature_templates);
 
 //  cerr << "Training tagger..." << endl;
-  train_viterbi(decoding_order, window_size, iterations, train, heldout, early_stopping, prune_features, features);
+  typename optimizer::optimized_feature_sequences optimized_features;
+  train_viterbi(decoding_order, window_size, iterations, train, heldout, early_stopping, heldout_threads, heldout_overlap, prune_features, features, optimized_features);
 
 //  cerr << "Encoding tagger..." << endl;
-  typedef feature_sequences_optimizer<FeatureSequences> optimizer;
-  typename optimizer::optimized_feature_sequences optimized_features;
-  optimizer::optimize(features, optimized_features);
   if (!optimized_features.save(out_tagger)) training_failure("Cannot save feature sequences!");
 }
 
 template <class FeatureSequences>
-void perceptron_tagger_trainer<FeatureSequences>::train_viterbi(int decoding_order, int window_size, int iterations, const vector<sentence>& train, const vector<sentence>& heldout, bool early_stopping, bool prune_features, FeatureSequences& features) {
+void perceptron_tagger_trainer<FeatureSequences>::train_viterbi(int decoding_order, int window_size, int iterations, const vector<sentence>& train, const vector<sentence>& heldout, bool early_stopping, unsigned heldout_threads, bool heldout_overlap, bool prune_features, FeatureSequences& features, typename optimizer::optimized_feature_sequences& optimized_features) {
   int best_correct = 0, best_iteration = -1;
-  FeatureSequences best_features;
 
   viterbi<FeatureSequences> decoder(features, decoding_order, window_size);
   typename decltype(decoder)::cache decoder_cache(decoder);
@@ -70,6 +71,73 @@ void perceptron_tagger_trainer<FeatureSequences>::train_viterbi(int decoding_ord
 
   vector<int> window(window_size);
 
+  // Heldout evaluation is performed using heldout_threads threads. If heldout_overlap
+  // is set, a snapshot of the tagger is evaluated while next iteration is being trained.
+  // The evaluated snapshots are optimized feature sequences, so the best one can be
+  // kept without copying the feature sequences being trained.
+  unique_ptr<typename optimizer::optimized_feature_sequences> frozen_features, best_features;
+  unique_ptr<viterbi<typename optimizer::optimized_feature_sequences>> frozen_decoder;
+  int frozen_iteration = -1;
+  string heldout_log;
+
+  enum { TAGS, LEMMAS, BOTH, TOTAL };
+  atomic<unsigned> heldout_index(0), heldout_correct[TOTAL], heldout_total(0);
+  vector<thread> heldout_evaluators;
+  auto heldout_evaluation = [&]() {
+    typename viterbi<typename optimizer::optimized_feature_sequences>::cache frozen_decoder_cache(*frozen_decoder);
+    vector<int> tags;
+    unsigned correct[TOTAL] = {}, total = 0;
+
+    for (unsigned current_index; (current_index = heldout_index++) < heldout.size();) {
+      auto& sentence = heldout[current_index];
+      if (tags.size() < sentence.forms.size()) tags.resize(sentence.forms.size() * 2);
+      frozen_decoder->tag(sentence.forms, sentence.analyses, frozen_decoder_cache, tags);
+
+      for (unsigned i = 0; i < sentence.forms.size(); i++) {
+        correct[TAGS] += sentence.gold[i].tag == sentence.analyses[i][tags[i]].tag;
+        correct[LEMMAS] += sentence.gold[i].lemma == sentence.analyses[i][tags[i]].lemma;
+        correct[BOTH] += sentence.gold[i].tag == sentence.analyses[i][tags[i]].tag && sentence.gold[i].lemma == sentence.analyses[i][tags[i]].lemma;
+        total++;
+      }
+    }
+
+    for (int i = 0; i < TOTAL; i++) heldout_correct[i] += correct[i];
+    heldout_total += total;
+  };
+  auto heldout_start = [&](int iteration, const string& log) {
+    frozen_features.reset(new typename optimizer::optimized_feature_sequences());
+    optimizer::optimize(features, *frozen_features);
+    frozen_decoder.reset(new viterbi<typename optimizer::optimized_feature_sequences>(*frozen_features, decoding_order, window_size));
+    frozen_iteration = iteration;
+    heldout_log.assign(log);
+
+    heldout_index = heldout_total = 0;
+    for (auto&& correct : heldout_correct) correct = 0;
+    if (heldout_threads > 1 || heldout_overlap) {
+      for (unsigned i = 0; i < max(heldout_threads, 1U); i++)
+        heldout_evaluators.emplace_back(heldout_evaluation);
+    } else {
+      heldout_evaluation();
+    }
+  };
+  auto heldout_finish = [&]() {
+    if (frozen_iteration < 0) return;
+    for (; !heldout_evaluators.empty(); heldout_evaluators.pop_back()) heldout_evaluators.back().join();
+
+    if (early_stopping && int(heldout_correct[BOTH]) > best_correct) {
+      best_correct = heldout_correct[BOTH];
+      best_iteration = frozen_iteration;
+      frozen_decoder.reset();
+      best_features = move(frozen_features);
+    }
+
+    cerr << heldout_log << ", heldout accuracy " << fixed << setprecision(2)
+        << 100 * heldout_correct[TAGS] / double(heldout_total) << "%t/"
+        << 100 * heldout_correct[LEMMAS] / double(heldout_total) << "%l/"
+        << 100 * heldout_correct[BOTH] / double(heldout_total) << "%b" << endl;
+    frozen_iteration = -1;
+  };
+
   // Initialize feature sequences for the gold decoding only if requested
   if (prune_features)
     for (unsigned s = 0; s < train.size(); s++) {
@@ -92,7 +160,9 @@ void perceptron_tagger_trainer<FeatureSequences>::train_viterbi(int decoding_ord
   for (int i = 0; i < iterations; i++) {
     // Train
     int train_correct = 0, train_total = 0;
-    cerr << "Iteration " << i + 1 << ": ";
+    ostringstream iteration_log;
+    ostream& log = !heldout.empty() && heldout_overlap ? iteration_log : cerr;
+    log << "Iteration " << i + 1 << ": ";
 
     vector<int> tags;
     for (unsigned s = 0; s < train.size(); s++) {
@@ -151,48 +221,29 @@ void perceptron_tagger_trainer<FeatureSequences>::train_viterbi(int decoding_ord
         element.second.gamma += element.second.alpha * (train.size() - element.second.last_gamma_update);
         element.second.last_gamma_update = 0;
       }
-    cerr << "done, accuracy " << fixed << setprecision(2) << train_correct * 100 / double(train_total) << '%';
+    log << "done, accuracy " << fixed << setprecision(2) << train_correct * 100 / double(train_total) << '%';
 
     // If we have any heldout data, compute accuracy and if requested store best tagger configuration
     if (!heldout.empty()) {
-      enum { TAGS, LEMMAS, BOTH, TOTAL };
-      int heldout_correct[TOTAL] = {}, heldout_total = 0;
-
-      typedef feature_sequences_optimizer<FeatureSequences> optimizer;
-      typename optimizer::optimized_feature_sequences frozen_features;
-      optimizer::optimize(features, frozen_features);
-      viterbi<decltype(frozen_features)> frozen_decoder(frozen_features, decoding_order, window_size);
-      typename decltype(frozen_decoder)::cache frozen_decoder_cache(frozen_decoder);
-
-      for (auto&& sentence : heldout) {
-        if (tags.size() < sentence.forms.size()) tags.resize(sentence.forms.size() * 2);
-        frozen_decoder.tag(sentence.forms, sentence.analyses, frozen_decoder_cache, tags);
-
-        for (unsigned i = 0; i < sentence.forms.size(); i++) {
-          heldout_correct[TAGS] += sentence.gold[i].tag == sentence.analyses[i][tags[i]].tag;
-          heldout_correct[LEMMAS] += sentence.gold[i].lemma == sentence.analyses[i][tags[i]].lemma;
-          heldout_correct[BOTH] += sentence.gold[i].tag == sentence.analyses[i][tags[i]].tag && sentence.gold[i].lemma == sentence.analyses[i][tags[i]].lemma;
-          heldout_total++;
-        }
-      }
-
-      if (early_stopping && heldout_correct[BOTH] > best_correct) {
-        best_correct = heldout_correct[BOTH];
-        best_iteration = i;
-        best_features = features;
+      if (heldout_overlap) {
+        // Finish evaluation of the previous iteration and start evaluating a snapshot of the current one
+        heldout_finish();
+        heldout_start(i, iteration_log.str());
+      } else {
+        heldout_start(i, string());
+        heldout_finish();
       }
-
-      cerr << ", heldout accuracy " << fixed << setprecision(2)
-          << 100 * heldout_correct[TAGS] / double(heldout_total) << "%t/"
-          << 100 * heldout_correct[LEMMAS] / double(heldout_total) << "%l/"
-          << 100 * heldout_correct[BOTH] / double(heldout_total) << "%b";
+    } else {
+      cerr << endl;
     }
-    cerr << endl;
   }
+  heldout_finish();
 
   if (early_stopping && best_iteration >= 0) {
     cerr << "Chosen tagger model from iteration " << best_iteration + 1 << endl;
-    features = best_features;
+    optimized_features = move(*best_features);
+  } else {
+    optimizer::optimize(features, optimized_features);
   }
 }
 
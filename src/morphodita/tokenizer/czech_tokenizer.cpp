@@ -245,7 +245,7 @@ bool czech_tokenizer::next_sentence(vector<token_range>& tokens) {
 	int _trans;
 	short _widec;
 
-	if ( ( current) == ( (chars.size() - 1)) )
+	if ( ( current) == ( chars_end()) )
 		goto _test_eof;
 	if ( cs == 0 )
 		goto _out;
@@ -434,10 +434,10 @@ _again:
 
 	if ( cs == 0 )
 		goto _out;
-	if ( ++( current) != ( (chars.size() - 1)) )
+	if ( ++( current) != ( chars_end()) )
 		goto _resume;
 	_test_eof: {}
-	if ( ( current) == ( (chars.size() - 1)) )
+	if ( ( current) == ( chars_end()) )
 	{
 	if ( _czech_tokenizer_eof_trans[cs] > 0 ) {
 		_trans = _czech_tokenizer_eof_trans[cs] - 1;
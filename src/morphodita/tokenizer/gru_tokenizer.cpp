@@ -17,6 +17,12 @@ bool gru_tokenizer::is_space(size_t index) {
   return (chars[index].cat & unilib::unicode::Zs) || chars[index].chr == '\r' || chars[index].chr == '\n' || chars[index].chr == '\t';
 }
 
+bool gru_tokenizer::is_paragraph_break(size_t index) {
+  return (chars[index].chr == '\n' && chars[index + 1].chr == '\n') ||
+         (chars[index].chr == '\r' && chars[index + 1].chr == '\n' && !is_end(index + 2) && chars[index + 2].chr == '\r' &&
+          !is_end(index + 3) && chars[index + 3].chr == '\n');
+}
+
 bool gru_tokenizer::next_sentence(vector<token_range>& tokens) {
   tokens.clear();
 
@@ -25,15 +31,15 @@ bool gru_tokenizer::next_sentence(vector<token_range>& tokens) {
 
   // Tokenize until EOS
   for (bool eos = false; !eos && !emergency_sentence_split(tokens); ) {
-    while (current < chars.size() - 1 && is_space(current))
+    while (!is_end(current) && is_space(current))
       if (next_outcome() == gru_tokenizer_network::END_OF_SENTENCE && !tokens.empty())
         break;
 
-    if (current >= chars.size() - 1) break;
+    if (is_end(current)) break;
 
     // We have a beginning of a token. Try if it is an URL.
     if (tokenize_url_email(tokens)) {
-      while (network_index < network_length && network_offsets[network_index] < current)
+      while (network_index < network_length && network_offsets[network_index] < chars_offset + current)
         if (network_outcomes[network_index++].outcome == gru_tokenizer_network::END_OF_SENTENCE && !tokens.empty())
           eos = true;
       continue;
@@ -45,7 +51,7 @@ bool gru_tokenizer::next_sentence(vector<token_range>& tokens) {
       int outcome = next_outcome();
       eos = outcome == gru_tokenizer_network::END_OF_SENTENCE;
       if (outcome != gru_tokenizer_network::NO_SPLIT) break;
-    } while (current < chars.size() - 1);
+    } while (!is_end(current));
     tokens.emplace_back(token_start, current - token_start);
   }
 
@@ -61,13 +67,18 @@ int gru_tokenizer::next_outcome() {
     network_outcomes.clear();
     network_offsets.clear();
 
-    // Prepare data for the classification
+    // Prepare data for the classification; the offsets are relative to the
+    // whole text, because the characters can be shifted between sentences.
+    // The window ends after a paragraph break, so that every paragraph is
+    // tokenized independently of the preceding text.
+    bool paragraph_break = false;
     for (size_t offset = current;
-         network_offsets.push_back(offset), offset < chars.size() - 1 && network_length < segment;
+         network_offsets.push_back(chars_offset + offset), !is_end(offset) && network_length < segment && !paragraph_break;
          network_length++, offset++) {
       if (is_space(offset)) {
         network_chars.emplace_back(' ', unilib::unicode::Zs);
-        while (offset + 1 < chars.size() - 1 && is_space(offset + 1)) offset++;
+        for (; !is_end(offset + 1) && is_space(offset + 1); offset++)
+          paragraph_break = paragraph_break || is_paragraph_break(offset);
       } else {
         network_chars.emplace_back(chars[offset].chr, chars[offset].cat);
       }
@@ -82,13 +93,13 @@ int gru_tokenizer::next_outcome() {
 
     // Add spacing token/sentence breaks
     for (size_t i = 0; i < network_length - 1; i++)
-      if (is_space(network_offsets[i+1])) {
+      if (is_space(network_offsets[i+1] - chars_offset)) {
         // Detect EOS on the following space or \n\n or \r\n\r\n, or if there is end of text
         bool eos = network_outcomes[i+1].outcome == gru_tokenizer_network::END_OF_SENTENCE;
         if (i + 2 == network_length) eos = true;
-        for (size_t j = network_offsets[i+1]; j + 1 < network_offsets[i+2] && !eos; j++)
+        for (size_t j = network_offsets[i+1] - chars_offset; j + 1 < network_offsets[i+2] - chars_offset && !eos; j++)
           eos = (chars[j].chr == '\n' && chars[j+1].chr == '\n') ||
-                (j + 3 < network_offsets[i+2] && chars[j].chr == '\r' && chars[j+1].chr == '\n' && chars[j+2].chr == '\r' && chars[j+3].chr == '\n');
+                (j + 3 < network_offsets[i+2] - chars_offset && chars[j].chr == '\r' && chars[j+1].chr == '\n' && chars[j+2].chr == '\r' && chars[j+3].chr == '\n');
         if (eos) network_outcomes[i].outcome = gru_tokenizer_network::END_OF_SENTENCE;
 
         if (network_outcomes[i].outcome == gru_tokenizer_network::NO_SPLIT)
@@ -105,7 +116,7 @@ int gru_tokenizer::next_outcome() {
           break;
     }
   }
-  return current = network_offsets[network_index + 1], network_outcomes[network_index++].outcome;
+  return current = network_offsets[network_index + 1] - chars_offset, network_outcomes[network_index++].outcome;
 }
 
 } // namespace morphodita
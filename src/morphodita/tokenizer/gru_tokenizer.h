@@ -26,6 +26,7 @@ class gru_tokenizer : public unicode_tokenizer {
 
  private:
   inline bool is_space(size_t index);
+  bool is_paragraph_break(size_t index);
   int next_outcome();
 
   unsigned segment;
@@ -11,6 +11,8 @@
 
 #include <algorithm>
 #include <random>
+#include <sstream>
+#include <thread>
 #include <utility>
 
 #include "common.h"
@@ -33,8 +35,8 @@ class gru_tokenizer_network_trainer : public gru_tokenizer_network_implementatio
  public:
   bool train(unsigned url_email_tokenizer, unsigned segment, bool allow_spaces, unsigned epochs, unsigned batch_size,
              float learning_rate, float learning_rate_final, float dropout, float initialization_range,
-             bool early_stopping, const vector<tokenized_sentence>& data, const vector<tokenized_sentence>& heldout,
-             binary_encoder& enc, string& error);
+             bool early_stopping, bool heldout_overlap, const vector<tokenized_sentence>& data,
+             const vector<tokenized_sentence>& heldout, binary_encoder& enc, string& error);
 
  private:
   template <int R, int C> using matrix = typename gru_tokenizer_network_implementation<D>::template matrix<R, C>;
@@ -80,8 +82,9 @@ class gru_tokenizer_network_trainer : public gru_tokenizer_network_implementatio
 template <int D>
 bool gru_tokenizer_network_trainer<D>::train(unsigned url_email_tokenizer, unsigned segment, bool allow_spaces, unsigned epochs, unsigned batch_size,
                                              float learning_rate_initial, float learning_rate_final, float dropout,
-                                             float initialization_range, bool early_stopping, const vector<tokenized_sentence>& data,
-                                             const vector<tokenized_sentence>& heldout, binary_encoder& enc, string& error) {
+                                             float initialization_range, bool early_stopping, bool heldout_overlap,
+                                             const vector<tokenized_sentence>& data, const vector<tokenized_sentence>& heldout,
+                                             binary_encoder& enc, string& error) {
   if (segment < 10) return error.assign("Segment size must be at least 10!"), false;
 
   unsigned characters = 0;
@@ -121,13 +124,48 @@ bool gru_tokenizer_network_trainer<D>::train(unsigned url_email_tokenizer, unsig
   float learning_rate = learning_rate_initial, b1t = 1.f, b2t = 1.f;
 
   float best_combined_f1 = 0.f; unsigned best_combined_f1_epoch = 0;
-  gru_tokenizer_network_trainer<D> best_combined_f1_network;
+  unique_ptr<gru_tokenizer_network_trainer<D>> best_combined_f1_network(new gru_tokenizer_network_trainer<D>());
+
+  // If heldout_overlap is set, a snapshot of the network is evaluated while next epoch is being trained.
+  // When the snapshot is the best network so far, it is swapped with the best network instead of copied.
+  unique_ptr<gru_tokenizer_network_trainer<D>> heldout_network(new gru_tokenizer_network_trainer<D>());
+  thread heldout_evaluator;
+  f1_info heldout_tokens, heldout_sentences;
+  unsigned heldout_epoch = 0; bool heldout_pending = false;
+  string heldout_log;
+  auto heldout_finish = [&]() {
+    if (!heldout_pending) return false;
+    if (heldout_evaluator.joinable()) heldout_evaluator.join();
+    heldout_pending = false;
+
+    cerr << heldout_log << ", heldout tokens: " << fixed << setprecision(2) << 100. * heldout_tokens.precision << "%P/"
+         << 100. * heldout_tokens.recall << "%R/" << 100. * heldout_tokens.f1 << "%, sentences: " << 100. * heldout_sentences.precision << "%P/"
+         << 100. * heldout_sentences.recall << "%R/" << 100. * heldout_sentences.f1 << "%";
+
+    if (early_stopping && heldout_sentences.f1 + heldout_tokens.f1 > best_combined_f1) {
+      best_combined_f1 = heldout_sentences.f1 + heldout_tokens.f1;
+      best_combined_f1_epoch = heldout_epoch;
+      if (heldout_overlap)
+        best_combined_f1_network.swap(heldout_network);
+      else
+        *best_combined_f1_network = *this;
+    }
+    if (early_stopping && best_combined_f1 && heldout_epoch - best_combined_f1_epoch > 30) {
+      cerr << endl << "Stopping after 30 iterations of not improving sum of sentence and token f1." << endl;
+      return true;
+    }
+    cerr << endl;
+    return false;
+  };
 
   size_t training_offset = 0, training_shift;
   vector<gru_tokenizer_network::char_info> training_input, instance_input(segment);
   vector<gru_tokenizer_network::outcome_t> training_output, instance_output(segment);
   vector<int> permutation; for (size_t i = 0; i < data.size(); i++) permutation.push_back(permutation.size());
   for (unsigned epoch = 0; epoch < epochs; epoch++) {
+    // If the pending evaluation of the previous epoch may stop the training, wait for it before training another epoch
+    if (heldout_pending && early_stopping && best_combined_f1 && heldout_epoch - best_combined_f1_epoch > 30 && heldout_finish()) break;
+
     double logprob = 0;
     int total = 0, correct = 0;
 
@@ -308,36 +346,39 @@ bool gru_tokenizer_network_trainer<D>::train(unsigned url_email_tokenizer, unsig
       learning_rate = exp(((epochs - epoch - 2) * log(learning_rate_initial) + (epoch + 1) * log(learning_rate_final)) / (epochs - 1));
 
     // Evaluate
-    cerr << "Epoch " << epoch+1 << ", logprob: " << scientific << setprecision(4) << logprob
-         << ", training acc: " << fixed << setprecision(2) << 100. * correct / double(total) << "%";
+    ostringstream epoch_log;
+    ostream& log = !heldout.empty() && heldout_overlap ? epoch_log : cerr;
+    log << "Epoch " << epoch+1 << ", logprob: " << scientific << setprecision(4) << logprob
+        << ", training acc: " << fixed << setprecision(2) << 100. * correct / double(total) << "%";
     if (!heldout.empty()) {
-      f1_info tokens, sentences;
-      evaluate(url_email_tokenizer, segment, allow_spaces, heldout, tokens, sentences);
-      cerr << ", heldout tokens: " << 100. * tokens.precision << "%P/" << 100. * tokens.recall << "%R/"
-           << 100. * tokens.f1 << "%, sentences: " << 100. * sentences.precision << "%P/"
-           << 100. * sentences.recall << "%R/" << 100. * sentences.f1 << "%";
-
-      if (early_stopping && sentences.f1 + tokens.f1 > best_combined_f1) {
-        best_combined_f1 = sentences.f1 + tokens.f1;
-        best_combined_f1_epoch = epoch;
-        best_combined_f1_network = *this;
-      }
-      if (early_stopping && best_combined_f1 && epoch - best_combined_f1_epoch > 30) {
-        cerr << endl << "Stopping after 30 iterations of not improving sum of sentence and token f1." << endl;
-        break;
+      if (heldout_overlap) {
+        // Finish evaluation of the previous epoch and start evaluating a snapshot of the current one
+        if (heldout_finish()) break;
+        *heldout_network = *this;
+        heldout_evaluator = thread([&]() {
+          heldout_network->evaluate(url_email_tokenizer, segment, allow_spaces, heldout, heldout_tokens, heldout_sentences);
+        });
+      } else {
+        evaluate(url_email_tokenizer, segment, allow_spaces, heldout, heldout_tokens, heldout_sentences);
       }
+      heldout_log = epoch_log.str();
+      heldout_epoch = epoch;
+      heldout_pending = true;
+      if (!heldout_overlap && heldout_finish()) break;
+    } else {
+      cerr << endl;
     }
-    cerr << endl;
   }
+  heldout_finish();
 
   // Choose best network if desired
   if (early_stopping && best_combined_f1) {
     cerr << "Choosing parameters from epoch " << best_combined_f1_epoch+1 << "." << endl;
-    this->embeddings = best_combined_f1_network.embeddings;
-    this->gru_fwd = best_combined_f1_network.gru_fwd;
-    this->gru_bwd = best_combined_f1_network.gru_bwd;
-    this->projection_fwd = best_combined_f1_network.projection_fwd;
-    this->projection_bwd = best_combined_f1_network.projection_bwd;
+    this->embeddings = best_combined_f1_network->embeddings;
+    this->gru_fwd = best_combined_f1_network->gru_fwd;
+    this->gru_bwd = best_combined_f1_network->gru_bwd;
+    this->projection_fwd = best_combined_f1_network->projection_fwd;
+    this->projection_bwd = best_combined_f1_network->projection_bwd;
   }
 
   // Encode the network
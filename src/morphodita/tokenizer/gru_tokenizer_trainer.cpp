@@ -21,7 +21,7 @@ namespace morphodita {
 
 bool gru_tokenizer_trainer::train(unsigned url_email_tokenizer, unsigned segment, bool allow_spaces, unsigned dimension, unsigned epochs,
                                   unsigned batch_size, float learning_rate, float learning_rate_final, float dropout,
-                                  float initialization_range, bool early_stopping, const vector<tokenized_sentence>& data,
+                                  float initialization_range, bool early_stopping, bool heldout_overlap, const vector<tokenized_sentence>& data,
                                   const vector<tokenized_sentence>& heldout, ostream& os, string& error) {
   using namespace unilib;
 
@@ -39,15 +39,15 @@ bool gru_tokenizer_trainer::train(unsigned url_email_tokenizer, unsigned segment
   if (dimension == 16) {
     gru_tokenizer_network_trainer<16> network;
     if (!network.train(url_email_tokenizer, segment, allow_spaces, epochs, batch_size, learning_rate, learning_rate_final,
-                       dropout, initialization_range, early_stopping, data, heldout, enc, error)) return false;
+                       dropout, initialization_range, early_stopping, heldout_overlap, data, heldout, enc, error)) return false;
   } else if (dimension == 24) {
     gru_tokenizer_network_trainer<24> network;
     if (!network.train(url_email_tokenizer, segment, allow_spaces, epochs, batch_size, learning_rate, learning_rate_final,
-                       dropout, initialization_range, early_stopping, data, heldout, enc, error)) return false;
+                       dropout, initialization_range, early_stopping, heldout_overlap, data, heldout, enc, error)) return false;
   } else if (dimension == 64) {
     gru_tokenizer_network_trainer<64> network;
     if (!network.train(url_email_tokenizer, segment, allow_spaces, epochs, batch_size, learning_rate, learning_rate_final,
-                       dropout, initialization_range, early_stopping, data, heldout, enc, error)) return false;
+                       dropout, initialization_range, early_stopping, heldout_overlap, data, heldout, enc, error)) return false;
   } else {
     return error.assign("Gru tokenizer dimension '").append(to_string(dimension)).append("' is not supported!"), false;
   }
@@ -27,7 +27,7 @@ class gru_tokenizer_trainer {
 
   static bool train(unsigned url_email_tokenizer, unsigned segment, bool allow_spaces, unsigned dimension, unsigned epochs,
                     unsigned batch_size, float learning_rate, float learning_rate_final, float dropout,
-                    float initialization_range, bool early_stopping, const vector<tokenized_sentence>& data,
+                    float initialization_range, bool early_stopping, bool heldout_overlap, const vector<tokenized_sentence>& data,
                     const vector<tokenized_sentence>& heldout, ostream& os, string& error);
 };
 
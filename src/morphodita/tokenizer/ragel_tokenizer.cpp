@@ -395,9 +395,13 @@ void ragel_tokenizer::ragel_map_add(char32_t chr, uint8_t mapping) {
   ragel_map[chr] = mapping;
 }
 
-bool ragel_tokenizer::ragel_url_email(unsigned version, const vector<char_info>& chars, size_t& current, vector<token_range>& tokens) {
+bool ragel_tokenizer::ragel_url_email(unsigned version, unicode_tokenizer& tokenizer, size_t& current, vector<token_range>& tokens) {
   int cs;
 
+  // The characters of the tokenizer, as used by the ragel_tokenizer machine
+  const vector<char_info>& chars = tokenizer.chars;
+  auto chars_end = [&tokenizer, &current]() { return tokenizer.chars_end(current); };
+
   size_t start = current, end = current, parens = 0;
   
 	{
@@ -410,7 +414,7 @@ bool ragel_tokenizer::ragel_url_email(unsigned version, const vector<char_info>&
 	int _trans;
 	short _widec;
 
-	if ( ( current) == ( (chars.size() - 1)) )
+	if ( ( current) == ( chars_end()) )
 		goto _test_eof;
 	if ( cs == 0 )
 		goto _out;
@@ -526,7 +530,7 @@ _match:
 _again:
 	if ( cs == 0 )
 		goto _out;
-	if ( ++( current) != ( (chars.size() - 1)) )
+	if ( ++( current) != ( chars_end()) )
 		goto _resume;
 	_test_eof: {}
 	_out: {}
@@ -32,7 +32,7 @@ class ragel_tokenizer : public unicode_tokenizer {
   static void ragel_map_add(char32_t chr, uint8_t mapping);
 
   friend class unicode_tokenizer;
-  static bool ragel_url_email(unsigned version, const vector<char_info>& chars, size_t& current_char, vector<token_range>& tokens);
+  static bool ragel_url_email(unsigned version, unicode_tokenizer& tokenizer, size_t& current_char, vector<token_range>& tokens);
 };
 
 uint8_t ragel_tokenizer::ragel_char(const char_info& chr) {
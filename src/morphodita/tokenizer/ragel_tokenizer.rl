@@ -17,8 +17,8 @@ namespace morphodita {
   machine ragel_tokenizer;
 
   variable p current;
-  variable pe (chars.size() - 1);
-  variable eof (chars.size() - 1);
+  variable pe chars_end();
+  variable eof chars_end();
 
   alphtype unsigned char;
   getkey ragel_char(chars[current]);
@@ -98,9 +98,13 @@ void ragel_tokenizer::ragel_map_add(char32_t chr, uint8_t mapping) {
   ragel_map[chr] = mapping;
 }
 
-bool ragel_tokenizer::ragel_url_email(unsigned version, const vector<char_info>& chars, size_t& current, vector<token_range>& tokens) {
+bool ragel_tokenizer::ragel_url_email(unsigned version, unicode_tokenizer& tokenizer, size_t& current, vector<token_range>& tokens) {
   int cs;
 
+  // The characters of the tokenizer, as used by the ragel_tokenizer machine
+  const vector<char_info>& chars = tokenizer.chars;
+  auto chars_end = [&tokenizer, &current]() { return tokenizer.chars_end(current); };
+
   size_t start = current, end = current, parens = 0;
   %%{
     include ragel_tokenizer;
@@ -11,6 +11,7 @@
 
 #include "ragel_tokenizer.h"
 #include "unicode_tokenizer.h"
+#include "utils/utf8_ascii.h"
 
 namespace ufal {
 namespace udpipe {
@@ -23,38 +24,97 @@ unicode_tokenizer::unicode_tokenizer(unsigned url_email_tokenizer) : url_email_t
 }
 
 void unicode_tokenizer::set_text(string_piece text, bool make_copy /*= false*/) {
-  using namespace unilib;
-
   if (make_copy && text.str) {
     text_buffer.assign(text.str, text.len);
     text.str = text_buffer.c_str();
   }
   current = 0;
 
+  // The characters are decoded lazily by chars_end.
   chars.clear();
-  for (const char* curr_str = text.str; text.len; curr_str = text.str)
-    chars.emplace_back(utf8::decode(text.str, text.len), curr_str);
-  chars.emplace_back(0, text.str);
+  chars_offset = 0;
+  undecoded = text;
+  decoded = false;
 }
 
 bool unicode_tokenizer::next_sentence(vector<string_piece>* forms, vector<token_range>* tokens_ptr) {
   vector<token_range>& tokens = tokens_ptr ? *tokens_ptr : tokens_buffer;
   tokens.clear();
   if (forms) forms->clear();
-  if (current >= chars.size() - 1) return false;
+  shift_chars();
+  if (is_end(current)) return false;
 
   bool result = next_sentence(tokens);
   if (forms)
     for (auto&& token : tokens)
       forms->emplace_back(chars[token.start].str, chars[token.start + token.length].str - chars[token.start].str);
 
+  // Return the token ranges relative to the whole text
+  if (chars_offset)
+    for (auto&& token : tokens)
+      token.start += chars_offset;
+
   return result;
 }
 
 bool unicode_tokenizer::tokenize_url_email(vector<token_range>& tokens) {
-  if (current >= chars.size() - 1) return false;
+  if (!url_email_tokenizer || is_end(current)) return false;
+
+  // Both an URL and an email contain a host, and everything up to the end
+  // of the host consists of ASCII characters allowed in the protocol, user
+  // and host. Therefore, the ragel machine is run only if the run of such
+  // characters contains a dot followed by an alphanumeric character.
+  // The scanned runs are word-sized (four bytes on average), so they are
+  // scanned byte by byte using a byte class table.
+  static const struct url_email_bytes {
+    enum { OTHER, ALLOWED, ALNUM };
+    uint8_t kind[256];
+    url_email_bytes() {
+      for (unsigned byte = 0; byte < 256; byte++)
+        kind[byte] = (byte >= '0' && byte <= '9') || (byte >= 'A' && byte <= 'Z') || (byte >= 'a' && byte <= 'z') ? ALNUM : OTHER;
+      for (auto&& byte : string("$-_.+!*'(),%:/@"))
+        kind[(unsigned char)byte] = ALLOWED;
+    }
+  } url_email;
 
-  return url_email_tokenizer ? ragel_tokenizer::ragel_url_email(url_email_tokenizer, chars, current, tokens) : false;
+  const char* text_end = undecoded.str + undecoded.len;
+  bool candidate = false;
+  for (const char* str = chars[current].str; !candidate && str < text_end && url_email.kind[(unsigned char)*str] != url_email.OTHER; str++)
+    candidate = *str == '.' && str + 1 < text_end && url_email.kind[(unsigned char)str[1]] == url_email.ALNUM;
+
+  return candidate && ragel_tokenizer::ragel_url_email(url_email_tokenizer, *this, current, tokens);
+}
+
+void unicode_tokenizer::decode_chars(size_t index) {
+  using namespace unilib;
+
+  for (index += DECODE_CHARS; undecoded.len && chars.size() <= index; ) {
+    // Runs of ASCII characters are decoded directly
+    for (size_t ascii = utf8_ascii::prefix(undecoded.str, min(undecoded.len, index + 1 - chars.size())); ascii; ascii--) {
+      chars.emplace_back(char32_t((unsigned char)*undecoded.str), undecoded.str);
+      undecoded.str++, undecoded.len--;
+    }
+    if (undecoded.len && chars.size() <= index) {
+      const char* str = undecoded.str;
+      chars.emplace_back(utf8::decode(undecoded.str, undecoded.len), str);
+    }
+  }
+  if (!undecoded.len) {
+    chars.emplace_back(0, undecoded.str);
+    decoded = true;
+  }
+}
+
+void unicode_tokenizer::shift_chars() {
+  // Drop the characters before current, keeping the previous one, which
+  // can be examined by the tokenizers. To keep the amortized cost constant,
+  // the window is shifted only when at least half of it would be dropped.
+  if (current > SHIFT_CHARS && current - 1 >= chars.size() - current) {
+    size_t shift = current - 1;
+    chars.erase(chars.begin(), chars.begin() + shift);
+    chars_offset += shift;
+    current -= shift;
+  }
 }
 
 bool unicode_tokenizer::emergency_sentence_split(const vector<token_range>& tokens) {
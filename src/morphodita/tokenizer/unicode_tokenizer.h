@@ -38,20 +38,50 @@ class unicode_tokenizer : public tokenizer {
 
     char_info(char32_t chr, const char* str) : chr(chr), cat(unilib::unicode::category(chr)), str(str) {}
   };
+  // The characters are decoded lazily into a window, which is shifted
+  // between sentences; chars[0] is the chars_offset-th character of the text.
+  // When the whole text is decoded, a sentinel character is appended.
   vector<char_info> chars;
+  size_t chars_offset;
   size_t current;
 
+  // Return the index of the sentinel if the given index or the following one
+  // is the end of text, and a larger index otherwise; the given and the
+  // following character are decoded when available. The ragel machines use
+  // chars_end() for current as their pe and eof, which is correct even if
+  // evaluated before current is incremented.
+  inline size_t chars_end(size_t index);
+  inline size_t chars_end() { return chars_end(current); }
+  inline bool is_end(size_t index);
+
   bool tokenize_url_email(vector<token_range>& tokens);
   bool emergency_sentence_split(const vector<token_range>& tokens);
   bool is_eos(const vector<token_range>& tokens, char32_t eos_chr, const unordered_set<string>* abbreviations);
 
  private:
+  void decode_chars(size_t index);
+  void shift_chars();
+
+  enum { DECODE_CHARS = 1024, SHIFT_CHARS = 65536 };
   unsigned url_email_tokenizer;
+  string_piece undecoded;
+  bool decoded;
   string text_buffer;
   vector<token_range> tokens_buffer;
   string eos_buffer;
+
+  friend class ragel_tokenizer;
 };
 
+size_t unicode_tokenizer::chars_end(size_t index) {
+  if (index + 1 >= chars.size() && !decoded) decode_chars(index + 1);
+  return decoded ? chars.size() - 1 : chars.size();
+}
+
+bool unicode_tokenizer::is_end(size_t index) {
+  return index >= chars_end(index);
+}
+
 } // namespace morphodita
 } // namespace udpipe
 } // namespace ufal
@@ -14,16 +14,16 @@ namespace udpipe {
 namespace morphodita {
 
 bool vertical_tokenizer::next_sentence(vector<token_range>& tokens) {
-  if (current >= chars.size() - 1) return false;
+  if (is_end(current)) return false;
 
   while (true) {
     size_t line_start = current;
-    while (current < chars.size() - 1 && chars[current].chr != '\r' && chars[current].chr != '\n') current++;
+    while (!is_end(current) && chars[current].chr != '\r' && chars[current].chr != '\n') current++;
 
     size_t line_end = current;
-    if (current < chars.size() - 1) {
+    if (!is_end(current)) {
       current++;
-      if (current < chars.size() - 1 &&
+      if (!is_end(current) &&
           ((chars[current-1].chr == '\r' && chars[current].chr == '\n') ||
            (chars[current-1].chr == '\n' && chars[current].chr == '\r')))
         current++;
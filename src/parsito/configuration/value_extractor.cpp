@@ -7,6 +7,8 @@
 // License, v. 2.0. If a copy of the MPL was not distributed with this
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
+#include <cstring>
+
 #include "value_extractor.h"
 #include "utils/split.h"
 
@@ -15,42 +17,55 @@ namespace udpipe {
 namespace parsito {
 
 void value_extractor::extract(const node& n, string& value) const {
+  extract(n, nullptr, value);
+}
+
+void value_extractor::extract(const node& n, const node_view* view, string& value) const {
   switch (selector) {
     case FORM:
-      value.assign(n.form);
+      if (view) value.assign(view->form.str, view->form.len);
+      else value.assign(n.form);
       break;
     case LEMMA:
-      value.assign(n.lemma);
+      if (view) value.assign(view->lemma.str, view->lemma.len);
+      else value.assign(n.lemma);
       break;
     case LEMMA_ID:
-      if (!n.misc.empty()) {
+      {
+        string_piece misc = view ? view->misc : string_piece(n.misc);
+        string_piece lemma = view ? view->lemma : string_piece(n.lemma);
+
         // Try finding LId= in misc column
-        auto lid = n.misc.find("LId=");
-        if (lid != string::npos) {
-          lid += 4;
+        for (size_t lid = 0; lid + 4 <= misc.len; lid++)
+          if (!memcmp(misc.str + lid, "LId=", 4)) {
+            lid += 4;
 
-          // Find optional | ending the lemma_id
-          auto lid_end = n.misc.find('|', lid);
-          if (lid_end == string::npos) lid_end = n.misc.size();
+            // Find optional | ending the lemma_id
+            size_t lid_end = lid;
+            while (lid_end < misc.len && misc.str[lid_end] != '|') lid_end++;
 
-          // Store the lemma_id
-          value.assign(n.misc, lid, lid_end - lid);
-          break;
-        }
+            // Store the lemma_id
+            lemma = string_piece(misc.str + lid, lid_end - lid);
+            break;
+          }
+        value.assign(lemma.str, lemma.len);
       }
-      value.assign(n.lemma);
       break;
     case TAG:
-      value.assign(n.xpostag);
+      if (view) value.assign(view->xpostag.str, view->xpostag.len);
+      else value.assign(n.xpostag);
       break;
     case UNIVERSAL_TAG:
-      value.assign(n.upostag);
+      if (view) value.assign(view->upostag.str, view->upostag.len);
+      else value.assign(n.upostag);
       break;
     case FEATS:
-      value.assign(n.feats);
+      if (view) value.assign(view->feats.str, view->feats.len);
+      else value.assign(n.feats);
       break;
     case UNIVERSAL_TAG_FEATS:
-      value.assign(n.upostag).append(n.feats);
+      if (view) value.assign(view->upostag.str, view->upostag.len).append(view->feats.str, view->feats.len);
+      else value.assign(n.upostag).append(n.feats);
       break;
     case DEPREL:
       value.assign(n.deprel);
@@ -20,6 +20,8 @@ namespace parsito {
 class value_extractor {
  public:
   void extract(const node& n, string& value) const;
+  void extract(const node& n, const node_view* view, string& value) const;
+  bool extracts_deprel() const { return selector == DEPREL; }
 
   bool create(string_piece description, string& error);
 
@@ -0,0 +1,179 @@
+// This file is part of Parsito <http://github.com/ufal/parsito/>.
+//
+// Copyright 2026 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <functional>
+
+#include "embeddings_cache.h"
+#include "neural_network.h"
+
+namespace ufal {
+namespace udpipe {
+namespace parsito {
+
+embeddings_cache::~embeddings_cache() {
+  for (unsigned i = 0; i < words.size(); i++)
+    for (unsigned word = 0; word < words[i]; word++)
+      delete entries[i][word].load();
+  for (auto&& entry : retired)
+    delete entry;
+}
+
+void embeddings_cache::init(const neural_network& network, const vector<embedding>& embeddings, bool quantized) {
+  this->network = &network;
+  this->embeddings = &embeddings;
+  this->quantized = quantized;
+
+  unsigned sequences, hidden_layer_size;
+  network.precomputed_embedding_shape(embeddings, sequences, hidden_layer_size);
+  entry_size = sizeof(entry) + (quantized ? sequences * hidden_layer_size * sizeof(int8_t) + sequences * sizeof(float) :
+                                            sequences * hidden_layer_size * sizeof(float));
+
+  words.resize(embeddings.size());
+  entries.resize(embeddings.size());
+  counts.resize(embeddings.size());
+  for (unsigned i = 0; i < embeddings.size(); i++) {
+    words[i] = 0;
+    while (embeddings[i].weight(words[i])) words[i]++;
+
+    entries[i].reset(new atomic<entry*>[words[i]]);
+    counts[i].reset(new atomic<unsigned>[words[i]]);
+    for (unsigned word = 0; word < words[i]; word++) {
+      entries[i][word].store(nullptr, memory_order_relaxed);
+      counts[i][word].store(0, memory_order_relaxed);
+    }
+  }
+}
+
+void embeddings_cache::set_memory_limit(size_t memory_limit) {
+  if (this->memory_limit.exchange(memory_limit) != memory_limit)
+    maintenance_requested.store(true);
+}
+
+size_t embeddings_cache::get_memory_limit() const {
+  return memory_limit.load();
+}
+
+size_t embeddings_cache::memory_for_words(unsigned words_per_embedding) const {
+  size_t memory = 0;
+  for (auto&& embedding_words : words)
+    memory += min(embedding_words, words_per_embedding) * entry_size;
+  return memory;
+}
+
+void embeddings_cache::get_statistics(statistics& stats) const {
+  stats.lookups = lookups.load();
+  stats.hits = hits.load();
+  stats.entries = entries_cached.load();
+  stats.memory = memory.load();
+  stats.memory_limit = memory_limit.load();
+}
+
+unsigned embeddings_cache::begin_use() {
+  while (true) {
+    unsigned current = generation.load();
+    readers[current & 1].fetch_add(1);
+    if (generation.load() == current) return current;
+    readers[current & 1].fetch_sub(1);
+  }
+}
+
+void embeddings_cache::end_use(unsigned generation, size_t lookups, size_t hits) {
+  readers[generation & 1].fetch_sub(1);
+
+  this->lookups.fetch_add(lookups, memory_order_relaxed);
+  this->hits.fetch_add(hits, memory_order_relaxed);
+  size_t observed = observations.fetch_add(lookups, memory_order_relaxed);
+  if ((observed + lookups) / MAINTENANCE_INTERVAL != observed / MAINTENANCE_INTERVAL || maintenance_requested.load(memory_order_relaxed))
+    maintain();
+}
+
+bool embeddings_cache::observe(unsigned embedding, unsigned word) {
+  if (embedding >= words.size() || word >= words[embedding]) return false;
+
+  unsigned count = counts[embedding][word].fetch_add(1, memory_order_relaxed) + 1;
+  entry* cached = entries[embedding][word].load(memory_order_acquire);
+  if (cached) return true;
+  if (count < admission_threshold.load(memory_order_relaxed)) return false;
+
+  // Reserve memory for a new entry and compute it if the limit allows it
+  if (memory.fetch_add(entry_size) + entry_size > memory_limit.load(memory_order_relaxed)) {
+    memory.fetch_sub(entry_size);
+    return false;
+  }
+
+  unique_ptr<entry> computed(new entry());
+  network->precompute_embedding(*embeddings, embedding, word, quantized, *computed);
+  if (!entries[embedding][word].compare_exchange_strong(cached, computed.get())) {
+    memory.fetch_sub(entry_size);
+    return false;
+  }
+  computed.release();
+  entries_cached.fetch_add(1, memory_order_relaxed);
+  return false;
+}
+
+void embeddings_cache::maintain() {
+  // The cache of a network being trained is never initialized
+  if (!entry_size) return;
+
+  unique_lock<mutex> lock(maintenance_mutex, try_to_lock);
+  if (!lock.owns_lock()) return;
+
+  // Readers of the previous generation might still use the retired entries
+  unsigned current = generation.load();
+  if (readers[(current - 1) & 1].load()) return;
+  for (auto&& entry : retired)
+    delete entry;
+  memory.fetch_sub(retired.size() * entry_size);
+  retired.clear();
+  maintenance_requested.store(false);
+
+  // Process a slice of the words, collecting their counts, evicting less
+  // frequent entries and decaying the counts
+  for (unsigned processed = 0; processed < MAINTENANCE_SLICE && maintenance_embedding < words.size(); processed++) {
+    if (maintenance_word < words[maintenance_embedding]) {
+      auto& count_ref = counts[maintenance_embedding][maintenance_word];
+      auto& entry_ref = entries[maintenance_embedding][maintenance_word];
+      unsigned count = count_ref.load(memory_order_relaxed);
+      if (count) candidates.push_back(count);
+      if (count < eviction_threshold && entry_ref.load(memory_order_relaxed))
+        if (entry* evicted = entry_ref.exchange(nullptr)) {
+          retired.push_back(evicted);
+          entries_cached.fetch_sub(1, memory_order_relaxed);
+        }
+      if (count) count_ref.fetch_sub(count - count / 2, memory_order_relaxed);
+      maintenance_word++;
+    }
+    if (maintenance_word >= words[maintenance_embedding])
+      maintenance_embedding++, maintenance_word = 0;
+  }
+
+  // After a pass over all words, find the smallest count of words fitting
+  // into the memory limit
+  if (maintenance_embedding >= words.size()) {
+    size_t capacity = memory_limit.load() / entry_size;
+    eviction_threshold = 0;
+    if (candidates.size() > capacity) {
+      nth_element(candidates.begin(), candidates.begin() + capacity, candidates.end(), greater<unsigned>());
+      eviction_threshold = candidates[capacity] + 1;
+    }
+    admission_threshold.store(max(eviction_threshold / 2, 1U), memory_order_relaxed);
+
+    candidates.clear();
+    maintenance_embedding = 0;
+  }
+
+  if (!retired.empty())
+    generation.fetch_add(1);
+}
+
+} // namespace parsito
+} // namespace udpipe
+} // namespace ufal
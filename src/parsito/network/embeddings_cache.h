@@ -0,0 +1,100 @@
+// This file is part of Parsito <http://github.com/ufal/parsito/>.
+//
+// Copyright 2026 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include "common.h"
+#include "parsito/embedding/embedding.h"
+
+namespace ufal {
+namespace udpipe {
+namespace parsito {
+
+class neural_network;
+
+// Cache of precomputed hidden layer contributions of embedding words, shared
+// by all threads and bounded by a memory limit. The entries are computed
+// lazily for frequently observed words; the observation counts decay over
+// time and the cached set is continuously adapted to the most frequent ones,
+// processing a small slice of the words after every MAINTENANCE_INTERVAL
+// lookups.
+//
+// Lookups are lock-free. Every thread performing lookups must enclose them
+// in begin_use and end_use, which guarantees that evicted entries are not
+// freed while they might still be used.
+class embeddings_cache {
+ public:
+  struct entry {
+    vector<float> values;            // contributions of all sequences,
+    vector<int8_t> quantized_values; // or their quantized version
+    vector<float> quantized_scales;  // with a scale for every sequence
+  };
+
+  struct statistics {
+    size_t lookups, hits, entries, memory, memory_limit;
+  };
+
+  ~embeddings_cache();
+
+  void init(const neural_network& network, const vector<embedding>& embeddings, bool quantized);
+  void set_memory_limit(size_t memory_limit);
+  size_t get_memory_limit() const;
+  // Memory needed to cache the given number of most frequent words of every embedding.
+  size_t memory_for_words(unsigned words_per_embedding) const;
+  void get_statistics(statistics& stats) const;
+
+  unsigned begin_use();
+  void end_use(unsigned generation, size_t lookups, size_t hits);
+
+  // Record an occurrence of the given word, returning whether it was cached.
+  bool observe(unsigned embedding, unsigned word);
+  inline const entry* lookup(unsigned embedding, unsigned word) const;
+
+ private:
+  void maintain();
+
+  const neural_network* network = nullptr;
+  const vector<embedding>* embeddings = nullptr;
+  bool quantized = false;
+  size_t entry_size = 0;
+
+  vector<unsigned> words;
+  vector<unique_ptr<atomic<entry*>[]>> entries;
+  vector<unique_ptr<atomic<unsigned>[]>> counts;
+  atomic<unsigned> admission_threshold{1};
+
+  atomic<size_t> memory{0}, memory_limit{0}, entries_cached{0};
+  atomic<size_t> lookups{0}, hits{0}, observations{0};
+  atomic<bool> maintenance_requested{false};
+  enum { MAINTENANCE_INTERVAL = 1 << 12, MAINTENANCE_SLICE = 1 << 12 };
+
+  // Evicted entries are retired and freed once the readers which might have
+  // seen them are finished; readers are tracked by the parity of generation.
+  atomic<unsigned> generation{0}, readers[2]{{0}, {0}};
+  vector<entry*> retired;
+  mutex maintenance_mutex;
+
+  // The counts of the words are collected during a pass over all words,
+  // determining the eviction threshold used during the following pass.
+  unsigned maintenance_embedding = 0, maintenance_word = 0;
+  vector<unsigned> candidates;
+  unsigned eviction_threshold = 0;
+};
+
+const embeddings_cache::entry* embeddings_cache::lookup(unsigned embedding, unsigned word) const {
+  return embedding < words.size() && word < words[embedding] ? entries[embedding][word].load(memory_order_acquire) : nullptr;
+}
+
+} // namespace parsito
+} // namespace udpipe
+} // namespace ufal
@@ -44,6 +44,7 @@ struct network_parameters {
   float maxnorm_regularization;
   float dropout_hidden, dropout_input;
   bool early_stopping;
+  bool heldout_overlap;
 };
 
 } // namespace parsito
@@ -34,41 +34,158 @@ void neural_network::load(binary_decoder& data) {
 }
 
 void neural_network::propagate(const vector<embedding>& embeddings, const vector<const vector<int>*>& embedding_ids_sequences,
-                               vector<float>& hidden_layer, vector<float>& outcomes, const embeddings_cache* cache, bool softmax) const {
+                               vector<float>& hidden_layer, vector<float>& outcomes, const embeddings_cache* cache, bool softmax,
+                               const vector<char>* outcomes_mask) const {
   assert(!weights[0].empty());
   assert(!weights[1].empty());
+  assert(!softmax || !outcomes_mask);
   for (auto&& embedding_ids : embedding_ids_sequences) if (embedding_ids) assert(embeddings.size() == embedding_ids->size());
 
   unsigned hidden_layer_size = weights[0].front().size();
   unsigned outcomes_size = weights[1].front().size();
 
+  // Hidden layer. The contribution of every embedding is computed directly
+  // in the same way as in the embeddings cache, so that the results do not
+  // depend on which words are cached; the outcomes are used as a buffer.
+  hidden_layer.assign(hidden_layer_size, 0);
+  if (outcomes.size() < hidden_layer_size) outcomes.resize(hidden_layer_size);
+
+  unsigned index = 0;
+  for (unsigned sequence = 0; sequence < embedding_ids_sequences.size(); sequence++)
+    for (unsigned i = 0; i < embeddings.size(); index += embeddings[i].dimension, i++)
+      if (embedding_ids_sequences[sequence] && embedding_ids_sequences[sequence]->at(i) >= 0) {
+        unsigned word = embedding_ids_sequences[sequence]->at(i);
+        const embeddings_cache::entry* cached = cache ? cache->lookup(i, word) : nullptr;
+        const float* contribution = cached ? cached->values.data() + sequence * hidden_layer_size : outcomes.data();
+        if (!cached)
+          embedding_contribution(embeddings[i].weight(word), embeddings[i].dimension, index, outcomes.data());
+        for (unsigned j = 0; j < hidden_layer_size; j++)
+          hidden_layer[j] += contribution[j];
+      }
+  for (unsigned i = 0; i < hidden_layer_size; i++) // Bias
+    hidden_layer[i] += weights[0][index][i];
+
+  // Activation function
+  activate(hidden_layer);
+
   outcomes.assign(outcomes_size, 0);
 
+  // Output layer, restricted to the range of the masked outcomes if requested.
+  // The outcomes are computed together to allow vectorization, so the masked
+  // outcomes inside the range are computed too.
+  unsigned outcomes_begin = 0, outcomes_end = outcomes_size;
+  if (outcomes_mask) {
+    assert(outcomes_mask->size() == outcomes_size);
+    while (outcomes_begin < outcomes_end && !(*outcomes_mask)[outcomes_begin]) outcomes_begin++;
+    while (outcomes_end > outcomes_begin && !(*outcomes_mask)[outcomes_end - 1]) outcomes_end--;
+  }
+
+  for (unsigned i = 0; i < hidden_layer_size; i++)
+    for (unsigned j = outcomes_begin; j < outcomes_end; j++)
+      outcomes[j] += hidden_layer[i] * weights[1][i][j];
+  for (unsigned i = outcomes_begin; i < outcomes_end; i++) // Bias
+    outcomes[i] += weights[1][hidden_layer_size][i];
+
+  // Softmax if requested
+  if (softmax) compute_softmax(outcomes);
+}
+
+// The following helpers are written as simple loops without dependencies
+// between iterations, so that the compiler can vectorize them.
+
+// Dot product of two int8 vectors, accumulated in int32.
+static inline int32_t dot_int8(const int8_t* a, const int8_t* b, unsigned size) {
+  int32_t result = 0;
+  for (unsigned i = 0; i < size; i++)
+    result += int16_t(a[i]) * int16_t(b[i]);
+  return result;
+}
+
+// Quantize given values to int8 using a symmetric scale, which is returned.
+static inline float quantize_int8(const float* values, unsigned size, int8_t* quantized) {
+  // The maximum absolute value is found using the bit patterns of the absolute
+  // values, which are ordered in the same way as the values themselves.
+  uint32_t maximum_bits = 0;
+  for (unsigned i = 0; i < size; i++) {
+    uint32_t bits;
+    memcpy(&bits, values + i, sizeof(bits));
+    bits &= 0x7FFFFFFFU;
+    maximum_bits = bits > maximum_bits ? bits : maximum_bits;
+  }
+  float maximum;
+  memcpy(&maximum, &maximum_bits, sizeof(maximum));
+
+  float scale = maximum / 127, inverse_scale = maximum ? 127 / maximum : 0;
+  for (unsigned i = 0; i < size; i++) {
+    float value = values[i] * inverse_scale;
+    quantized[i] = int8_t(int32_t(value + copysign(0.5f, value)));
+  }
+  return scale;
+}
+
+// Add given int8 values multiplied by a scale to a float vector.
+static inline void add_scaled_int8(const int8_t* values, float scale, unsigned size, float* target) {
+  for (unsigned i = 0; i < size; i++)
+    target[i] += scale * float(values[i]);
+}
+
+void neural_network::propagate_quantized(const vector<embedding>& embeddings, const vector<const vector<int>*>& embedding_ids_sequences,
+                                         vector<float>& hidden_layer, vector<int8_t>& hidden_layer_quantized, vector<float>& outcomes,
+                                         const quantized_network& quantized, const embeddings_cache* cache, bool softmax,
+                                         const vector<char>* outcomes_mask) const {
+  assert(!weights[0].empty());
+  assert(!quantized.outcomes_weights.empty());
+  assert(!softmax || !outcomes_mask);
+  for (auto&& embedding_ids : embedding_ids_sequences) if (embedding_ids) assert(embeddings.size() == embedding_ids->size());
+
+  unsigned hidden_layer_size = weights[0].front().size();
+  unsigned outcomes_size = quantized.outcomes_weights.size();
+
   // Hidden layer
   hidden_layer.assign(hidden_layer_size, 0);
 
+  // The contributions of the embeddings which are not cached are computed
+  // and quantized in the same way as in the quantized embeddings cache, using
+  // the outcomes and the quantized hidden layer as buffers.
+  if (outcomes.size() < hidden_layer_size) outcomes.resize(hidden_layer_size);
+  hidden_layer_quantized.resize(hidden_layer_size);
+
   unsigned index = 0;
   for (unsigned sequence = 0; sequence < embedding_ids_sequences.size(); sequence++)
     for (unsigned i = 0; i < embeddings.size(); index += embeddings[i].dimension, i++)
       if (embedding_ids_sequences[sequence] && embedding_ids_sequences[sequence]->at(i) >= 0) {
         unsigned word = embedding_ids_sequences[sequence]->at(i);
-        if (cache && i < cache->size() && word < cache->at(i).size()) {
-          // Use cache
-          const float* precomputed = cache->at(i)[word].data() + sequence * hidden_layer_size;
-          for (unsigned j = 0; j < hidden_layer_size; j++)
-            hidden_layer[j] += precomputed[j];
+        const embeddings_cache::entry* cached = cache ? cache->lookup(i, word) : nullptr;
+        if (cached) {
+          add_scaled_int8(cached->quantized_values.data() + sequence * hidden_layer_size,
+                          cached->quantized_scales[sequence], hidden_layer_size, hidden_layer.data());
         } else {
-          // Compute directly
-          const float* embedding = embeddings[i].weight(word);
-          for (unsigned j = 0; j < embeddings[i].dimension; j++)
-            for (unsigned k = 0; k < hidden_layer_size; k++)
-              hidden_layer[k] += embedding[j] * weights[0][index + j][k];
+          embedding_contribution(embeddings[i].weight(word), embeddings[i].dimension, index, outcomes.data());
+          float scale = quantize_int8(outcomes.data(), hidden_layer_size, hidden_layer_quantized.data());
+          add_scaled_int8(hidden_layer_quantized.data(), scale, hidden_layer_size, hidden_layer.data());
         }
       }
   for (unsigned i = 0; i < hidden_layer_size; i++) // Bias
     hidden_layer[i] += weights[0][index][i];
 
   // Activation function
+  activate(hidden_layer);
+
+  // Quantize the hidden layer
+  float hidden_layer_scale = quantize_int8(hidden_layer.data(), hidden_layer_size, hidden_layer_quantized.data());
+
+  // Quantized output layer, only the masked outcomes if requested
+  assert(!outcomes_mask || outcomes_mask->size() == outcomes_size);
+  outcomes.resize(outcomes_size);
+  for (unsigned i = 0; i < outcomes_size; i++)
+    outcomes[i] = outcomes_mask && !(*outcomes_mask)[i] ? 0 : quantized.outcomes_biases[i] + hidden_layer_scale *
+        quantized.outcomes_scales[i] * dot_int8(quantized.outcomes_weights[i].data(), hidden_layer_quantized.data(), hidden_layer_size);
+
+  // Softmax if requested
+  if (softmax) compute_softmax(outcomes);
+}
+
+void neural_network::activate(vector<float>& hidden_layer) const {
   switch (hidden_layer_activation) {
     case activation_function::TANH:
       if (!tanh_cache.empty())
@@ -87,24 +204,17 @@ void neural_network::propagate(const vector<embedding>& embeddings, const vector
         if (weight < 0) weight = 0;
       break;
   }
+}
 
-  for (unsigned i = 0; i < hidden_layer_size; i++)
-    for (unsigned j = 0; j < outcomes_size; j++)
-      outcomes[j] += hidden_layer[i] * weights[1][i][j];
-  for (unsigned i = 0; i < outcomes_size; i++) // Bias
-    outcomes[i] += weights[1][hidden_layer_size][i];
+void neural_network::compute_softmax(vector<float>& outcomes) {
+  float max = outcomes[0];
+  for (unsigned i = 1; i < outcomes.size(); i++) if (outcomes[i] > max) max = outcomes[i];
 
-  // Softmax if requested
-  if (softmax) {
-    float max = outcomes[0];
-    for (unsigned i = 1; i < outcomes_size; i++) if (outcomes[i] > max) max = outcomes[i];
+  float sum = 0;
+  for (unsigned i = 0; i < outcomes.size(); i++) sum += (outcomes[i] = exp(outcomes[i] - max));
+  sum = 1 / sum;
 
-    float sum = 0;
-    for (unsigned i = 0; i < outcomes_size; i++) sum += (outcomes[i] = exp(outcomes[i] - max));
-    sum = 1 / sum;
-
-    for (unsigned i = 0; i < outcomes_size; i++) outcomes[i] *= sum;
-  }
+  for (unsigned i = 0; i < outcomes.size(); i++) outcomes[i] *= sum;
 }
 
 void neural_network::generate_tanh_cache() {
@@ -113,31 +223,74 @@ void neural_network::generate_tanh_cache() {
     tanh_cache[i] = tanh(i / 32768.0 - 10);
 }
 
-void neural_network::generate_embeddings_cache(const vector<embedding>& embeddings, embeddings_cache& cache, unsigned max_words) const {
+void neural_network::generate_quantized_network(quantized_network& quantized) const {
+  assert(!weights[1].empty());
+
+  unsigned hidden_layer_size = weights[0].front().size();
+  unsigned outcomes_size = weights[1].front().size();
+
+  // Output layer, transposed and with a scale for every outcome
+  vector<float> column(hidden_layer_size);
+  quantized.outcomes_weights.resize(outcomes_size);
+  quantized.outcomes_scales.resize(outcomes_size);
+  quantized.outcomes_biases.resize(outcomes_size);
+  for (unsigned i = 0; i < outcomes_size; i++) {
+    for (unsigned j = 0; j < hidden_layer_size; j++)
+      column[j] = weights[1][j][i];
+    quantized.outcomes_weights[i].resize(hidden_layer_size);
+    quantized.outcomes_scales[i] = quantize_int8(column.data(), hidden_layer_size, quantized.outcomes_weights[i].data());
+    quantized.outcomes_biases[i] = weights[1][hidden_layer_size][i];
+  }
+}
+
+void neural_network::precomputed_embedding_shape(const vector<embedding>& embeddings, unsigned& sequences, unsigned& hidden_layer_size) const {
   unsigned embeddings_dim = 0;
   for (auto&& embedding : embeddings) embeddings_dim += embedding.dimension;
 
-  unsigned sequences = weights[0].size() / embeddings_dim;
+  sequences = embeddings_dim ? weights[0].size() / embeddings_dim : 0;
   assert(sequences * embeddings_dim + 1 == weights[0].size());
 
-  unsigned hidden_layer_size = weights[0].front().size();
+  hidden_layer_size = weights[0].front().size();
+}
 
-  cache.resize(embeddings.size());
-  for (unsigned i = 0, weight_index = 0; i < embeddings.size(); weight_index += embeddings[i].dimension, i++) {
-    unsigned words = 0;
-    while (words < max_words && embeddings[i].weight(words)) words++;
-
-    cache[i].resize(words);
-    for (unsigned word = 0; word < words; word++) {
-      const float* embedding = embeddings[i].weight(word);
-
-      cache[i][word].assign(sequences * hidden_layer_size, 0);
-      for (unsigned sequence = 0, index = weight_index; sequence < sequences; index += embeddings_dim, sequence++)
-        for (unsigned j = 0; j < embeddings[i].dimension; j++)
-          for (unsigned k = 0; k < hidden_layer_size; k++)
-            cache[i][word][sequence * hidden_layer_size + k] += embedding[j] * weights[0][index + j][k];
-    }
+void neural_network::precompute_embedding(const vector<embedding>& embeddings, unsigned i, unsigned word, bool quantized,
+                                          embeddings_cache::entry& entry) const {
+  unsigned embeddings_dim = 0, weight_index = 0;
+  for (unsigned j = 0; j < embeddings.size(); j++) {
+    if (j < i) weight_index += embeddings[j].dimension;
+    embeddings_dim += embeddings[j].dimension;
   }
+
+  unsigned sequences, hidden_layer_size;
+  precomputed_embedding_shape(embeddings, sequences, hidden_layer_size);
+
+  const float* embedding = embeddings[i].weight(word);
+  assert(embedding);
+
+  vector<float> values(sequences * hidden_layer_size);
+  for (unsigned sequence = 0, index = weight_index; sequence < sequences; index += embeddings_dim, sequence++)
+    embedding_contribution(embedding, embeddings[i].dimension, index, values.data() + sequence * hidden_layer_size);
+
+  if (quantized) {
+    // Quantize every sequence using its own scale
+    entry.quantized_values.resize(sequences * hidden_layer_size);
+    entry.quantized_scales.resize(sequences);
+    for (unsigned sequence = 0; sequence < sequences; sequence++)
+      entry.quantized_scales[sequence] = quantize_int8(values.data() + sequence * hidden_layer_size, hidden_layer_size,
+                                                       entry.quantized_values.data() + sequence * hidden_layer_size);
+  } else {
+    entry.values.swap(values);
+  }
+}
+
+void neural_network::embedding_contribution(const float* embedding, unsigned dimension, unsigned index, float* contribution) const {
+  unsigned hidden_layer_size = weights[0].front().size();
+
+  for (unsigned k = 0; k < hidden_layer_size; k++)
+    contribution[k] = 0;
+  for (unsigned j = 0; j < dimension; j++)
+    for (unsigned k = 0; k < hidden_layer_size; k++)
+      contribution[k] += embedding[j] * weights[0][index + j][k];
 }
 
 } // namespace parsito
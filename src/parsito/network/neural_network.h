@@ -9,8 +9,11 @@
 
 #pragma once
 
+#include <cstdint>
+
 #include "common.h"
 #include "activation_function.h"
+#include "embeddings_cache.h"
 #include "parsito/embedding/embedding.h"
 #include "utils/binary_decoder.h"
 
@@ -20,19 +23,38 @@ namespace parsito {
 
 class neural_network {
  public:
-  typedef vector<vector<vector<float>>> embeddings_cache;
-
+  // If an outcomes mask is given, only the outcomes present in the mask are
+  // guaranteed to be computed; the softmax cannot be requested in that case.
   void propagate(const vector<embedding>& embeddings, const vector<const vector<int>*>& embedding_ids_sequences,
-                 vector<float>& hidden_layer, vector<float>& outcomes, const embeddings_cache* cache = nullptr, bool softmax = true) const;
+                 vector<float>& hidden_layer, vector<float>& outcomes, const embeddings_cache* cache = nullptr, bool softmax = true,
+                 const vector<char>* outcomes_mask = nullptr) const;
+
+  // Quantized network used for int8 inference. The output layer weights are
+  // stored transposed with a scale for every outcome; the embeddings are
+  // taken from a quantized embeddings cache.
+  struct quantized_network {
+    vector<vector<int8_t>> outcomes_weights;
+    vector<float> outcomes_scales, outcomes_biases;
+  };
+  void propagate_quantized(const vector<embedding>& embeddings, const vector<const vector<int>*>& embedding_ids_sequences,
+                           vector<float>& hidden_layer, vector<int8_t>& hidden_layer_quantized, vector<float>& outcomes,
+                           const quantized_network& quantized, const embeddings_cache* cache = nullptr, bool softmax = true,
+                           const vector<char>* outcomes_mask = nullptr) const;
 
   void load(binary_decoder& data);
   void generate_tanh_cache();
-  void generate_embeddings_cache(const vector<embedding>& embeddings, embeddings_cache& cache, unsigned max_words) const;
+  void generate_quantized_network(quantized_network& quantized) const;
+
+  void precomputed_embedding_shape(const vector<embedding>& embeddings, unsigned& sequences, unsigned& hidden_layer_size) const;
+  void precompute_embedding(const vector<embedding>& embeddings, unsigned i, unsigned word, bool quantized, embeddings_cache::entry& entry) const;
 
  private:
   friend class neural_network_trainer;
 
   void load_matrix(binary_decoder& data, vector<vector<float>>& m);
+  void activate(vector<float>& hidden_layer) const;
+  void embedding_contribution(const float* embedding, unsigned dimension, unsigned index, float* contribution) const;
+  static void compute_softmax(vector<float>& outcomes);
 
   activation_function::type hidden_layer_activation;
   vector<vector<float>> weights[2];
@@ -23,11 +23,23 @@ class parser {
  public:
   virtual ~parser() {};
 
-  virtual void parse(tree& t, unsigned beam_size = 0, double* cost = nullptr) const = 0;
-
-  enum { NO_CACHE = 0, FULL_CACHE = 2147483647};
-  static parser* load(const char* file, unsigned cache = 1000);
-  static parser* load(istream& in, unsigned cache = 1000);
+  // If node views are given, the node values are taken from them instead of the tree.
+  virtual void parse(tree& t, unsigned beam_size = 0, double* cost = nullptr, bool quantized = false,
+                     const vector<node_view>* views = nullptr) const = 0;
+
+  // The embeddings cache size is given in megabytes, limited by the memory
+  // needed to cache all words. The DEFAULT_CACHE uses the memory needed to
+  // cache DEFAULT_CACHE_WORDS words of every embedding.
+  enum { NO_CACHE = 0, DEFAULT_CACHE = 2147483646, FULL_CACHE = 2147483647};
+  enum { DEFAULT_CACHE_WORDS = 1000 };
+  static parser* load(const char* file, unsigned cache = DEFAULT_CACHE);
+  static parser* load(istream& in, unsigned cache = DEFAULT_CACHE);
+  virtual void set_cache_size(unsigned cache) = 0;
+
+  struct cache_statistics {
+    size_t lookups, hits, entries, memory, memory_limit;
+  };
+  virtual void get_cache_statistics(cache_statistics& statistics) const = 0;
 
  protected:
   virtual void load(binary_decoder& data, unsigned cache) = 0;
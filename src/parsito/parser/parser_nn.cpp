@@ -22,14 +22,16 @@ namespace parsito {
 
 parser_nn::parser_nn(bool versioned) : versioned(versioned) {}
 
-void parser_nn::parse(tree& t, unsigned beam_size, double* cost) const {
+void parser_nn::parse(tree& t, unsigned beam_size, double* cost, bool quantized, const vector<node_view>* views) const {
+  assert(!views || views->size() >= t.nodes.size());
+
   if (beam_size > 1)
-    parse_beam_search(t, beam_size, cost);
+    parse_beam_search(t, beam_size, cost, quantized, views);
   else
-    parse_greedy(t, cost);
+    parse_greedy(t, cost, quantized, views);
 }
 
-void parser_nn::parse_greedy(tree& t, double* cost) const {
+void parser_nn::parse_greedy(tree& t, double* cost, bool quantized, const vector<node_view>* views) const {
   assert(system);
   if (cost) *cost = 0.;
 
@@ -37,6 +39,12 @@ void parser_nn::parse_greedy(tree& t, double* cost) const {
   workspace* w = workspaces.pop();
   if (!w) w = new workspace(single_root);
 
+  // Start using the embeddings cache
+  if (quantized) get_quantized_network();
+  embeddings_cache& active_cache = quantized ? quantized_cache : cache;
+  unsigned cache_generation = active_cache.begin_use();
+  w->cache_lookups = w->cache_hits = 0;
+
   // Create configuration
   w->conf.init(&t);
 
@@ -45,28 +53,38 @@ void parser_nn::parse_greedy(tree& t, double* cost) const {
   for (size_t i = 0; i < t.nodes.size(); i++) {
     if (w->embeddings[i].size() < embeddings.size()) w->embeddings[i].resize(embeddings.size());
     for (size_t j = 0; j < embeddings.size(); j++) {
-      values[j].extract(t.nodes[i], w->word);
+      values[j].extract(t.nodes[i], views ? &(*views)[i] : nullptr, w->word);
       w->embeddings[i][j] = embeddings[j].lookup_word(w->word, w->word_buffer);
+      observe(active_cache, j, w->embeddings[i][j], w);
     }
   }
 
   // Compute which transitions to perform and perform them
   int transitions = 0;
   for (; !w->conf.final(); transitions++) {
-    // Extract nodes from the configuration
-    nodes.extract(w->conf, w->extracted_nodes);
-    w->extracted_embeddings.resize(w->extracted_nodes.size());
-    for (size_t i = 0; i < w->extracted_nodes.size(); i++)
-      w->extracted_embeddings[i] = w->extracted_nodes[i] >= 0 ? &w->embeddings[w->extracted_nodes[i]] : nullptr;
+    // Find applicable transitions
+    unsigned applicable = system->applicable_mask(w->conf, w->applicable);
 
-    // Classify using neural network
-    network.propagate(embeddings, w->extracted_embeddings, w->network_buffer, w->outcomes, &embeddings_cache, cost ? true : false);
-
-    // Find most probable applicable transition
     int best = -1;
-    for (unsigned i = 0; i < w->outcomes.size(); i++)
-      if (system->applicable(w->conf, i) && (best < 0 || w->outcomes[i] > w->outcomes[best]))
-        best = i;
+    if (applicable == 1 && !cost) {
+      // Only one transition is applicable, no need to classify
+      while (!w->applicable[++best]) {}
+    } else {
+      // Extract nodes from the configuration
+      nodes.extract(w->conf, w->extracted_nodes);
+      w->extracted_embeddings.resize(w->extracted_nodes.size());
+      for (size_t i = 0; i < w->extracted_nodes.size(); i++)
+        w->extracted_embeddings[i] = w->extracted_nodes[i] >= 0 ? &w->embeddings[w->extracted_nodes[i]] : nullptr;
+
+      // Classify using neural network; without the cost, only the applicable
+      // transitions are scored and the softmax is not needed
+      propagate(w, cost ? true : false, quantized, cost ? nullptr : &w->applicable);
+
+      // Find most probable applicable transition
+      for (unsigned i = 0; i < w->applicable.size(); i++)
+        if (w->applicable[i] && (best < 0 || w->outcomes[i] > w->outcomes[best]))
+          best = i;
+    }
 
     // Perform the best transition
     int child = system->perform(w->conf, best);
@@ -75,25 +93,35 @@ void parser_nn::parse_greedy(tree& t, double* cost) const {
     // If a node was linked, recompute its embeddings as deprel has changed
     if (child >= 0)
       for (size_t i = 0; i < embeddings.size(); i++) {
+        if (!values[i].extracts_deprel()) continue;
         values[i].extract(t.nodes[child], w->word);
         w->embeddings[child][i] = embeddings[i].lookup_word(w->word, w->word_buffer);
+        observe(active_cache, i, w->embeddings[child][i], w);
       }
   }
 
   if (cost && transitions)
     *cost = *cost / transitions * (t.nodes.size() - 1);
 
+  active_cache.end_use(cache_generation, w->cache_lookups, w->cache_hits);
+
   // Store workspace
   workspaces.push(w);
 }
 
-void parser_nn::parse_beam_search(tree& t, unsigned beam_size, double* cost) const {
+void parser_nn::parse_beam_search(tree& t, unsigned beam_size, double* cost, bool quantized, const vector<node_view>* views) const {
   assert(system);
 
   // Retrieve or create workspace
   workspace* w = workspaces.pop();
   if (!w) w = new workspace(single_root);
 
+  // Start using the embeddings cache
+  if (quantized) get_quantized_network();
+  embeddings_cache& active_cache = quantized ? quantized_cache : cache;
+  unsigned cache_generation = active_cache.begin_use();
+  w->cache_lookups = w->cache_hits = 0;
+
   // Allocate and initialize configuration
   for (int i = 0; i < 2; i++) {
     while (w->bs_confs[i].size() < beam_size) w->bs_confs[i].emplace_back(single_root);
@@ -112,8 +140,9 @@ void parser_nn::parse_beam_search(tree& t, unsigned beam_size, double* cost) con
     if (w->embeddings[i].size() < embeddings.size()) w->embeddings[i].resize(embeddings.size());
     if (w->embeddings_values[i].size() < embeddings.size()) w->embeddings_values[i].resize(embeddings.size());
     for (size_t j = 0; j < embeddings.size(); j++) {
-      values[j].extract(t.nodes[i], w->embeddings_values[i][j]);
+      values[j].extract(t.nodes[i], views ? &(*views)[i] : nullptr, w->embeddings_values[i][j]);
       w->embeddings[i][j] = embeddings[j].lookup_word(w->embeddings_values[i][j], w->word_buffer);
+      observe(active_cache, j, w->embeddings[i][j], w);
     }
   }
 
@@ -139,13 +168,15 @@ void parser_nn::parse_beam_search(tree& t, unsigned beam_size, double* cost) con
       all_final = false;
 
       bs_conf.refresh_tree();
-      // Update embeddings for all nodes
+      // Update embeddings for all nodes, only the deprels might have changed
       for (size_t i = 0; i < t.nodes.size(); i++)
         for (size_t j = 0; j < embeddings.size(); j++) {
+          if (!values[j].extracts_deprel()) continue;
           values[j].extract(t.nodes[i], w->word);
           if (w->word != w->embeddings_values[i][j]) {
             w->embeddings[i][j] = embeddings[j].lookup_word(w->word, w->word_buffer);
             w->embeddings_values[i][j].assign(w->word);
+            observe(active_cache, j, w->embeddings[i][j], w);
           }
         }
 
@@ -156,11 +187,12 @@ void parser_nn::parse_beam_search(tree& t, unsigned beam_size, double* cost) con
         w->extracted_embeddings[i] = w->extracted_nodes[i] >= 0 ? &w->embeddings[w->extracted_nodes[i]] : nullptr;
 
       // Classify using neural network
-      network.propagate(embeddings, w->extracted_embeddings, w->network_buffer, w->outcomes, &embeddings_cache);
+      propagate(w, true, quantized);
 
       // Store all alternatives
-      for (unsigned i = 0; i < w->outcomes.size(); i++)
-        if (system->applicable(bs_conf.conf, i)) {
+      system->applicable_mask(bs_conf.conf, w->applicable);
+      for (unsigned i = 0; i < w->applicable.size(); i++)
+        if (w->applicable[i]) {
           double cost = (bs_conf.cost * iteration + log(w->outcomes[i])) / (iteration + 1);
           if (w->bs_alternatives.size() == beam_size) {
             if (cost <= w->bs_alternatives[0].cost) continue;
@@ -194,10 +226,40 @@ void parser_nn::parse_beam_search(tree& t, unsigned beam_size, double* cost) con
 
   if (cost) *cost = w->bs_confs[iteration & 1][best].cost * (t.nodes.size() - 1);
 
+  active_cache.end_use(cache_generation, w->cache_lookups, w->cache_hits);
+
   // Store workspace
   workspaces.push(w);
 }
 
+void parser_nn::observe(embeddings_cache& cache, unsigned embedding, int word, workspace* w) const {
+  if (word < 0) return;
+
+  w->cache_lookups++;
+  if (cache.observe(embedding, word)) w->cache_hits++;
+}
+
+void parser_nn::propagate(workspace* w, bool softmax, bool quantized, const vector<char>* outcomes_mask) const {
+  if (quantized)
+    network.propagate_quantized(embeddings, w->extracted_embeddings, w->network_buffer, w->network_buffer_quantized,
+                                w->outcomes, get_quantized_network(), &quantized_cache, softmax, outcomes_mask);
+  else
+    network.propagate(embeddings, w->extracted_embeddings, w->network_buffer, w->outcomes, &cache, softmax, outcomes_mask);
+}
+
+const neural_network::quantized_network& parser_nn::get_quantized_network() const {
+  if (!quantized_network_ready.load(memory_order_acquire)) {
+    lock_guard<mutex> lock(quantized_network_mutex);
+    if (!quantized_network_ready.load(memory_order_relaxed)) {
+      network.generate_quantized_network(quantized_network);
+      quantized_cache.init(network, embeddings, true);
+      quantized_cache.set_memory_limit(cache_memory_limit(quantized_cache));
+      quantized_network_ready.store(true, memory_order_release);
+    }
+  }
+  return quantized_network;
+}
+
 void parser_nn::workspace::beam_size_configuration::refresh_tree() {
   for (auto&& node : conf.t->nodes) node.children.clear();
   for (size_t i = 0; i < conf.t->nodes.size(); i++) {
@@ -256,7 +318,38 @@ void parser_nn::load(binary_decoder& data, unsigned cache) {
   // Load the network
   network.load(data);
   network.generate_tanh_cache();
-  network.generate_embeddings_cache(embeddings, embeddings_cache, cache);
+
+  // Initialize the embeddings cache, which is filled lazily during parsing
+  this->cache.init(network, embeddings, false);
+  set_cache_size(cache);
+}
+
+void parser_nn::set_cache_size(unsigned cache) {
+  // The quantized cache is initialized lazily, its limit is set afterwards
+  lock_guard<mutex> lock(quantized_network_mutex);
+  cache_size = cache;
+  this->cache.set_memory_limit(cache_memory_limit(this->cache));
+  if (quantized_network_ready.load(memory_order_relaxed))
+    quantized_cache.set_memory_limit(cache_memory_limit(quantized_cache));
+}
+
+size_t parser_nn::cache_memory_limit(const embeddings_cache& cache) const {
+  if (cache_size == DEFAULT_CACHE) return cache.memory_for_words(DEFAULT_CACHE_WORDS);
+
+  size_t full_memory = cache.memory_for_words(FULL_CACHE);
+  return cache_size >= (full_memory >> 20) + 1 ? full_memory : size_t(cache_size) << 20;
+}
+
+void parser_nn::get_cache_statistics(cache_statistics& statistics) const {
+  embeddings_cache::statistics stats[2];
+  cache.get_statistics(stats[0]);
+  quantized_cache.get_statistics(stats[1]);
+
+  statistics.lookups = stats[0].lookups + stats[1].lookups;
+  statistics.hits = stats[0].hits + stats[1].hits;
+  statistics.entries = stats[0].entries + stats[1].entries;
+  statistics.memory = stats[0].memory + stats[1].memory;
+  statistics.memory_limit = stats[0].memory_limit + stats[1].memory_limit;
 }
 
 } // namespace parsito
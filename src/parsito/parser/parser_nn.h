@@ -9,12 +9,15 @@
 
 #pragma once
 
+#include <atomic>
 #include <list>
+#include <mutex>
 
 #include "common.h"
 #include "parsito/configuration/node_extractor.h"
 #include "parsito/configuration/value_extractor.h"
 #include "parsito/embedding/embedding.h"
+#include "parsito/network/embeddings_cache.h"
 #include "parsito/network/neural_network.h"
 #include "parser.h"
 #include "parsito/transition/transition_system.h"
@@ -28,15 +31,19 @@ class parser_nn : public parser {
  public:
   parser_nn(bool versioned);
 
-  virtual void parse(tree& t, unsigned beam_size = 0, double* cost = nullptr) const override;
+  virtual void parse(tree& t, unsigned beam_size = 0, double* cost = nullptr, bool quantized = false,
+                     const vector<node_view>* views = nullptr) const override;
+  virtual void set_cache_size(unsigned cache) override;
+  virtual void get_cache_statistics(cache_statistics& statistics) const override;
 
  protected:
   virtual void load(binary_decoder& data, unsigned cache) override;
 
  private:
   friend class parser_nn_trainer;
-  void parse_greedy(tree& t, double* cost) const;
-  void parse_beam_search(tree& t, unsigned beam_size, double* cost) const;
+  void parse_greedy(tree& t, double* cost, bool quantized, const vector<node_view>* views) const;
+  void parse_beam_search(tree& t, unsigned beam_size, double* cost, bool quantized, const vector<node_view>* views) const;
+  const neural_network::quantized_network& get_quantized_network() const;
 
   bool versioned;
   unsigned version;
@@ -52,7 +59,15 @@ class parser_nn : public parser {
   vector<embedding> embeddings;
 
   neural_network network;
-  neural_network::embeddings_cache embeddings_cache;
+  mutable embeddings_cache cache;
+  unsigned cache_size = DEFAULT_CACHE;
+  size_t cache_memory_limit(const embeddings_cache& cache) const;
+
+  // The quantized network and its embeddings cache are generated on first use
+  mutable neural_network::quantized_network quantized_network;
+  mutable embeddings_cache quantized_cache;
+  mutable atomic<bool> quantized_network_ready{false};
+  mutable mutex quantized_network_mutex;
 
   struct workspace {
     workspace(bool single_root) : conf(single_root) {}
@@ -66,7 +81,11 @@ class parser_nn : public parser {
     vector<int> extracted_nodes;
     vector<const vector<int>*> extracted_embeddings;
 
+    vector<char> applicable;
     vector<float> outcomes, network_buffer;
+    vector<int8_t> network_buffer_quantized;
+
+    size_t cache_lookups, cache_hits;
 
     // Beam-size structures
     struct beam_size_configuration {
@@ -93,6 +112,9 @@ class parser_nn : public parser {
     vector<beam_size_alternative> bs_alternatives;
   };
   mutable threadsafe_stack<workspace> workspaces;
+
+  void observe(embeddings_cache& cache, unsigned embedding, int word, workspace* w) const;
+  void propagate(workspace* w, bool softmax, bool quantized, const vector<char>* outcomes_mask = nullptr) const;
 };
 
 } // namespace parsito
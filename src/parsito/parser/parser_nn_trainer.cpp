@@ -12,6 +12,8 @@
 #include <fstream>
 #include <limits>
 #include <random>
+#include <sstream>
+#include <thread>
 #include <unordered_set>
 
 #include "parsito/network/neural_network_trainer.h"
@@ -29,7 +31,7 @@ namespace parsito {
 
 void parser_nn_trainer::train(const string& transition_system_name, const string& transition_oracle_name, bool single_root,
                               const string& embeddings_description, const string& nodes_description, const network_parameters& parameters,
-                              unsigned /*number_of_threads*/, const vector<tree>& train, const vector<tree>& heldout, binary_encoder& enc) {
+                              unsigned number_of_threads, const vector<tree>& train, const vector<tree>& heldout, binary_encoder& enc) {
   if (train.empty()) training_failure("No training data was given!");
 
   // Random generator with fixed seed for reproducibility
@@ -253,6 +255,72 @@ void parser_nn_trainer::train(const string& transition_system_name, const string
   neural_network heldout_best_network;
   unsigned heldout_best_correct_labelled = 0, heldout_best_iteration = 0;
 
+  // Heldout evaluation is performed using number_of_threads threads. If heldout_overlap
+  // is set, a snapshot of the parser is evaluated while next iteration is being trained.
+  parser_nn heldout_parser(true);
+  if (!heldout.empty() && parameters.heldout_overlap) {
+    heldout_parser.version = parser.version;
+    heldout_parser.single_root = parser.single_root;
+    heldout_parser.labels = parser.labels;
+    heldout_parser.system.reset(transition_system::create(transition_system_name, heldout_parser.labels));
+    heldout_parser.nodes = parser.nodes;
+    heldout_parser.values = parser.values;
+  }
+
+  const parser_nn* heldout_evaluated = nullptr;
+  unsigned heldout_evaluated_iteration = 0;
+  string heldout_log;
+  atomic<unsigned> heldout_index(0), heldout_total(0), heldout_correct_unlabelled(0), heldout_correct_labelled(0);
+  vector<thread> heldout_threads;
+  auto heldout_evaluation = [&]() {
+    tree t;
+    unsigned total = 0, correct_unlabelled = 0, correct_labelled = 0;
+    for (unsigned current_index; (current_index = heldout_index++) < heldout.size();) {
+      const tree& gold = heldout[current_index];
+      t = gold;
+      t.unlink_all_nodes();
+      heldout_evaluated->parse(t);
+      for (size_t i = 1; i < t.nodes.size(); i++) {
+        total++;
+        correct_unlabelled += t.nodes[i].head == gold.nodes[i].head;
+        correct_labelled += t.nodes[i].head == gold.nodes[i].head && t.nodes[i].deprel == gold.nodes[i].deprel;
+      }
+    }
+    heldout_total += total;
+    heldout_correct_unlabelled += correct_unlabelled;
+    heldout_correct_labelled += correct_labelled;
+  };
+  auto heldout_start = [&](const parser_nn& evaluated, unsigned iteration, const string& log) {
+    heldout_evaluated = &evaluated;
+    heldout_log.assign(log);
+    heldout_evaluated_iteration = iteration;
+    heldout_index = heldout_total = heldout_correct_unlabelled = heldout_correct_labelled = 0;
+    if (number_of_threads > 1 || parameters.heldout_overlap) {
+      for (unsigned i = 0; i < max(number_of_threads, 1U); i++)
+        heldout_threads.emplace_back(heldout_evaluation);
+    } else {
+      heldout_evaluation();
+    }
+  };
+  auto heldout_finish = [&]() {
+    if (!heldout_evaluated) return;
+    for (; !heldout_threads.empty(); heldout_threads.pop_back()) heldout_threads.back().join();
+
+    unsigned total = heldout_total, correct_unlabelled = heldout_correct_unlabelled, correct_labelled = heldout_correct_labelled;
+    cerr << heldout_log << ", heldout UAS " << fixed << setprecision(2) << (100. * correct_unlabelled / total) << "%, LAS " << (100. * correct_labelled / total) << "%" << endl;
+
+    if (parameters.early_stopping && correct_labelled > heldout_best_correct_labelled) {
+      // The snapshot is overwritten in the next iteration, so it can be swapped
+      if (heldout_evaluated == &heldout_parser)
+        swap(heldout_best_network, heldout_parser.network);
+      else
+        heldout_best_network = heldout_evaluated->network;
+      heldout_best_correct_labelled = correct_labelled;
+      heldout_best_iteration = heldout_evaluated_iteration;
+    }
+    heldout_evaluated = nullptr;
+  };
+
   vector<int> permutation;
   for (size_t i = 0; i < train.size(); i++)
     permutation.push_back(permutation.size());
@@ -459,36 +527,29 @@ void parser_nn_trainer::train(const string& transition_system_name, const string
       for (double old_atomic_logprob = atomic_logprob; atomic_logprob.compare_exchange_weak(old_atomic_logprob, old_atomic_logprob + logprob); ) {}
     };
 
-    cerr << "Iteration " << iteration << ": ";
+    ostringstream iteration_log;
+    ostream& log = !heldout.empty() && parameters.heldout_overlap ? iteration_log : cerr;
+    log << "Iteration " << iteration << ": ";
     training();
-    cerr << "training logprob " << scientific << setprecision(4) << atomic_logprob;
+    log << "training logprob " << scientific << setprecision(4) << atomic_logprob;
 
     // Evaluate heldout data if present
     if (!heldout.empty()) {
-      tree t;
-      unsigned total = 0, correct_unlabelled = 0, correct_labelled = 0;
-      for (auto&& gold : heldout) {
-        t = gold;
-        t.unlink_all_nodes();
-        parser.parse(t);
-        for (size_t i = 1; i < t.nodes.size(); i++) {
-          total++;
-          correct_unlabelled += t.nodes[i].head == gold.nodes[i].head;
-          correct_labelled += t.nodes[i].head == gold.nodes[i].head && t.nodes[i].deprel == gold.nodes[i].deprel;
-        }
-      }
-
-      cerr << ", heldout UAS " << fixed << setprecision(2) << (100. * correct_unlabelled / total) << "%, LAS " << (100. * correct_labelled / total) << "%";
-
-      if (parameters.early_stopping && correct_labelled > heldout_best_correct_labelled) {
-        heldout_best_network = parser.network;
-        heldout_best_correct_labelled = correct_labelled;
-        heldout_best_iteration = iteration;
+      if (parameters.heldout_overlap) {
+        // Finish evaluation of the previous iteration and start evaluating a snapshot of the current one
+        heldout_finish();
+        heldout_parser.embeddings = parser.embeddings;
+        heldout_parser.network = parser.network;
+        heldout_start(heldout_parser, iteration, iteration_log.str());
+      } else {
+        heldout_start(parser, iteration, string());
+        heldout_finish();
       }
+    } else {
+      cerr << endl;
     }
-
-    cerr << endl;
   }
+  heldout_finish();
 
   if (parameters.early_stopping && heldout_best_iteration > 0) {
     cerr << "Using early stopping -- choosing network from iteration " << heldout_best_iteration << endl;
@@ -26,6 +26,16 @@ bool transition_system::applicable(const configuration& conf, unsigned transitio
   return transitions[transition]->applicable(conf);
 }
 
+unsigned transition_system::applicable_mask(const configuration& conf, vector<char>& mask) const {
+  unsigned applicable = 0;
+
+  mask.resize(transitions.size());
+  for (unsigned i = 0; i < transitions.size(); i++)
+    applicable += mask[i] = transitions[i]->applicable(conf);
+
+  return applicable;
+}
+
 int transition_system::perform(configuration& conf, unsigned transition) const {
   assert(transition < transitions.size());
 
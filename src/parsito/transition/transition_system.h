@@ -23,6 +23,7 @@ class transition_system {
 
   virtual unsigned transition_count() const;
   virtual bool applicable(const configuration& conf, unsigned transition) const;
+  virtual unsigned applicable_mask(const configuration& conf, vector<char>& mask) const;
   virtual int perform(configuration& conf, unsigned transition) const;
   virtual transition_oracle* oracle(const string& name) const = 0;
 
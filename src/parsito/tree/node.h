@@ -10,6 +10,7 @@
 #pragma once
 
 #include "common.h"
+#include "utils/string_piece.h"
 
 namespace ufal {
 namespace udpipe {
@@ -33,6 +34,18 @@ class node {
   node(int id = -1, const string& form = string()) : id(id), form(form), head(-1) {}
 };
 
+// Values of a node stored elsewhere, which can be used during parsing instead
+// of the values stored in the node. The deprel is always taken from the node.
+class node_view {
+ public:
+  string_piece form;
+  string_piece lemma;
+  string_piece upostag;
+  string_piece xpostag;
+  string_piece feats;
+  string_piece misc;
+};
+
 } // namespace parsito
 } // namespace udpipe
 } // namespace ufal
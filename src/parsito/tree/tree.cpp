@@ -26,13 +26,35 @@ bool tree::empty() {
 }
 
 void tree::clear() {
-  nodes.clear();
+  while (!nodes.empty()) {
+    unused_nodes.push_back(move(nodes.back()));
+    nodes.pop_back();
+  }
   node& root = add_node(root_form);
   root.lemma = root.upostag = root.xpostag = root.feats = root_form;
 }
 
 node& tree::add_node(const string& form) {
-  nodes.emplace_back((int)nodes.size(), form);
+  if (unused_nodes.empty()) {
+    nodes.emplace_back((int)nodes.size(), form);
+  } else {
+    // Reuse a node removed by clear, keeping its allocated memory
+    nodes.push_back(move(unused_nodes.back()));
+    unused_nodes.pop_back();
+
+    node& n = nodes.back();
+    n.id = (int)nodes.size() - 1;
+    n.form.assign(form);
+    n.lemma.clear();
+    n.upostag.clear();
+    n.xpostag.clear();
+    n.feats.clear();
+    n.head = -1;
+    n.deprel.clear();
+    n.deps.clear();
+    n.misc.clear();
+    n.children.clear();
+  }
   return nodes.back();
 }
 
@@ -29,6 +29,10 @@ class tree {
   void unlink_all_nodes();
 
   static const string root_form;
+
+ private:
+  // Nodes removed by clear, kept to reuse their allocated memory
+  vector<node> unused_nodes;
 };
 
 } // namespace parsito
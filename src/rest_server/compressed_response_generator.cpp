@@ -0,0 +1,293 @@
+// This file is part of UDPipe <http://github.com/ufal/udpipe/>.
+//
+// Copyright 2026 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+#include "compressed_response_generator.h"
+
+namespace ufal {
+namespace udpipe {
+
+using microrestd::response_generator;
+
+static const unsigned length_bases[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const unsigned length_extras[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const unsigned distance_bases[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const unsigned distance_extras[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+static uint32_t reverse_bits(uint32_t code, unsigned length) {
+  uint32_t reversed = 0;
+  for (unsigned i = 0; i < length; i++, code >>= 1)
+    reversed = (reversed << 1) | (code & 1);
+  return reversed;
+}
+
+static uint32_t crc32_update(uint32_t crc, const unsigned char* data, size_t len) {
+  static const struct crc32_table {
+    uint32_t table[256];
+    crc32_table() {
+      for (uint32_t i = 0; i < 256; i++) {
+        uint32_t value = i;
+        for (int bit = 0; bit < 8; bit++)
+          value = value & 1 ? 0xEDB88320U ^ (value >> 1) : value >> 1;
+        table[i] = value;
+      }
+    }
+  } crc32;
+
+  crc = ~crc;
+  while (len--)
+    crc = crc32.table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+compressed_response_generator::compressed_response_generator(response_generator* generator, format_t format)
+  : generator(generator), format(format), started(false), history_start(0), position(0), block_start(0), block_bits(0),
+    head(1 << HASH_BITS, 0), prev(WINDOW, 0), bit_buffer(0), bit_count(0),
+    checksum(format == GZIP ? 0 : 1), checksum_b(0), input_length(0) {}
+
+bool compressed_response_generator::generate() {
+  if (!generator) return false;
+
+  if (!started) {
+    started = true;
+    if (format == GZIP)
+      output.append("\x1F\x8B\x08\x00\x00\x00\x00\x00\x00\xFF", 10);
+    else
+      output.append("\x78\x01", 2);
+  }
+
+  bool more = generator->generate();
+  microrestd::string_piece data = generator->current();
+  compress(data, !more);
+  generator->consume(data.len);
+
+  if (!more) generator.reset();
+  return true;
+}
+
+microrestd::string_piece compressed_response_generator::current() const {
+  return microrestd::string_piece(output.data(), output.size());
+}
+
+void compressed_response_generator::consume(size_t length) {
+  output.erase(0, length);
+}
+
+bool compressed_response_generator::accepted_format(const char* accept_encoding, format_t& format) {
+  if (!accept_encoding) return false;
+
+  // Find the qualities of gzip, deflate and of the wildcard, -1 if not given.
+  double gzip = -1, deflate = -1, any = -1;
+  for (const char* value = accept_encoding; *value; ) {
+    while (*value && (isspace(*value) || *value == ',')) value++;
+    const char* coding = value;
+    while (*value && *value != ',' && *value != ';' && !isspace(*value)) value++;
+    string name(coding, value - coding);
+    for (auto&& chr : name) chr = tolower(chr);
+
+    // Parse optional parameters, of which only q is relevant.
+    double quality = 1;
+    while (*value && *value != ',') {
+      while (*value && (isspace(*value) || *value == ';')) value++;
+      if ((value[0] == 'q' || value[0] == 'Q') && value[1] == '=')
+        quality = strtod(value + 2, nullptr);
+      while (*value && *value != ',' && *value != ';') value++;
+    }
+
+    if (name == "gzip" || name == "x-gzip") gzip = quality;
+    else if (name == "deflate") deflate = quality;
+    else if (name == "*") any = quality;
+  }
+
+  // An explicitly given quality takes precedence over the wildcard;
+  // choose the encoding with the highest nonzero quality, preferring gzip.
+  if (gzip < 0) gzip = max(any, 0.);
+  if (deflate < 0) deflate = max(any, 0.);
+  if (gzip > 0 && gzip >= deflate) return format = GZIP, true;
+  if (deflate > 0) return format = ZLIB, true;
+  return false;
+}
+
+const char* compressed_response_generator::content_encoding(format_t format) {
+  return format == GZIP ? "gzip" : "deflate";
+}
+
+void compressed_response_generator::compress(microrestd::string_piece data, bool finish) {
+  // Update the checksum and length of the uncompressed data.
+  auto bytes = (const unsigned char*) data.str;
+  if (format == GZIP) {
+    checksum = crc32_update(checksum, bytes, data.len);
+  } else {
+    for (size_t i = 0; i < data.len; ) {
+      for (size_t end = min(data.len, i + 5552); i < end; i++)
+        checksum_b += checksum += bytes[i];
+      checksum %= 65521; checksum_b %= 65521;
+    }
+  }
+  input_length += uint32_t(data.len);
+
+  history.append(data.str, data.len);
+
+  // Compress the available data, keeping enough lookahead for a longest match
+  // unless we are finishing.
+  size_t end = history_start + history.size();
+  size_t limit = finish ? end : end > MAX_MATCH ? end - MAX_MATCH : 0;
+  const unsigned char* window = (const unsigned char*) history.data() - history_start;
+  auto hash = [window](size_t pos) {
+    return ((uint32_t(window[pos]) << 10) ^ (uint32_t(window[pos + 1]) << 5) ^ window[pos + 2]) & ((1 << HASH_BITS) - 1);
+  };
+  auto insert = [&](size_t pos) {
+    // Positions are stored incremented by one, zero denoting no position;
+    // positions not fitting into 32 bits are not inserted at all.
+    if (pos + MIN_MATCH > end || pos >= 0xFFFFFFFFU) return 0U;
+    uint32_t& bucket = head[hash(pos)];
+    uint32_t candidate = bucket;
+    prev[pos & (WINDOW - 1)] = candidate;
+    bucket = uint32_t(pos + 1);
+    return unsigned(candidate);
+  };
+
+  while (position < limit) {
+    unsigned best_length = 0, best_distance = 0;
+    unsigned available = unsigned(min(end - position, size_t(MAX_MATCH)));
+    size_t candidate = insert(position);
+    for (int chain = 0; candidate && chain < MAX_CHAIN; chain++) {
+      size_t match = candidate - 1;
+      if (match >= position || position - match > WINDOW) break;
+
+      unsigned length = 0;
+      while (length < available && window[match + length] == window[position + length]) length++;
+      if (length > best_length) {
+        best_length = length;
+        best_distance = unsigned(position - match);
+        if (length == available) break;
+      }
+
+      size_t next = prev[match & (WINDOW - 1)];
+      if (next >= candidate) break;
+      candidate = next;
+    }
+
+    if (best_length >= MIN_MATCH) {
+      unsigned length_code = unsigned(upper_bound(length_bases, length_bases + 29, best_length) - length_bases) - 1;
+      unsigned distance_code = unsigned(upper_bound(distance_bases, distance_bases + 30, best_distance) - distance_bases) - 1;
+      block_symbols.emplace_back(uint16_t(best_length), uint16_t(best_distance));
+      block_bits += (length_code < 23 ? 7 : 8) + length_extras[length_code] + 5 + distance_extras[distance_code];
+
+      for (unsigned i = 1; i < best_length; i++)
+        insert(position + i);
+      position += best_length;
+    } else {
+      block_symbols.emplace_back(0, window[position]);
+      block_bits += window[position] < 144 ? 8 : 9;
+      position++;
+    }
+
+    if (position - block_start >= BLOCK_LENGTH)
+      write_block(window, false);
+  }
+
+  if (finish) {
+    // Write the final block and the trailer.
+    write_block(window, true);
+    flush_bits();
+
+    uint32_t trailer[2] = {checksum, input_length};
+    if (format == GZIP) {
+      for (auto&& value : trailer)
+        for (int i = 0; i < 4; i++)
+          output.push_back(char((value >> (8 * i)) & 0xFF));
+    } else {
+      uint32_t adler32 = (checksum_b << 16) | checksum;
+      for (int i = 3; i >= 0; i--)
+        output.push_back(char((adler32 >> (8 * i)) & 0xFF));
+    }
+
+    history.clear();
+    history.shrink_to_fit();
+  } else {
+    // Drop data which can no longer be referenced nor stored.
+    size_t needed = min(position > WINDOW ? position - WINDOW : 0, block_start);
+    if (needed > history_start + WINDOW) {
+      history.erase(0, needed - history_start);
+      history_start = needed;
+    }
+  }
+}
+
+void compressed_response_generator::write_block(const unsigned char* window, bool final) {
+  // Store the block if the fixed Huffman codes would not make it smaller,
+  // counting the end of block symbol and the stored block headers.
+  size_t length = position - block_start;
+  size_t stored_blocks = max((length + 65534) / 65535, size_t(1));
+  if (8 * (length + 5 * stored_blocks) < block_bits + 7 + 3) {
+    for (size_t stored = 0; stored < stored_blocks; stored++) {
+      size_t start = block_start + stored * 65535, end = min(start + 65535, position);
+      put_bits(final && stored + 1 == stored_blocks, 3);
+      flush_bits();
+      for (uint32_t header : {uint32_t(end - start), uint32_t(~(end - start) & 0xFFFF)})
+        put_bits(header, 16);
+      output.append((const char*) window + start, end - start);
+    }
+  } else {
+    put_bits(final | 2, 3);
+    for (auto&& symbol : block_symbols)
+      if (!symbol.length) {
+        put_symbol(symbol.value);
+      } else {
+        unsigned code = unsigned(upper_bound(length_bases, length_bases + 29, symbol.length) - length_bases) - 1;
+        put_symbol(257 + code);
+        put_bits(symbol.length - length_bases[code], length_extras[code]);
+        code = unsigned(upper_bound(distance_bases, distance_bases + 30, symbol.value) - distance_bases) - 1;
+        put_bits(reverse_bits(code, 5), 5);
+        put_bits(symbol.value - distance_bases[code], distance_extras[code]);
+      }
+    put_symbol(256);
+  }
+
+  block_symbols.clear();
+  block_bits = 0;
+  block_start = position;
+}
+
+void compressed_response_generator::put_bits(uint32_t bits, unsigned length) {
+  bit_buffer |= uint64_t(bits) << bit_count;
+  bit_count += length;
+  while (bit_count >= 8) {
+    output.push_back(char(bit_buffer & 0xFF));
+    bit_buffer >>= 8;
+    bit_count -= 8;
+  }
+}
+
+void compressed_response_generator::put_symbol(unsigned symbol) {
+  static const struct fixed_codes {
+    uint16_t codes[288];
+    uint8_t lengths[288];
+    fixed_codes() {
+      for (unsigned symbol = 0; symbol < 288; symbol++) {
+        lengths[symbol] = symbol < 144 ? 8 : symbol < 256 ? 9 : symbol < 280 ? 7 : 8;
+        codes[symbol] = reverse_bits(symbol < 144 ? 0x30 + symbol : symbol < 256 ? 0x190 + symbol - 144 :
+                                     symbol < 280 ? symbol - 256 : 0xC0 + symbol - 280, lengths[symbol]);
+      }
+    }
+  } fixed;
+
+  put_bits(fixed.codes[symbol], fixed.lengths[symbol]);
+}
+
+void compressed_response_generator::flush_bits() {
+  if (bit_count) put_bits(0, 8 - bit_count);
+}
+
+} // namespace udpipe
+} // namespace ufal
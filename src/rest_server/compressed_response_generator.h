@@ -0,0 +1,69 @@
+// This file is part of UDPipe <http://github.com/ufal/udpipe/>.
+//
+// Copyright 2026 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <cstdint>
+
+#include "common.h"
+#include "microrestd/microrestd.h"
+
+namespace ufal {
+namespace udpipe {
+
+// Response generator compressing the output of another generator
+// incrementally, using deflate in either gzip or zlib container. Every
+// block uses fixed Huffman codes, or is stored if it would not be smaller.
+class compressed_response_generator : public microrestd::response_generator {
+ public:
+  enum format_t { GZIP, ZLIB };
+
+  compressed_response_generator(microrestd::response_generator* generator, format_t format);
+
+  virtual bool generate() override;
+  virtual microrestd::string_piece current() const override;
+  virtual void consume(size_t length) override;
+
+  // Choose the format according to the Accept-Encoding header, returning
+  // false if no compression is acceptable.
+  static bool accepted_format(const char* accept_encoding, format_t& format);
+  static const char* content_encoding(format_t format);
+
+ private:
+  void compress(microrestd::string_piece data, bool finish);
+  void write_block(const unsigned char* window, bool final);
+  void put_bits(uint32_t bits, unsigned length);
+  void put_symbol(unsigned symbol);
+  void flush_bits();
+
+  unique_ptr<microrestd::response_generator> generator;
+  format_t format;
+  bool started;
+  string output;
+
+  // Deflate state; the symbols of the current block are either literals
+  // (with zero length) or matches
+  struct symbol {
+    uint16_t length, value;
+    symbol(uint16_t length, uint16_t value) : length(length), value(value) {}
+  };
+  string history;
+  size_t history_start, position, block_start;
+  vector<symbol> block_symbols;
+  size_t block_bits;
+  vector<uint32_t> head, prev;
+  uint64_t bit_buffer;
+  unsigned bit_count;
+  uint32_t checksum, checksum_b, input_length;
+
+  enum { WINDOW = 1 << 15, HASH_BITS = 15, MIN_MATCH = 3, MAX_MATCH = 258, MAX_CHAIN = 32, BLOCK_LENGTH = 1 << 16 };
+};
+
+} // namespace udpipe
+} // namespace ufal
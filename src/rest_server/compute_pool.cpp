@@ -0,0 +1,141 @@
+// This file is part of UDPipe <http://github.com/ufal/udpipe/>.
+//
+// Copyright 2026 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+
+#include "compute_pool.h"
+
+namespace ufal {
+namespace udpipe {
+
+compute_pool::job::~job() {
+  if (pool) pool->release(*this);
+}
+
+compute_pool::compute_pool(unsigned threads, unsigned queues, unsigned queue_limit, unsigned pool_limit)
+    : queues(queues), queue_limit(queue_limit), pool_limit(pool_limit) {
+  for (auto&& queue : this->queues)
+    queue.statistics = queue_statistics();
+
+  for (unsigned i = 0; i < max(threads, 1U); i++)
+    workers.emplace_back(&compute_pool::worker, this);
+}
+
+compute_pool::~compute_pool() {
+  {
+    unique_lock<mutex> lock(pool_mutex);
+    stopping = true;
+  }
+  pool_cv.notify_all();
+
+  for (auto&& worker : workers)
+    worker.join();
+
+  // Release the jobs still waiting in the queues
+  for (auto&& queue : queues)
+    for (auto&& job : queue.jobs)
+      job->pool = nullptr;
+}
+
+compute_pool::admission compute_pool::admit(unsigned queue, job& job) {
+  unique_lock<mutex> lock(pool_mutex);
+  if (queue >= queues.size()) return POOL_FULL;
+
+  auto& info = queues[queue];
+  if (queue_limit && info.statistics.admitted >= queue_limit)
+    return info.statistics.rejected++, QUEUE_FULL;
+  if (pool_limit && admitted >= pool_limit)
+    return info.statistics.rejected++, POOL_FULL;
+
+  info.statistics.admitted++;
+  admitted++;
+
+  job.pool = this;
+  job.queue = queue;
+  job.released = false;
+  job.admitted = chrono::steady_clock::now();
+  return ADMITTED;
+}
+
+void compute_pool::schedule(const shared_ptr<job>& job) {
+  {
+    unique_lock<mutex> lock(pool_mutex);
+    if (!job->pool || job->released || stopping) return;
+
+    job->scheduled = chrono::steady_clock::now();
+    queues[job->queue].jobs.push_back(job);
+    queues[job->queue].statistics.waiting++;
+  }
+  pool_cv.notify_one();
+}
+
+void compute_pool::release(job& job) {
+  unique_lock<mutex> lock(pool_mutex);
+  if (!job.pool || job.released) return;
+  job.released = true;
+
+  auto& statistics = queues[job.queue].statistics;
+  double latency = chrono::duration<double>(chrono::steady_clock::now() - job.admitted).count();
+  statistics.admitted--;
+  statistics.completed++;
+  statistics.latency_seconds += latency;
+  statistics.max_latency_seconds = max(statistics.max_latency_seconds, latency);
+  admitted--;
+}
+
+unsigned compute_pool::threads() const {
+  return workers.size();
+}
+
+void compute_pool::get_statistics(vector<queue_statistics>& statistics) {
+  unique_lock<mutex> lock(pool_mutex);
+  statistics.clear();
+  for (auto&& queue : queues)
+    statistics.push_back(queue.statistics);
+}
+
+void compute_pool::worker() {
+  unique_lock<mutex> lock(pool_mutex);
+  while (true) {
+    // Find the next nonempty queue in a round-robin fashion
+    unsigned queue = 0;
+    while (!stopping) {
+      for (queue = 0; queue < queues.size(); queue++)
+        if (!queues[(next_queue + queue) % queues.size()].jobs.empty())
+          break;
+      if (queue < queues.size()) break;
+      pool_cv.wait(lock);
+    }
+    if (stopping) return;
+
+    queue = (next_queue + queue) % queues.size();
+    next_queue = (queue + 1) % queues.size();
+
+    auto& info = queues[queue];
+    shared_ptr<job> job = move(info.jobs.front());
+    info.jobs.pop_front();
+    auto started = chrono::steady_clock::now();
+    info.statistics.waiting--;
+    info.statistics.running++;
+    info.statistics.wait_seconds += chrono::duration<double>(started - job->scheduled).count();
+
+    // Run the job without the lock
+    lock.unlock();
+    job->run();
+    auto finished = chrono::steady_clock::now();
+    job.reset();
+    lock.lock();
+
+    info.statistics.running--;
+    info.statistics.work_seconds += chrono::duration<double>(finished - started).count();
+  }
+}
+
+} // namespace udpipe
+} // namespace ufal
@@ -0,0 +1,82 @@
+// This file is part of UDPipe <http://github.com/ufal/udpipe/>.
+//
+// Copyright 2026 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "common.h"
+
+namespace ufal {
+namespace udpipe {
+
+// Pool of compute threads processing jobs from several bounded queues.
+//
+// A job is admitted to a queue first, which fails if the queue or the whole
+// pool is full. Then it is repeatedly scheduled, each time performing
+// a bounded piece of work, until it is released. The queues are served in
+// a round-robin fashion and a rescheduled job is appended to the end of its
+// queue, so that large jobs do not delay the small ones for long.
+class compute_pool {
+ public:
+  class job {
+   public:
+    virtual ~job();
+
+    // Perform a bounded piece of work.
+    virtual void run() = 0;
+
+   private:
+    friend class compute_pool;
+    compute_pool* pool = nullptr;
+    unsigned queue = 0;
+    bool released = false;
+    chrono::steady_clock::time_point admitted, scheduled;
+  };
+
+  enum admission { ADMITTED, QUEUE_FULL, POOL_FULL };
+
+  struct queue_statistics {
+    unsigned admitted, waiting, running;
+    size_t completed, rejected;
+    double wait_seconds, work_seconds, latency_seconds, max_latency_seconds;
+  };
+
+  compute_pool(unsigned threads, unsigned queues, unsigned queue_limit, unsigned pool_limit);
+  ~compute_pool();
+
+  admission admit(unsigned queue, job& job);
+  void schedule(const shared_ptr<job>& job);
+  void release(job& job);
+
+  unsigned threads() const;
+  void get_statistics(vector<queue_statistics>& statistics);
+
+ private:
+  void worker();
+
+  struct queue_info {
+    deque<shared_ptr<job>> jobs;
+    queue_statistics statistics;
+  };
+  vector<queue_info> queues;
+  unsigned queue_limit, pool_limit, admitted = 0, next_queue = 0;
+  bool stopping = false;
+
+  vector<thread> workers;
+  mutex pool_mutex;
+  condition_variable pool_cv;
+};
+
+} // namespace udpipe
+} // namespace ufal
@@ -32,6 +32,9 @@ class rest_request {
   virtual bool respond_method_not_allowed(const char* comma_separated_allowed_methods) = 0;
   virtual bool respond_error(string_piece error, int code = 400) = 0;
 
+  // Value of the given request header, or nullptr if it is not present.
+  virtual const char* header(const char* name) const = 0;
+
   std::string url;
   std::string method;
   std::string body;
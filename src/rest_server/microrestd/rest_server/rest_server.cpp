@@ -73,6 +73,7 @@ class rest_server::microhttpd_request : public rest_request {
   virtual bool respond_not_found() override;
   virtual bool respond_method_not_allowed(const char* comma_separated_allowed_methods) override;
   virtual bool respond_error(string_piece error, int code = 400) override;
+  virtual const char* header(const char* name) const override;
 
  private:
   const rest_server& server;
@@ -206,6 +207,10 @@ const char* rest_server::microhttpd_request::forwarded_for() const {
   return MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "X-Forwarded-For");
 }
 
+const char* rest_server::microhttpd_request::header(const char* name) const {
+  return MHD_lookup_connection_value(connection, MHD_HEADER_KIND, name);
+}
+
 bool rest_server::microhttpd_request::respond(const char* content_type, string_piece body,
                                               const std::vector<std::pair<const char*, const char*>>& headers) {
   unique_ptr<MHD_Response, MHD_ResponseDeleter> response(create_response(body, content_type, headers));
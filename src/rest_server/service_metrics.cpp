@@ -0,0 +1,177 @@
+// This file is part of UDPipe <http://github.com/ufal/udpipe/>.
+//
+// Copyright 2026 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+
+#include "service_metrics.h"
+
+namespace ufal {
+namespace udpipe {
+
+const char* service_metrics::stage_names[STAGES] = {"tokenize", "tag", "parse", "output"};
+const double service_metrics::bucket_bounds[BUCKETS - 1] = {
+  0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5,
+};
+
+void service_metrics::init(unsigned models) {
+  this->models = models;
+  for (auto&& shard : shards) {
+    shard.reset(new atomic_model_metrics[models]);
+    for (unsigned i = 0; i < models; i++) {
+      auto& model = shard[i];
+      model.requests.store(0);
+      for (int stage = 0; stage < STAGES; stage++) {
+        model.sentences[stage].store(0);
+        model.tokens[stage].store(0);
+      }
+      for (int histogram = 0; histogram <= STAGES; histogram++) {
+        auto& target = histogram < STAGES ? model.stages[histogram] : model.latency;
+        for (auto&& bucket : target.buckets)
+          bucket.store(0);
+        target.count.store(0);
+        target.sum_ns.store(0);
+      }
+    }
+  }
+
+  parser_caches.reset(new atomic_parser_cache_metrics[models]);
+  for (unsigned i = 0; i < models; i++)
+    parser_cache(i, parser_cache_metrics());
+}
+
+void service_metrics::request(unsigned model) {
+  if (model < models)
+    current_shard(model).requests.fetch_add(1, memory_order_relaxed);
+}
+
+void service_metrics::stage(unsigned model, stage_type stage, size_t tokens, double seconds) {
+  if (model >= models) return;
+
+  auto& metrics = current_shard(model);
+  metrics.sentences[stage].fetch_add(1, memory_order_relaxed);
+  metrics.tokens[stage].fetch_add(tokens, memory_order_relaxed);
+  observe(metrics.stages[stage], seconds);
+}
+
+void service_metrics::latency(unsigned model, double seconds) {
+  if (model < models)
+    observe(current_shard(model).latency, seconds);
+}
+
+void service_metrics::parser_cache(unsigned model, const parser_cache_metrics& cache) {
+  if (model >= models) return;
+
+  auto& target = parser_caches[model];
+  target.lookups.store(cache.lookups, memory_order_relaxed);
+  target.hits.store(cache.hits, memory_order_relaxed);
+  target.entries.store(cache.entries, memory_order_relaxed);
+  target.memory.store(cache.memory, memory_order_relaxed);
+  target.memory_limit.store(cache.memory_limit, memory_order_relaxed);
+}
+
+void service_metrics::get_metrics(vector<model_metrics>& metrics) const {
+  metrics.assign(models, model_metrics());
+  for (auto&& shard : shards)
+    for (unsigned i = 0; i < models; i++) {
+      auto& source = shard[i];
+      auto& target = metrics[i];
+
+      target.requests += source.requests.load(memory_order_relaxed);
+      for (int stage = 0; stage < STAGES; stage++) {
+        target.sentences[stage] += source.sentences[stage].load(memory_order_relaxed);
+        target.tokens[stage] += source.tokens[stage].load(memory_order_relaxed);
+      }
+      for (int histogram = 0; histogram <= STAGES; histogram++) {
+        auto& source_histogram = histogram < STAGES ? source.stages[histogram] : source.latency;
+        auto& target_histogram = histogram < STAGES ? target.stages[histogram] : target.latency;
+        for (int bucket = 0; bucket < BUCKETS; bucket++)
+          target_histogram.buckets[bucket] += source_histogram.buckets[bucket].load(memory_order_relaxed);
+        target_histogram.count += source_histogram.count.load(memory_order_relaxed);
+        target_histogram.sum += source_histogram.sum_ns.load(memory_order_relaxed) * 1e-9;
+      }
+    }
+
+  for (unsigned i = 0; i < models; i++) {
+    auto& source = parser_caches[i];
+    auto& target = metrics[i].parser_cache;
+    target.lookups = source.lookups.load(memory_order_relaxed);
+    target.hits = source.hits.load(memory_order_relaxed);
+    target.entries = source.entries.load(memory_order_relaxed);
+    target.memory = source.memory.load(memory_order_relaxed);
+    target.memory_limit = source.memory_limit.load(memory_order_relaxed);
+  }
+}
+
+service_metrics::atomic_model_metrics& service_metrics::current_shard(unsigned model) {
+  static atomic<unsigned> threads(0);
+  static thread_local unsigned thread_shard = threads.fetch_add(1, memory_order_relaxed) % SHARDS;
+  return shards[thread_shard][model];
+}
+
+void service_metrics::observe(atomic_histogram& histogram, double seconds) {
+  int bucket = lower_bound(bucket_bounds, bucket_bounds + BUCKETS - 1, seconds) - bucket_bounds;
+  histogram.buckets[bucket].fetch_add(1, memory_order_relaxed);
+  histogram.count.fetch_add(1, memory_order_relaxed);
+  histogram.sum_ns.fetch_add(uint64_t(seconds * 1e9), memory_order_relaxed);
+}
+
+service_metrics::prometheus_writer::prometheus_writer() {
+  os.precision(9);
+}
+
+void service_metrics::prometheus_writer::family(const char* name, const char* type, const char* help) {
+  os << "# HELP " << name << ' ' << help << "\n# TYPE " << name << ' ' << type << '\n';
+}
+
+void service_metrics::prometheus_writer::sample(const char* name, const char* suffix, const labels_type& labels, size_t value) {
+  sample_labels(name, suffix, labels);
+  os << ' ' << value << '\n';
+}
+
+void service_metrics::prometheus_writer::sample(const char* name, const char* suffix, const labels_type& labels, double value) {
+  sample_labels(name, suffix, labels);
+  os << ' ' << value << '\n';
+}
+
+void service_metrics::prometheus_writer::histogram(const char* name, labels_type labels, const service_metrics::histogram& histogram) {
+  size_t cumulative = 0;
+  labels.emplace_back("le", string());
+  for (int i = 0; i < BUCKETS; i++) {
+    ostringstream bound;
+    if (i + 1 < BUCKETS) bound << bucket_bounds[i]; else bound << "+Inf";
+    labels.back().second = bound.str();
+    sample(name, "_bucket", labels, cumulative += histogram.buckets[i]);
+  }
+  labels.pop_back();
+  sample(name, "_sum", labels, histogram.sum);
+  sample(name, "_count", labels, histogram.count);
+}
+
+string service_metrics::prometheus_writer::str() const {
+  return os.str();
+}
+
+void service_metrics::prometheus_writer::sample_labels(const char* name, const char* suffix, const labels_type& labels) {
+  os << name << suffix;
+  for (size_t i = 0; i < labels.size(); i++) {
+    os << (i ? ',' : '{') << labels[i].first << "=\"";
+    for (auto&& chr : labels[i].second)
+      if (chr == '\\') os << "\\\\";
+      else if (chr == '"') os << "\\\"";
+      else if (chr == '\n') os << "\\n";
+      else os << chr;
+    os << '"';
+  }
+  if (!labels.empty()) os << '}';
+}
+
+const char* service_metrics::prometheus_writer::mime = "text/plain; version=0.0.4";
+
+} // namespace udpipe
+} // namespace ufal
@@ -0,0 +1,102 @@
+// This file is part of UDPipe <http://github.com/ufal/udpipe/>.
+//
+// Copyright 2026 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <sstream>
+
+#include "common.h"
+
+namespace ufal {
+namespace udpipe {
+
+// Request and processing stage counters of every model, together with
+// histograms of the stage durations. The counters are sharded by threads,
+// so that they can be updated lock-free without contention, and summed
+// when the metrics are requested.
+class service_metrics {
+ public:
+  enum stage_type { TOKENIZE, TAG, PARSE, OUTPUT, STAGES };
+  enum { BUCKETS = 15 };
+
+  static const char* stage_names[STAGES];
+  static const double bucket_bounds[BUCKETS - 1];
+
+  struct histogram {
+    size_t buckets[BUCKETS];
+    size_t count;
+    double sum;
+  };
+  struct parser_cache_metrics {
+    size_t lookups, hits, entries, memory, memory_limit;
+  };
+  struct model_metrics {
+    size_t requests;
+    size_t sentences[STAGES], tokens[STAGES];
+    histogram stages[STAGES], latency;
+    parser_cache_metrics parser_cache;
+  };
+
+  void init(unsigned models);
+
+  void request(unsigned model);
+  void stage(unsigned model, stage_type stage, size_t tokens, double seconds);
+  void latency(unsigned model, double seconds);
+  // The parser embeddings cache statistics are snapshots of the loaded model.
+  void parser_cache(unsigned model, const parser_cache_metrics& cache);
+
+  void get_metrics(vector<model_metrics>& metrics) const;
+
+  // Writer of metrics in the Prometheus text format.
+  class prometheus_writer {
+   public:
+    typedef vector<pair<const char*, string>> labels_type;
+
+    prometheus_writer();
+
+    void family(const char* name, const char* type, const char* help);
+    void sample(const char* name, const char* suffix, const labels_type& labels, size_t value);
+    void sample(const char* name, const char* suffix, const labels_type& labels, double value);
+    void histogram(const char* name, labels_type labels, const histogram& histogram);
+    string str() const;
+
+    static const char* mime;
+
+   private:
+    void sample_labels(const char* name, const char* suffix, const labels_type& labels);
+    ostringstream os;
+  };
+
+ private:
+  struct atomic_histogram {
+    atomic<size_t> buckets[BUCKETS], count;
+    atomic<uint64_t> sum_ns;
+  };
+  struct atomic_model_metrics {
+    atomic<size_t> requests;
+    atomic<size_t> sentences[STAGES], tokens[STAGES];
+    atomic_histogram stages[STAGES], latency;
+  };
+  enum { SHARDS = 16 };
+  unique_ptr<atomic_model_metrics[]> shards[SHARDS];
+
+  struct atomic_parser_cache_metrics {
+    atomic<size_t> lookups, hits, entries, memory, memory_limit;
+  };
+  unique_ptr<atomic_parser_cache_metrics[]> parser_caches;
+  unsigned models = 0;
+
+  atomic_model_metrics& current_shard(unsigned model);
+  static void observe(atomic_histogram& histogram, double seconds);
+};
+
+} // namespace udpipe
+} // namespace ufal
@@ -7,8 +7,10 @@
 // License, v. 2.0. If a copy of the MPL was not distributed with this
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
+#include <algorithm>
 #include <fstream>
 #include <sstream>
+#include <thread>
 
 #include "common.h"
 #include "udpipe_service.h"
@@ -16,6 +18,7 @@
 #include "utils/options.h"
 #include "utils/parse_int.h"
 #include "utils/path_from_utf8.h"
+#include "utils/split.h"
 #include "version/version.h"
 
 using namespace ufal::udpipe;
@@ -62,30 +65,44 @@ int main(int argc, char* argv[]) {
   iostreams_init();
 
   options::map options;
-  if (!options::parse({{"concurrent_models", options::value::any},
+  if (!options::parse({{"compute_threads", options::value::any},
+                       {"concurrent_models", options::value::any},
                        {"connection_timeout", options::value::any},
                        {"daemon", options::value::none},
                        {"log_file", options::value::any},
                        {"log_request_max_size", options::value::any},
                        {"no_check_models_loadable",options::value::none},
                        {"no_preload_default",options::value::none},
+                       {"parser_embeddings_cache", options::value::any},
+                       {"pin_models", options::value::any},
+                       {"prefetch_models", options::value::none},
                        {"max_connections", options::value::any},
                        {"max_request_size", options::value::any},
+                       {"model_queue_limit", options::value::any},
+                       {"models_memory", options::value::any},
+                       {"queue_limit", options::value::any},
                        {"threads", options::value::any},
                        {"version", options::value::none},
                        {"help", options::value::none}}, argc, argv, options) ||
       options.count("help") ||
       ((argc < 3 || (argc % 3) != 0) && !options.count("version")))
     runtime_failure("Usage: " << argv[0] << " [options] port default_model_id (model_ids model_file acknowledgements)+\n"
-                    "Options: --concurrent_models=maximum concurrently loaded models (default 10)\n"
+                    "Options: --compute_threads=threads processing the requests (default CPU cores)\n"
+                    "         --concurrent_models=maximum concurrently loaded models (default 10)\n"
                     "         --connection_timeout=maximum connection timeout [s] (default 60)\n"
                     "         --daemon (daemonize after start)\n"
                     "         --log_file=file path (no logging if empty, default udpipe_server.log)\n"
                     "         --log_request_max_size=max req log size [kB] (0 unlimited, default 64)\n"
                     "         --max_connections=maximum network connections (default 256)\n"
                     "         --max_request_size=maximum request size [kB] (default 1024)\n"
+                    "         --model_queue_limit=maximum processed requests per model (default 64)\n"
+                    "         --models_memory=maximum memory of loaded models [MB] (default 0 unlimited)\n"
                     "         --no_check_models_loadable (do not check models are loadable)\n"
                     "         --no_preload_default (do not preload default model)\n"
+                    "         --parser_embeddings_cache=parser embeddings cache [MB] (default 1000 words per embedding)\n"
+                    "         --pin_models=colon-separated model ids never released once loaded\n"
+                    "         --prefetch_models (load frequently requested models in advance)\n"
+                    "         --queue_limit=maximum processed requests (default 256)\n"
                     "         --threads=threads to use (default 0 means unlimitted)\n"
                     "         --version\n"
                     "         --help");
@@ -99,11 +116,18 @@ int main(int argc, char* argv[]) {
   // Process options
   int port = parse_int(argv[1], "port number");
   service_options.default_model = argv[2];
+  service_options.compute_threads = options.count("compute_threads") ? parse_int(options["compute_threads"], "compute threads") : max(thread::hardware_concurrency(), 1U);
   service_options.concurrent_limit = options.count("concurrent_models") ? parse_int(options["concurrent_models"], "concurrent models") : 10;
   int connection_timeout = options.count("connection_timeout") ? parse_int(options["connection_timeout"], "connection timeout") : 60;
   int log_request_max_size = options.count("log_request_max_size") ? parse_int(options["log_request_max_size"], "log request maximum size") : 64;
   int max_connections = options.count("max_connections") ? parse_int(options["max_connections"], "maximum connections") : 256;
   int max_request_size = options.count("max_request_size") ? parse_int(options["max_request_size"], "maximum request size") : 1024;
+  service_options.model_queue_limit = options.count("model_queue_limit") ? parse_int(options["model_queue_limit"], "model queue limit") : 64;
+  service_options.queue_limit = options.count("queue_limit") ? parse_int(options["queue_limit"], "queue limit") : 256;
+  service_options.models_memory = size_t(options.count("models_memory") ? parse_int(options["models_memory"], "models memory") : 0) << 20;
+  service_options.parser_embeddings_cache = options.count("parser_embeddings_cache") ? parse_int(options["parser_embeddings_cache"], "parser embeddings cache") : parsito::parser::DEFAULT_CACHE;
+  if (options.count("pin_models")) split(options["pin_models"], ':', service_options.pinned_models);
+  service_options.prefetch_models = options.count("prefetch_models");
   service_options.check_models_loadable = !options.count("no_check_models_loadable");
   service_options.preload_default = !options.count("no_preload_default");
   int threads = options.count("threads") ? parse_int(options["threads"], "number of threads") : 0;
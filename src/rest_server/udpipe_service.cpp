@@ -16,6 +16,7 @@
 #include "unilib/utf8.h"
 #include "utils/path_from_utf8.h"
 #include "utils/split.h"
+#include "utils/utf8_ascii.h"
 
 namespace ufal {
 namespace udpipe {
@@ -32,6 +33,10 @@ bool udpipe_service::init(const service_options& options) {
     unique_ptr<ifstream> is(new ifstream(path_from_utf8(model_description.file).c_str(), ifstream::binary));
     if (!is->is_open()) return false;
 
+    // Estimate the model memory by the size of its file
+    if (!is->seekg(0, ifstream::end)) return false;
+    size_t memory = is->tellg();
+
     // Split the ids
     vector<string> ids;
     split(model_description.ids, ':', ids);
@@ -39,6 +44,8 @@ bool udpipe_service::init(const service_options& options) {
 
     // Store the model
     models.emplace_back(ids.front(), model_description.acknowledgements, (unsigned)models.size(), is.release());
+    models.back().memory = memory;
+    models.back().parser_embeddings_cache = options.parser_embeddings_cache;
 
     // Fail if this model id is aready in use.
     if (!models_map.emplace(ids.front(), &models.back()).second) return false;
@@ -61,9 +68,14 @@ bool udpipe_service::init(const service_options& options) {
   models_map[string()] = default_model;
 
   // Create model loader
-  loader.reset(new model_loader(options.concurrent_limit));
+  loader.reset(new model_loader(options.concurrent_limit, options.models_memory));
   for (auto&& model : models)
-    loader->add(&model);
+    loader->add(&model, model.memory);
+  for (auto&& id : options.pinned_models) {
+    auto model_it = models_map.find(id);
+    if (model_it == models_map.end()) return false;
+    loader->pin(model_it->second->loader_id);
+  }
 
   // Check that models are loadable if requested
   for (size_t i = 0; i < models.size(); i++)
@@ -73,7 +85,16 @@ bool udpipe_service::init(const service_options& options) {
       models[i].fill_capabilities();
       if (&models[i] != default_model || !options.preload_default) models[i].release();
     }
-  if (options.preload_default && !loader->load(default_model->loader_id)) return false;
+  if (options.preload_default) {
+    loader->pin(default_model->loader_id);
+    if (!loader->load(default_model->loader_id)) return false;
+    loader->release(default_model->loader_id);
+  }
+  if (options.prefetch_models) loader->start_prefetching();
+
+  // Create compute pool
+  pool.reset(new compute_pool(options.compute_threads, models.size(), options.model_queue_limit, options.queue_limit));
+  metrics.init(models.size());
 
   // Fill json_models
   json_models.clear().object().indent().key("models").indent().object();
@@ -94,6 +115,8 @@ unordered_map<string, bool (udpipe_service::*)(microrestd::rest_request&)> udpip
   // REST service
   {"/models", &udpipe_service::handle_models},
   {"/process", &udpipe_service::handle_process},
+  {"/metrics", &udpipe_service::handle_metrics},
+  {"/queues", &udpipe_service::handle_queues},
   // Weblicht service
   {"/weblicht/tokenize", &udpipe_service::handle_weblicht_tokenize},
   {"/weblicht/tag", &udpipe_service::handle_weblicht_tag},
@@ -118,6 +141,196 @@ udpipe_service::loaded_model* udpipe_service::load_model(const string& id, strin
   return new loaded_model(model_it->second, loader.get());
 }
 
+// Compute pool
+bool udpipe_service::admit_job(const string& id, compute_pool::job& job, string& error, int& code) {
+  auto model_it = models_map.find(id);
+  if (model_it == models_map.end())
+    return error.assign("Requested model '").append(id).append("' does not exist.\n"), code = 400, false;
+
+  switch (pool->admit(model_it->second->loader_id, job)) {
+    case compute_pool::ADMITTED:
+      return true;
+    case compute_pool::QUEUE_FULL:
+      return error.assign("Too many requests for model '").append(model_it->second->id).append("' are being processed, try again later.\n"), code = 429, false;
+    default:
+      return error.assign("The UDPipe server is overloaded, try again later.\n"), code = 503, false;
+  }
+}
+
+void udpipe_service::processing_job::start(loaded_model* loaded, input_format* input, string&& data, const string* tagger, const string* parser, output_format* output, bool prepare) {
+  this->loaded.reset(loaded);
+  this->input.reset(input);
+  this->data = move(data);
+  this->tag = tagger != nullptr;
+  this->tagger = tagger ? *tagger : string();
+  this->parse = parser != nullptr;
+  this->parser = parser ? *parser : string();
+  this->output.reset(output);
+  this->preparing = prepare;
+  this->prepared = !prepare;
+
+  this->input->set_text(this->data);
+  started = chrono::steady_clock::now();
+  metrics.request(this->loaded->model->loader_id);
+
+  unique_lock<mutex> lock(job_mutex);
+  scheduled = true;
+  pool.schedule(shared_from_this());
+}
+
+void udpipe_service::processing_job::run() {
+  {
+    unique_lock<mutex> lock(job_mutex);
+    if (cancelled) {
+      scheduled = false;
+      pool.release(*this);
+      return;
+    }
+  }
+
+  unsigned model = loaded->model->loader_id;
+  auto start = chrono::steady_clock::now();
+  size_t words = 0;
+  bool finished = false;
+  if (preparing) {
+    // Read the input, count the infclen and buffer the sentences
+    while (words < job_chunk_words && !finished)
+      if (input->next_sentence(s, error)) {
+        words += s.words.size() - 1;
+        metrics.stage(model, service_metrics::TOKENIZE, s.words.size() - 1, lap(start));
+        for (size_t i = 1; i < s.words.size(); i++)
+          infclen += utf8_ascii::length(s.words[i].form);
+        if (sentences_complete) {
+          sentences_size += sentence_memory(s);
+          if (sentences_size <= buffered_input_limit) {
+            sentences.push_back(move(s));
+          } else {
+            sentences_complete = false;
+            sentences.clear();
+            sentences.shrink_to_fit();
+          }
+        }
+      } else {
+        finished = true;
+      }
+
+    if (finished) {
+      if (!error.empty())
+        return finish_run(true);
+
+      // Unless all sentences are buffered, the input is read once again
+      if (sentences_complete) {
+        input.reset();
+      } else {
+        input->reset_document();
+        input->set_text(data);
+        reread = true;
+      }
+      preparing = false;
+      finished = false;
+
+      unique_lock<mutex> lock(job_mutex);
+      prepared = true;
+      job_cv.notify_all();
+    }
+  } else {
+    // Process the sentences and generate the output
+    while (words < job_chunk_words && !finished)
+      if (next_sentence()) {
+        words += s.words.size() - 1;
+        // The tokenization of the input read again has already been counted
+        if (input && !reread)
+          metrics.stage(model, service_metrics::TOKENIZE, s.words.size() - 1, lap(start));
+        else
+          lap(start);
+        if (tag) {
+          loaded->model->model->tag(s, tagger, error);
+          metrics.stage(model, service_metrics::TAG, s.words.size() - 1, lap(start));
+        }
+        if (parse) {
+          loaded->model->model->parse(s, parser, error);
+          metrics.stage(model, service_metrics::PARSE, s.words.size() - 1, lap(start));
+        }
+        output->write_sentence(s, chunk);
+        metrics.stage(model, service_metrics::OUTPUT, s.words.size() - 1, lap(start));
+      } else {
+        output->finish_document(chunk);
+        finished = true;
+      }
+
+    if (parse) {
+      parsito::parser::cache_statistics cache;
+      auto morphodita_parsito = dynamic_cast<const model_morphodita_parsito*>(loaded->model->model.get());
+      if (morphodita_parsito && morphodita_parsito->parser_cache_statistics(cache))
+        metrics.parser_cache(model, {cache.lookups, cache.hits, cache.entries, cache.memory, cache.memory_limit});
+    }
+  }
+
+  finish_run(finished);
+}
+
+void udpipe_service::processing_job::finish_run(bool finished) {
+  unique_lock<mutex> lock(job_mutex);
+  if (!chunk.empty()) {
+    if (produced.empty()) produced.swap(chunk); else produced.append(chunk);
+    chunk.clear();
+  }
+  this->finished = finished;
+  if (finished || cancelled) {
+    scheduled = false;
+    pool.release(*this);
+    if (finished) metrics.latency(loaded->model->loader_id, lap(started));
+  } else if (preparing || produced.size() < job_lookahead_size) {
+    pool.schedule(shared_from_this());
+  } else {
+    scheduled = false;
+  }
+  job_cv.notify_all();
+}
+
+double udpipe_service::processing_job::lap(chrono::steady_clock::time_point& start) {
+  auto now = chrono::steady_clock::now();
+  double seconds = chrono::duration<double>(now - start).count();
+  start = now;
+  return seconds;
+}
+
+bool udpipe_service::processing_job::next_sentence() {
+  if (input) return input->next_sentence(s, error);
+  if (sentences_index >= sentences.size()) return false;
+
+  s = move(sentences[sentences_index++]);
+  return true;
+}
+
+bool udpipe_service::processing_job::wait_prepared(size_t& infclen, string& error) {
+  unique_lock<mutex> lock(job_mutex);
+  job_cv.wait(lock, [this]{ return prepared || finished; });
+
+  infclen = this->infclen;
+  error = this->error;
+  return prepared;
+}
+
+bool udpipe_service::processing_job::next_output(string& output) {
+  unique_lock<mutex> lock(job_mutex);
+  if (!scheduled && !finished) {
+    scheduled = true;
+    pool.schedule(shared_from_this());
+  }
+  job_cv.wait(lock, [this]{ return !produced.empty() || finished; });
+
+  output.swap(produced);
+  produced.clear();
+  return !finished;
+}
+
+void udpipe_service::processing_job::cancel() {
+  unique_lock<mutex> lock(job_mutex);
+  cancelled = true;
+  if (!scheduled) pool.release(*this);
+}
+
 // REST service
 udpipe_service::rest_response_generator::rest_response_generator(const model_info* model) : model(model) {
   json.object();
@@ -134,7 +347,10 @@ bool udpipe_service::handle_models(microrestd::rest_request& req) {
 
 bool udpipe_service::handle_process(microrestd::rest_request& req) {
   string error;
+  int code;
   auto id = get_model_id(req);
+  shared_ptr<processing_job> job(new processing_job(*pool, metrics));
+  if (!admit_job(id, *job, error, code)) return req.respond_error(error, code);
   unique_ptr<loaded_model> loaded(load_model(id, error));
   if (!loaded) return req.respond_error(error);
 
@@ -145,67 +361,179 @@ bool udpipe_service::handle_process(microrestd::rest_request& req) {
   auto& parser = get_parser(req, loaded->model, error); if (!error.empty()) return req.respond_error(error);
   unique_ptr<output_format> output(get_output_format(req, error)); if (!output) return req.respond_error(error);
 
-  // Try loading the input and count the infclen header
-  int infclen = 0;
-  {
-    input->set_text(data);
-    sentence s;
-    while (input->next_sentence(s, error))
-      for (size_t i = 1; i < s.words.size(); i++) {
-        const char* str = s.words[i].form.c_str();
-        for (size_t len = s.words[i].form.size(); len; unilib::utf8::decode(str, len))
-          infclen++;
-      }
-    if (!error.empty())
-      return req.respond_error(error.insert(0, "Cannot read input data: ").append("\n"));
-
-    input->reset_document();
-  }
+  // Load the input and count the infclen header, and start the processing
+  size_t infclen;
+  job->start(loaded.release(), input.release(), move(data), tagger != "none" ? &tagger : nullptr,
+             parser != "none" ? &parser : nullptr, output.release(), true);
+  if (!job->wait_prepared(infclen, error))
+    return req.respond_error(error.insert(0, "Cannot read input data: ").append("\n"));
 
-  input->set_text(data, true);
   class generator : public rest_response_generator {
    public:
-    generator(loaded_model* loaded, input_format* input, const string& tagger, const string& parser, output_format* output)
-        : rest_response_generator(loaded->model), loaded(loaded), input(input), tagger(tagger), parser(parser), output(output) {}
+    generator(const shared_ptr<processing_job>& job) : rest_response_generator(job->model()), job(job) {}
+    ~generator() { job->cancel(); }
 
     bool generate() {
-      if (!input->next_sentence(s, error)) {
-        output->finish_document(os);
-        json.value(os.str(), true);
-        os.str(string());
+      bool more = job->next_output(output);
+      json.value(output, true);
+      if (!more) json.finish(true);
 
-        json.finish(true);
+      return more;
+    }
 
-        return false;
-      }
+   private:
+    shared_ptr<processing_job> job;
+    string output;
+  };
+  string infclen_value = to_string(infclen);
+  return respond_compressed(req, generator::mime, new generator(job), {{infclen_header, infclen_value.c_str()}});
+}
 
-      if (tagger != "none")
-        loaded->model->model->tag(s, tagger, error);
-      if (parser != "none")
-        loaded->model->model->parse(s, parser, error);
+bool udpipe_service::handle_queues(microrestd::rest_request& req) {
+  vector<compute_pool::queue_statistics> statistics;
+  pool->get_statistics(statistics);
+
+  microrestd::json_builder json;
+  json.object().indent().key("threads").indent().value(int(pool->threads()));
+  json.indent().key("models").indent().object();
+  for (auto&& model : models) {
+    auto& queue = statistics[model.loader_id];
+    json.indent().key(model.id).indent().object();
+    json.indent().key("admitted").indent().value(int(queue.admitted));
+    json.indent().key("waiting").indent().value(int(queue.waiting));
+    json.indent().key("running").indent().value(int(queue.running));
+    json.indent().key("completed").indent().value(int(queue.completed));
+    json.indent().key("rejected").indent().value(int(queue.rejected));
+    json.indent().key("wait_ms").indent().value(int(queue.wait_seconds * 1000));
+    json.indent().key("work_ms").indent().value(int(queue.work_seconds * 1000));
+    json.indent().key("mean_latency_ms").indent().value(queue.completed ? int(queue.latency_seconds * 1000 / queue.completed) : 0);
+    json.indent().key("max_latency_ms").indent().value(int(queue.max_latency_seconds * 1000));
+    json.indent().close();
+  }
+  json.indent().close().finish(true);
+  return req.respond(json.mime, json);
+}
 
-      output->write_sentence(s, os);
-      json.value(os.str(), true);
-      os.str(string());
+bool udpipe_service::handle_metrics(microrestd::rest_request& req) {
+  service_metrics::prometheus_writer out;
 
-      return true;
-    }
+  // Requests and processing stages
+  vector<service_metrics::model_metrics> model_metrics;
+  metrics.get_metrics(model_metrics);
 
-   private:
-    sentence s;
-    string error;
-    ostringstream os;
-    unique_ptr<loaded_model> loaded;
-    unique_ptr<input_format> input;
-    const string& tagger;
-    const string& parser;
-    unique_ptr<output_format> output;
-  };
-  return req.respond(generator::mime, new generator(loaded.release(), input.release(), tagger, parser, output.release()), {{infclen_header, to_string(infclen).c_str()}});
+  out.family("udpipe_requests_total", "counter", "Number of requests processed by a model.");
+  for (auto&& model : models)
+    out.sample("udpipe_requests_total", "", {{"model", model.id}}, model_metrics[model.loader_id].requests);
+  out.family("udpipe_request_duration_seconds", "histogram", "Duration of request processing, including queueing.");
+  for (auto&& model : models)
+    out.histogram("udpipe_request_duration_seconds", {{"model", model.id}}, model_metrics[model.loader_id].latency);
+  out.family("udpipe_sentences_total", "counter", "Number of sentences processed by a model stage.");
+  for (auto&& model : models)
+    for (int stage = 0; stage < service_metrics::STAGES; stage++)
+      out.sample("udpipe_sentences_total", "", {{"model", model.id}, {"stage", service_metrics::stage_names[stage]}}, model_metrics[model.loader_id].sentences[stage]);
+  out.family("udpipe_tokens_total", "counter", "Number of tokens processed by a model stage.");
+  for (auto&& model : models)
+    for (int stage = 0; stage < service_metrics::STAGES; stage++)
+      out.sample("udpipe_tokens_total", "", {{"model", model.id}, {"stage", service_metrics::stage_names[stage]}}, model_metrics[model.loader_id].tokens[stage]);
+  out.family("udpipe_stage_duration_seconds", "histogram", "Duration of processing a sentence by a model stage.");
+  for (auto&& model : models)
+    for (int stage = 0; stage < service_metrics::STAGES; stage++)
+      out.histogram("udpipe_stage_duration_seconds", {{"model", model.id}, {"stage", service_metrics::stage_names[stage]}}, model_metrics[model.loader_id].stages[stage]);
+
+  out.family("udpipe_parser_embeddings_cache_lookups_total", "counter", "Number of parser embeddings cache lookups since the model was loaded.");
+  for (auto&& model : models)
+    out.sample("udpipe_parser_embeddings_cache_lookups_total", "", {{"model", model.id}}, model_metrics[model.loader_id].parser_cache.lookups);
+  out.family("udpipe_parser_embeddings_cache_hits_total", "counter", "Number of parser embeddings cache hits since the model was loaded.");
+  for (auto&& model : models)
+    out.sample("udpipe_parser_embeddings_cache_hits_total", "", {{"model", model.id}}, model_metrics[model.loader_id].parser_cache.hits);
+  out.family("udpipe_parser_embeddings_cache_entries", "gauge", "Number of cached parser embeddings.");
+  for (auto&& model : models)
+    out.sample("udpipe_parser_embeddings_cache_entries", "", {{"model", model.id}}, model_metrics[model.loader_id].parser_cache.entries);
+  out.family("udpipe_parser_embeddings_cache_memory_bytes", "gauge", "Memory used by the parser embeddings cache.");
+  for (auto&& model : models)
+    out.sample("udpipe_parser_embeddings_cache_memory_bytes", "", {{"model", model.id}}, model_metrics[model.loader_id].parser_cache.memory);
+  out.family("udpipe_parser_embeddings_cache_memory_limit_bytes", "gauge", "Memory limit of the parser embeddings cache.");
+  for (auto&& model : models)
+    out.sample("udpipe_parser_embeddings_cache_memory_limit_bytes", "", {{"model", model.id}}, model_metrics[model.loader_id].parser_cache.memory_limit);
+
+  // Compute pool queues
+  vector<compute_pool::queue_statistics> queues;
+  pool->get_statistics(queues);
+
+  out.family("udpipe_compute_threads", "gauge", "Number of compute threads.");
+  out.sample("udpipe_compute_threads", "", {}, size_t(pool->threads()));
+  out.family("udpipe_queue_requests", "gauge", "Number of admitted requests of a model, and how many of them are waiting and running.");
+  for (auto&& model : models) {
+    out.sample("udpipe_queue_requests", "", {{"model", model.id}, {"state", "admitted"}}, size_t(queues[model.loader_id].admitted));
+    out.sample("udpipe_queue_requests", "", {{"model", model.id}, {"state", "waiting"}}, size_t(queues[model.loader_id].waiting));
+    out.sample("udpipe_queue_requests", "", {{"model", model.id}, {"state", "running"}}, size_t(queues[model.loader_id].running));
+  }
+  out.family("udpipe_queue_rejected_total", "counter", "Number of requests rejected because of full queues.");
+  for (auto&& model : models)
+    out.sample("udpipe_queue_rejected_total", "", {{"model", model.id}}, queues[model.loader_id].rejected);
+  out.family("udpipe_queue_wait_seconds_total", "counter", "Total time the requests waited in a queue for a compute thread.");
+  for (auto&& model : models)
+    out.sample("udpipe_queue_wait_seconds_total", "", {{"model", model.id}}, queues[model.loader_id].wait_seconds);
+  out.family("udpipe_queue_work_seconds_total", "counter", "Total time the compute threads processed the requests.");
+  for (auto&& model : models)
+    out.sample("udpipe_queue_work_seconds_total", "", {{"model", model.id}}, queues[model.loader_id].work_seconds);
+
+  // Model loader
+  model_loader::statistics loader_statistics;
+  vector<model_loader::resource_statistics> loader_models;
+  loader->get_statistics(loader_statistics, &loader_models);
+
+  out.family("udpipe_models_limit", "gauge", "Maximum number of concurrently loaded models.");
+  out.sample("udpipe_models_limit", "", {}, size_t(loader_statistics.concurrent_limit));
+  out.family("udpipe_models_loaded", "gauge", "Number of loaded models.");
+  out.sample("udpipe_models_loaded", "", {}, size_t(loader_statistics.loaded));
+  out.family("udpipe_models_used", "gauge", "Number of models used by requests.");
+  out.sample("udpipe_models_used", "", {}, size_t(loader_statistics.used));
+  out.family("udpipe_models_memory_bytes", "gauge", "Estimated memory of the loaded models.");
+  out.sample("udpipe_models_memory_bytes", "", {}, loader_statistics.memory);
+  out.family("udpipe_models_memory_limit_bytes", "gauge", "Memory limit of the loaded models, zero if unlimited.");
+  out.sample("udpipe_models_memory_limit_bytes", "", {}, loader_statistics.memory_limit);
+  out.family("udpipe_model_loaded", "gauge", "Whether a model is loaded.");
+  for (auto&& model : models)
+    out.sample("udpipe_model_loaded", "", {{"model", model.id}}, size_t(loader_models[model.loader_id].loaded));
+  out.family("udpipe_model_loads_total", "counter", "Number of model loads.");
+  for (auto&& model : models)
+    out.sample("udpipe_model_loads_total", "", {{"model", model.id}}, loader_models[model.loader_id].loads);
+  out.family("udpipe_model_evictions_total", "counter", "Number of model evictions.");
+  for (auto&& model : models)
+    out.sample("udpipe_model_evictions_total", "", {{"model", model.id}}, loader_models[model.loader_id].evictions);
+  out.family("udpipe_model_pinned", "gauge", "Whether a model is pinned.");
+  for (auto&& model : models)
+    out.sample("udpipe_model_pinned", "", {{"model", model.id}}, size_t(loader_models[model.loader_id].pinned));
+  out.family("udpipe_model_prefetches_total", "counter", "Number of models loaded in advance by prefetching.");
+  out.sample("udpipe_model_prefetches_total", "", {}, loader_statistics.prefetches);
+  out.family("udpipe_model_load_failures_total", "counter", "Number of failed model loads.");
+  out.sample("udpipe_model_load_failures_total", "", {}, loader_statistics.load_failures);
+  out.family("udpipe_model_load_seconds_total", "counter", "Total time spent loading models.");
+  out.sample("udpipe_model_load_seconds_total", "", {}, loader_statistics.load_seconds);
+  out.family("udpipe_model_waits_total", "counter", "Number of requests waiting for a model to be loaded.");
+  out.sample("udpipe_model_waits_total", "", {}, loader_statistics.waits);
+  out.family("udpipe_model_saturated_waits_total", "counter", "Number of requests waiting because the limit of loaded models was reached.");
+  out.sample("udpipe_model_saturated_waits_total", "", {}, loader_statistics.saturated_waits);
+  out.family("udpipe_model_wait_seconds_total", "counter", "Total time requests waited for a model to be loaded.");
+  out.sample("udpipe_model_wait_seconds_total", "", {}, loader_statistics.wait_seconds);
+
+  string body = out.str();
+  return req.respond(service_metrics::prometheus_writer::mime, body);
 }
 
 // Weblicht service
-udpipe_service::weblicht_response_generator::weblicht_response_generator(const model_info* model) : model(model) {}
+udpipe_service::weblicht_response_generator::weblicht_response_generator(const shared_ptr<processing_job>& job) : job(job) {}
+
+udpipe_service::weblicht_response_generator::~weblicht_response_generator() {
+  job->cancel();
+}
+
+bool udpipe_service::weblicht_response_generator::generate() {
+  bool more = job->next_output(output);
+  if (data.empty()) data.swap(output); else data.append(output);
+  return more;
+}
 
 microrestd::string_piece udpipe_service::weblicht_response_generator::current() const {
   return microrestd::string_piece(data.data(), data.size());
@@ -215,57 +543,27 @@ void udpipe_service::weblicht_response_generator::consume(size_t length) {
   data.erase(0, length);
 }
 
-void udpipe_service::weblicht_response_generator::append(const string& data) {
-  this->data.append(data.begin(), data.end());
-}
-
 const char* udpipe_service::weblicht_response_generator::mime = "application/conllu";
 
 bool udpipe_service::handle_weblicht_tokenize(microrestd::rest_request& req) {
   string error;
+  int code;
   auto id = get_model_id(req);
+  shared_ptr<processing_job> job(new processing_job(*pool, metrics));
+  if (!admit_job(id, *job, error, code)) return req.respond_error(error, code);
   unique_ptr<loaded_model> loaded(load_model(id, error));
   if (!loaded) return req.respond_error(error);
 
-  unique_ptr<input_format> tokenizer(loaded->model->model->new_tokenizer(req.params["tokenizer"]));
+  unique_ptr<input_format> tokenizer(new_tokenizer(loaded->model, req.params["tokenizer"]));
   if (!tokenizer) return req.respond_error("Cannot create a tokenizer for a given model");
   unique_ptr<output_format> output(output_format::new_conllu_output_format());
   if (!output) return req.respond_error("Cannot create CoNLL-U output format");
 
-  tokenizer->set_text(req.body);
-
-  class generator : public weblicht_response_generator {
-   public:
-    generator(loaded_model* loaded, input_format* tokenizer, const string* tagger, const string* parser, output_format* output)
-        : weblicht_response_generator(loaded->model), loaded(loaded), tokenizer(tokenizer), tagger(tagger), parser(parser), output(output) {}
-
-    bool generate() {
-      if (!tokenizer->next_sentence(s, error)) {
-        output->finish_document(os); append(os.str()); os.str(string());
-        return false;
-      }
-
-      if (tagger) model->model->tag(s, *tagger, error);
-      if (parser) model->model->parse(s, *parser, error);
-
-      output->write_sentence(s, os); append(os.str()); os.str(string());
-      return true;
-    }
-
-   private:
-    sentence s;
-    string error;
-    ostringstream os;
-    unique_ptr<loaded_model> loaded;
-    unique_ptr<input_format> tokenizer;
-    const string* tagger;
-    const string* parser;
-    unique_ptr<output_format> output;
-  };
-
   const string* tagger = (req.params.end() != req.params.find("tagger")) ?  &req.params["tagger"] : nullptr;
   const string* parser = (req.params.end() != req.params.find("parser")) ?  &req.params["parser"] : nullptr;
-  return req.respond(generator::mime, new generator(loaded.release(), tokenizer.release(), tagger, parser, output.release()));
+  job->start(loaded.release(), tokenizer.release(), string(req.body), tagger, parser, output.release(), false);
+
+  return respond_compressed(req, weblicht_response_generator::mime, new weblicht_response_generator(job));
 }
 
 bool udpipe_service::handle_weblicht_tag(microrestd::rest_request& req) {
@@ -278,7 +576,10 @@ bool udpipe_service::handle_weblicht_parse(microrestd::rest_request& req) {
 
 bool udpipe_service::handle_weblicht_tag_parse(microrestd::rest_request& req, const string* tagger, const string* parser) {
   string error;
+  int code;
   auto id = get_model_id(req);
+  shared_ptr<processing_job> job(new processing_job(*pool, metrics));
+  if (!admit_job(id, *job, error, code)) return req.respond_error(error, code);
   unique_ptr<loaded_model> loaded(load_model(id, error));
   if (!loaded) return req.respond_error(error);
 
@@ -287,46 +588,16 @@ bool udpipe_service::handle_weblicht_tag_parse(microrestd::rest_request& req, co
   unique_ptr<output_format> output(output_format::new_conllu_output_format());
   if (!output) return req.respond_error("Cannot create CoNLL-U output format");
 
-  // Try loading the input CoNLL-U file
-  input->set_text(req.body);
-  sentence s;
-  while (input->next_sentence(s, error)) {}
-  if (!error.empty())
+  // Try loading the input CoNLL-U file and start the processing
+  size_t infclen;
+  job->start(loaded.release(), input.release(), string(req.body), tagger, parser, output.release(), true);
+  if (!job->wait_prepared(infclen, error))
     return req.respond_error(error.insert(0, "Cannot read input CoNLL-U file: ").append("\n"));
 
-  input->reset_document();
-  input->set_text(req.body);
-  class generator : public weblicht_response_generator {
-   public:
-    generator(loaded_model* loaded, const string* tagger, const string* parser, input_format* input, output_format* output)
-        : weblicht_response_generator(loaded->model), loaded(loaded), tagger(tagger), parser(parser), input(input), output(output) {}
-
-    bool generate() {
-      if (!input->next_sentence(s, error)) {
-        output->finish_document(os); append(os.str()); os.str(string());
-        return false;
-      }
-
-      if (tagger) model->model->tag(s, *tagger, error);
-      if (parser) model->model->parse(s, *parser, error);
-
-      output->write_sentence(s, os); append(os.str()); os.str(string());
-      return true;
-    }
-
-   private:
-    sentence s;
-    string error;
-    ostringstream os;
-    unique_ptr<loaded_model> loaded;
-    const string* tagger;
-    const string* parser;
-    unique_ptr<input_format> input;
-    unique_ptr<output_format> output;
-  };
-  return req.respond(generator::mime, new generator(loaded.release(), tagger, parser, input.release(), output.release()));
+  return respond_compressed(req, weblicht_response_generator::mime, new weblicht_response_generator(job));
 }
 
+
 // Helper functions
 const string& udpipe_service::get_model_id(microrestd::rest_request& req) {
   auto model_it = req.params.find("model");
@@ -348,17 +619,24 @@ input_format* udpipe_service::get_input_format(microrestd::rest_request& req, co
   auto tokenizer_it = req.params.find("tokenizer");
   if (tokenizer_it != req.params.end()) {
     if (!model->can_tokenize) return error.assign("The required model does not contain a tokenizer!"), nullptr;
-    input_format* tokenizer = model->model->new_tokenizer(tokenizer_it->second);
+    input_format* tokenizer = new_tokenizer(model, tokenizer_it->second);
     if (!tokenizer) return error.assign("Cannot construct a tokenizer instance!"), nullptr;
     return is_tokenizer = true, tokenizer;
   }
 
   auto& input = req.params.emplace("input", "conllu").first->second;
+  if (input.compare(0, 6, "binary") == 0) return error.assign("The binary input format is not supported by the REST server.\n"), nullptr;
   auto input_format = input_format::new_input_format(input);
   if (!input_format) return error.assign("Unknown input format '").append(input).append("'.\n"), nullptr;
   return is_tokenizer = false, input_format;
 }
 
+input_format* udpipe_service::new_tokenizer(const model_info* model, const string& options) {
+  // The requests are processed by the compute threads, so the tokenizer
+  // must not start additional threads; the last value of an option is used.
+  return model->model->new_tokenizer(options + ";threads=1");
+}
+
 const string& udpipe_service::get_tagger(microrestd::rest_request& req, const model_info* model, string& error) {
   auto& tagger = req.params.emplace("tagger", "none").first->second;
   if (tagger != "none" && !model->can_tag) return error.assign("The required model does not contain a tagger!"), empty;
@@ -373,13 +651,42 @@ const string& udpipe_service::get_parser(microrestd::rest_request& req, const mo
 
 output_format* udpipe_service::get_output_format(microrestd::rest_request& req, string& error) {
   auto& output = req.params.emplace("output", "conllu").first->second;
+  if (output.compare(0, 6, "binary") == 0) return error.assign("The binary output format is not supported by the REST server.\n"), nullptr;
   auto output_format = output_format::new_output_format(output);
   if (!output_format) return error.assign("Unknown output format '").append(output).append("'.\n"), nullptr;
   return output_format;
 }
 
+size_t udpipe_service::sentence_memory(const sentence& s) {
+  size_t memory = sizeof(sentence);
+  for (auto&& word : s.words)
+    memory += sizeof(word) + word.form.size() + word.lemma.size() + word.upostag.size() + word.xpostag.size() + word.feats.size() +
+        word.deprel.size() + word.deps.size() + word.misc.size() + word.children.size() * sizeof(int);
+  for (auto&& multiword_token : s.multiword_tokens)
+    memory += sizeof(multiword_token) + multiword_token.form.size() + multiword_token.feats.size() + multiword_token.misc.size();
+  for (auto&& empty_node : s.empty_nodes)
+    memory += sizeof(empty_node) + empty_node.form.size() + empty_node.lemma.size() + empty_node.deps.size() + empty_node.misc.size();
+  for (auto&& comment : s.comments)
+    memory += sizeof(comment) + comment.size();
+  return memory;
+}
+
+bool udpipe_service::respond_compressed(microrestd::rest_request& req, const char* content_type, microrestd::response_generator* generator,
+                                        vector<pair<const char*, const char*>> headers) {
+  compressed_response_generator::format_t format;
+  if (compressed_response_generator::accepted_format(req.header("Accept-Encoding"), format)) {
+    generator = new compressed_response_generator(generator, format);
+    headers.emplace_back("Content-Encoding", compressed_response_generator::content_encoding(format));
+    headers.emplace_back("Vary", "Accept-Encoding");
+  }
+  return req.respond(content_type, generator, headers);
+}
+
 const string udpipe_service::empty;
 const char* udpipe_service::infclen_header = "X-Billing-Input-NFC-Len";
+const size_t udpipe_service::buffered_input_limit = 64 << 20;
+const size_t udpipe_service::job_chunk_words = 1 << 10;
+const size_t udpipe_service::job_lookahead_size = 64 << 10;
 
 } // namespace udpipe
 } // namespace ufal
@@ -9,11 +9,19 @@
 
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
 #include <unordered_map>
 
 #include "common.h"
+#include "compressed_response_generator.h"
+#include "compute_pool.h"
+#include "service_metrics.h"
 #include "microrestd/microrestd.h"
 #include "model/model.h"
+#include "model/model_morphodita_parsito.h"
 #include "sentence/input_format.h"
 #include "sentence/output_format.h"
 #include "utils/threadsafe_resource_loader.h"
@@ -38,8 +46,15 @@ class udpipe_service : public microrestd::rest_service {
     vector<model_description> model_descriptions;
     string default_model;
     unsigned concurrent_limit;
+    size_t models_memory;
+    vector<string> pinned_models;
+    bool prefetch_models;
     bool preload_default;
     bool check_models_loadable;
+    unsigned compute_threads;
+    unsigned model_queue_limit;
+    unsigned queue_limit;
+    unsigned parser_embeddings_cache;
   };
 
   bool init(const service_options& options);
@@ -58,6 +73,8 @@ class udpipe_service : public microrestd::rest_service {
       if (!model) {
         is->seekg(0);
         model.reset(Model::load(*is));
+        if (auto morphodita_parsito = dynamic_cast<model_morphodita_parsito*>(model.get()))
+          morphodita_parsito->set_parser_cache_size(parser_embeddings_cache);
       }
       return model != nullptr;
     }
@@ -83,6 +100,8 @@ class udpipe_service : public microrestd::rest_service {
     unsigned loader_id;
     unique_ptr<istream> is;
     unique_ptr<Model> model;
+    size_t memory = 0;
+    unsigned parser_embeddings_cache = parsito::parser::DEFAULT_CACHE;
     bool can_tokenize = true;
     bool can_tag = true;
     bool can_parse = true;
@@ -102,6 +121,58 @@ class udpipe_service : public microrestd::rest_service {
   };
   loaded_model* load_model(const string& id, string& error);
 
+  // Compute pool and metrics
+  unique_ptr<compute_pool> pool;
+  service_metrics metrics;
+
+  // Processing of the input by the compute pool, with the output collected
+  // by the response generators. When prepare is requested, the whole input
+  // is read first, counting its infclen and buffering the sentences.
+  class processing_job : public compute_pool::job, public enable_shared_from_this<processing_job> {
+   public:
+    processing_job(compute_pool& pool, service_metrics& metrics) : pool(pool), metrics(metrics) {}
+
+    void start(loaded_model* loaded, input_format* input, string&& data, const string* tagger, const string* parser, output_format* output, bool prepare);
+    virtual void run() override;
+
+    bool wait_prepared(size_t& infclen, string& error);
+    bool next_output(string& output);
+    void cancel();
+
+    const model_info* model() const { return loaded->model; }
+
+   private:
+    bool next_sentence();
+    void finish_run(bool finished);
+    static double lap(chrono::steady_clock::time_point& start);
+
+    compute_pool& pool;
+    service_metrics& metrics;
+    chrono::steady_clock::time_point started;
+    unique_ptr<loaded_model> loaded;
+    unique_ptr<input_format> input;
+    string data;
+    bool tag = false, parse = false;
+    string tagger, parser;
+    unique_ptr<output_format> output;
+
+    bool preparing = false;
+    size_t infclen = 0;
+    vector<sentence> sentences;
+    size_t sentences_index = 0, sentences_size = 0;
+    bool sentences_complete = true, reread = false;
+
+    sentence s;
+    string error;
+    string chunk;
+
+    mutex job_mutex;
+    condition_variable job_cv;
+    string produced;
+    bool scheduled = false, cancelled = false, prepared = false, finished = false;
+  };
+  bool admit_job(const string& id, compute_pool::job& job, string& error, int& code);
+
   // REST service
   class rest_response_generator : public microrestd::json_response_generator {
    public:
@@ -112,19 +183,22 @@ class udpipe_service : public microrestd::rest_service {
 
   bool handle_models(microrestd::rest_request& req);
   bool handle_process(microrestd::rest_request& req);
+  bool handle_queues(microrestd::rest_request& req);
+  bool handle_metrics(microrestd::rest_request& req);
 
   // Weblicht service
   class weblicht_response_generator : public microrestd::response_generator {
    public:
-    weblicht_response_generator(const model_info* model);
+    weblicht_response_generator(const shared_ptr<processing_job>& job);
+    virtual ~weblicht_response_generator() override;
+    virtual bool generate() override;
     virtual microrestd::string_piece current() const override;
     virtual void consume(size_t length) override;
-    void append(const string& data);
 
     static const char* mime;
    protected:
-    string data;
-    const model_info* model;
+    string data, output;
+    shared_ptr<processing_job> job;
   };
 
   bool handle_weblicht_tokenize(microrestd::rest_request& req);
@@ -136,14 +210,21 @@ class udpipe_service : public microrestd::rest_service {
   const string& get_model_id(microrestd::rest_request& req);
   bool get_data(microrestd::rest_request& req, string& data, string& error);
   input_format* get_input_format(microrestd::rest_request& req, const model_info* model, bool& is_tokenizer, string& error);
+  static input_format* new_tokenizer(const model_info* model, const string& options);
   const string& get_tagger(microrestd::rest_request& req, const model_info* model, string& error);
   const string& get_parser(microrestd::rest_request& req, const model_info* model, string& error);
   output_format* get_output_format(microrestd::rest_request& req, string& error);
+  static size_t sentence_memory(const sentence& s);
+  static bool respond_compressed(microrestd::rest_request& req, const char* content_type, microrestd::response_generator* generator,
+                                 vector<pair<const char*, const char*>> headers = {});
 
   microrestd::json_builder json_models;
 
   static const string empty;
   static const char* infclen_header;
+  static const size_t buffered_input_limit;
+  static const size_t job_chunk_words;
+  static const size_t job_lookahead_size;
 };
 
 } // namespace udpipe
@@ -0,0 +1,73 @@
+// This file is part of UDPipe <http://github.com/ufal/udpipe/>.
+//
+// Copyright 2026 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include "common.h"
+#include "utils/string_piece.h"
+
+namespace ufal {
+namespace udpipe {
+
+// Shared definitions of the binary input and output formats.
+//
+// The binary format is a sequence of records, each consisting of a varint
+// payload length, the payload itself and a final '\n' byte, which keeps
+// the data intact when read line by line and allows skipping records
+// without decoding them. A payload starts with its type:
+// - HEADER, followed by the version() string, starts every document;
+// - SENTENCE is followed by a varint count and the strings (each a varint
+//   length and the bytes) of a sentence string table, the empty string
+//   being implicitly its zeroth entry,
+//   and then the sentence itself, with all strings stored as varint
+//   indices to the string table:
+//   - varint count and strings of comments,
+//   - varint count of non-root words and for every of them its form, lemma,
+//     upostag, xpostag, feats, varint head + 1, deprel, deps and misc,
+//   - varint count of multiword tokens and for every of them varint id_first,
+//     varint id_last - id_first, form, misc and feats,
+//   - varint count of empty nodes and for every of them varint id, varint
+//     index, form, lemma, upostag, xpostag, feats, deps and misc.
+class binary_format {
+ public:
+  enum { HEADER = 'H', SENTENCE = 'S' };
+  enum { MAX_VARINT_LENGTH = (8 * sizeof(size_t) + 6) / 7 };
+  static string_piece version() { return "UDPipe binary 1"; }
+
+  static inline size_t varint_length(size_t value) {
+    size_t length = 1;
+    for (; value >= 0x80; value >>= 7) length++;
+    return length;
+  }
+
+  static inline void append_varint(string& output, size_t value) {
+    for (; value >= 0x80; value >>= 7)
+      output.push_back(char((value & 0x7F) | 0x80));
+    output.push_back(char(value));
+  }
+
+  static inline void write_varint(char*& output, size_t value) {
+    for (; value >= 0x80; value >>= 7)
+      *output++ = char((value & 0x7F) | 0x80);
+    *output++ = char(value);
+  }
+
+  static inline bool read_varint(string_piece& data, size_t& value) {
+    value = 0;
+    for (unsigned shift = 0; data.len && shift < 64; shift += 7) {
+      unsigned char byte = *data.str++; data.len--;
+      value |= size_t(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) return true;
+    }
+    return false;
+  }
+};
+
+} // namespace udpipe
+} // namespace ufal
@@ -7,12 +7,14 @@
 // License, v. 2.0. If a copy of the MPL was not distributed with this
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
+#include "binary_format.h"
 #include "input_format.h"
 #include "tokenizer/morphodita_tokenizer_wrapper.h"
 #include "utils/getpara.h"
 #include "utils/named_values.h"
 #include "utils/parse_int.h"
 #include "utils/split.h"
+#include "word_recycler.h"
 
 namespace ufal {
 namespace udpipe {
@@ -37,6 +39,10 @@ class input_format_conllu : public input_format {
   unsigned version;
   string_piece text;
   string text_copy;
+  word_recycler recycler;
+
+  static bool parse_id(string_piece str, const char* value_name, int& value, string& error);
+  static bool split_id(string_piece id, char separator, string_piece (&parts)[2]);
 
   static const string columns[10];
 };
@@ -62,20 +68,18 @@ void input_format_conllu::set_text(string_piece text, bool make_copy) {
 
 bool input_format_conllu::next_sentence(sentence& s, string& error) {
   error.clear();
-  s.clear();
+
+  recycler.clear(s);
+
   int last_multiword_token = 0;
 
-  vector<string_piece> tokens, parts;
+  string_piece tokens[10], parts[2];
   while (text.len) {
     // Read line
-    string_piece line(text.str, 0);
-    while (line.len < text.len && (line.str[line.len] != '\r' && line.str[line.len] != '\n')) line.len++;
-
-    text.str += line.len, text.len -= line.len;
-    if (text.len >= 2 && text.str[0] == '\r' && text.str[1] == '\n')
-      text.str += 2, text.len -= 2;
-    else if (text.len && *text.str == '\n')
-      text.str++, text.len--;
+    auto newline = (const char*) memchr(text.str, '\n', text.len);
+    string_piece line(text.str, newline ? newline - text.str : text.len);
+    text.str += line.len + (newline ? 1 : 0), text.len -= line.len + (newline ? 1 : 0);
+    if (line.len && line.str[line.len - 1] == '\r') line.len--;
 
     // Empty lines denote end of tree, unless at the beginning
     if (!line.len) {
@@ -90,8 +94,14 @@ bool input_format_conllu::next_sentence(sentence& s, string& error) {
     }
 
     // Parse the line
-    split(line, '\t', tokens);
-    if (tokens.size() != 10)
+    unsigned columns_count = 0;
+    for (const char* column = line.str, *line_end = line.str + line.len; ; columns_count++) {
+      auto tab = (const char*) memchr(column, '\t', line_end - column);
+      if (columns_count < 10) tokens[columns_count] = string_piece(column, (tab ? tab : line_end) - column);
+      if (!tab) { columns_count++; break; }
+      column = tab + 1;
+    }
+    if (columns_count != 10)
       return error.assign("The CoNLL-U line '").append(line.str, line.len).append("' does not contain 10 columns!") , false;
 
     // Check that no column is empty and contains no spaces (except FORM, LEMMA and MISC in version >= 2)
@@ -104,11 +114,10 @@ bool input_format_conllu::next_sentence(sentence& s, string& error) {
 
     // Handle multiword tokens
     if (memchr(tokens[0].str, '-', tokens[0].len)) {
-      split(tokens[0], '-', parts);
-      if (parts.size() != 2)
+      if (!split_id(tokens[0], '-', parts))
         return error.assign("Cannot parse ID of multiword token '").append(line.str, line.len).append("'!") , false;
       int from, to;
-      if (!parse_int(parts[0], "CoNLL-U id", from, error) || !parse_int(parts[1], "CoNLL-U id", to, error))
+      if (!parse_id(parts[0], "CoNLL-U id", from, error) || !parse_id(parts[1], "CoNLL-U id", to, error))
         return false;
       if (from != int(s.words.size()))
         return error.assign("Incorrect ID '").append(parts[0].str, parts[0].len).append("' of multiword token '").append(line.str, line.len).append("'!"), false;
@@ -133,11 +142,10 @@ bool input_format_conllu::next_sentence(sentence& s, string& error) {
     // Handle empty nodes
     if (version >= 2)
       if (memchr(tokens[0].str, '.', tokens[0].len)) {
-        split(tokens[0], '.', parts);
-        if (parts.size() != 2)
+        if (!split_id(tokens[0], '.', parts))
           return error.assign("Cannot parse ID of empty node '").append(line.str, line.len).append("'!") , false;
         int id, index;
-        if (!parse_int(parts[0], "CoNLL-U empty node id", id, error) || !parse_int(parts[1], "CoNLL-U empty node index", index, error))
+        if (!parse_id(parts[0], "CoNLL-U empty node id", id, error) || !parse_id(parts[1], "CoNLL-U empty node index", index, error))
           return false;
         if (id != int(s.words.size()) - 1)
           return error.assign("Incorrect ID '").append(parts[0].str, parts[0].len).append("' of empty node token '").append(line.str, line.len).append("'!"), false;
@@ -161,7 +169,7 @@ bool input_format_conllu::next_sentence(sentence& s, string& error) {
 
     // Parse word ID and head
     int id;
-    if (!parse_int(tokens[0], "CoNLL-U id", id, error))
+    if (!parse_id(tokens[0], "CoNLL-U id", id, error))
       return false;
     if (id != int(s.words.size()))
       return error.assign("Incorrect ID '").append(tokens[0].str, tokens[0].len).append("' of CoNLL-U line '").append(line.str, line.len).append("'!"), false;
@@ -170,14 +178,14 @@ bool input_format_conllu::next_sentence(sentence& s, string& error) {
     if (tokens[6].len == 1 && tokens[6].str[0] == '_') {
       head = -1;
     } else {
-      if (!parse_int(tokens[6], "CoNLL-U head", head, error))
+      if (!parse_id(tokens[6], "CoNLL-U head", head, error))
         return false;
       if (head < 0)
         return error.assign("Numeric head value '").append(tokens[0].str, tokens[0].len).append("' cannot be negative!"), false;
     }
 
     // Add new word
-    auto& word = s.add_word(tokens[1]);
+    auto& word = recycler.add_word(s, tokens[1]);
     word.lemma.assign(tokens[2].str, tokens[2].len);
     if (!(tokens[3].len == 1 && tokens[3].str[0] == '_')) word.upostag.assign(tokens[3].str, tokens[3].len);
     if (!(tokens[4].len == 1 && tokens[4].str[0] == '_')) word.xpostag.assign(tokens[4].str, tokens[4].len);
@@ -192,17 +200,39 @@ bool input_format_conllu::next_sentence(sentence& s, string& error) {
   if (last_multiword_token >= int(s.words.size()))
     return error.assign("There are words missing for multiword token '").append(s.multiword_tokens.back().form).append("'!"), false;
 
-  // Set heads correctly
+  // Set heads correctly; the words are visited in order of their ids,
+  // so the children are appended already sorted
   for (auto&& word : s.words)
     if (word.id && word.head >= 0) {
       if (word.head >= int(s.words.size()))
         return error.assign("Node ID '").append(to_string(word.id)).append("' form '").append(word.form).append("' has too large head: '").append(to_string(word.head)).append("'!"), false;
-      s.set_head(word.id, word.head, word.deprel);
+      s.words[word.head].children.push_back(word.id);
     }
 
   return !s.empty();
 }
 
+bool input_format_conllu::parse_id(string_piece str, const char* value_name, int& value, string& error) {
+  // Parse the usual short sequence of digits directly, falling back
+  // to parse_int for everything else
+  if (str.len && str.len < 10) {
+    value = 0;
+    size_t i = 0;
+    for (; i < str.len && str.str[i] >= '0' && str.str[i] <= '9'; i++)
+      value = 10 * value + (str.str[i] - '0');
+    if (i == str.len) return true;
+  }
+  return parse_int(str, value_name, value, error);
+}
+
+bool input_format_conllu::split_id(string_piece id, char separator, string_piece (&parts)[2]) {
+  auto first = (const char*) memchr(id.str, separator, id.len);
+  if (!first) return false;
+  parts[0] = string_piece(id.str, first - id.str);
+  parts[1] = string_piece(first + 1, id.str + id.len - first - 1);
+  return !memchr(parts[1].str, separator, parts[1].len);
+}
+
 // Horizontal input format
 class input_format_horizontal : public input_format {
  public:
@@ -214,6 +244,7 @@ class input_format_horizontal : public input_format {
  private:
   string_piece text;
   string text_copy;
+  word_recycler recycler;
   bool new_document = true;
   string document_id;
   unsigned preceeding_newlines = 2;
@@ -244,27 +275,32 @@ void input_format_horizontal::set_text(string_piece text, bool make_copy) {
 
 bool input_format_horizontal::next_sentence(sentence& s, string& error) {
   error.clear();
-  s.clear();
+  recycler.clear(s);
+
+  const char* str = text.str;
+  const char* end = text.str + text.len;
 
   // Skip spaces and newlines
-  while (text.len && (*text.str == ' ' || *text.str == '\t' || *text.str == '\r' || *text.str == '\n')) {
-    preceeding_newlines += *text.str == '\n';
-    text.str++, text.len--;
-  }
+  while (str < end && (*str == ' ' || *str == '\t' || *str == '\r' || *str == '\n'))
+    preceeding_newlines += *str++ == '\n';
 
   // Read space (and tab) separated words
-  while (text.len && *text.str != '\r' && *text.str != '\n') {
-    string_piece word = text;
-
-    // Slurp the word
-    while (text.len && *text.str != ' ' && *text.str != '\t' && *text.str != '\r' && *text.str != '\n')
-      text.str++, text.len--;
-    word.len = text.str - word.str;
-    s.add_word(word);
+  while (str < end && *str != '\r' && *str != '\n') {
+    const char* word = str;
+
+    // Slurp the word, noting whether it can contain an &nbsp;
+    bool nbsp = false;
+    for (; str < end; str++) {
+      unsigned char chr = *str;
+      if (chr > ' ')
+        nbsp |= chr == 0xC2;
+      else if (chr == ' ' || chr == '\t' || chr == '\r' || chr == '\n')
+        break;
+    }
+    string& form = recycler.add_word(s, string_piece(word, str - word)).form;
 
     // Replace &nbsp;s by regular spaces
-    if (s.words.back().form.find("\302\240") != string::npos) {
-      string& form = s.words.back().form;
+    if (nbsp && form.find("\302\240") != string::npos) {
       size_t form_len = 0;
       for (size_t i = 0; i < form.size(); i++) {
         if (form_len && form[form_len-1] == '\302' && form[i] == '\240')
@@ -276,9 +312,10 @@ bool input_format_horizontal::next_sentence(sentence& s, string& error) {
     }
 
     // Skip spaces
-    while (text.len && (*text.str == ' ' || *text.str == '\t'))
-      text.str++, text.len--;
+    while (str < end && (*str == ' ' || *str == '\t'))
+      str++;
   }
+  text = string_piece(str, end - str);
 
   if (!s.empty()) {
     // Mark new document if needed
@@ -309,6 +346,7 @@ class input_format_vertical : public input_format {
  private:
   string_piece text;
   string text_copy;
+  word_recycler recycler;
   bool new_document = true;
   string document_id;
   unsigned preceeding_newlines = 2;
@@ -337,38 +375,39 @@ void input_format_vertical::set_text(string_piece text, bool make_copy) {
 
 bool input_format_vertical::next_sentence(sentence& s, string& error) {
   error.clear();
-  s.clear();
+  recycler.clear(s);
+
+  const char* str = text.str;
+  const char* end = text.str + text.len;
 
   // Skip tabs and newlines
-  while (text.len && (*text.str == '\t' || *text.str == '\r' || *text.str == '\n')) {
-    preceeding_newlines += *text.str == '\n';
-    text.str++, text.len--;
-  }
+  while (str < end && (*str == '\t' || *str == '\r' || *str == '\n'))
+    preceeding_newlines += *str++ == '\n';
 
   // Read first word without tabs on every line
-  while (text.len && *text.str != '\r' && *text.str != '\n') {
-    string_piece word = text;
+  while (str < end && *str != '\r' && *str != '\n') {
+    const char* word = str;
 
     // Slurp the word
-    while (text.len && *text.str != '\t' && *text.str != '\r' && *text.str != '\n')
-      text.str++, text.len--;
-    word.len = text.str - word.str;
-    s.add_word(word);
+    while (str < end && ((unsigned char)*str > '\r' || (*str != '\t' && *str != '\r' && *str != '\n')))
+      str++;
+    recycler.add_word(s, string_piece(word, str - word));
 
-    // Skip spaces till end of line
-    while (text.len && *text.str != '\r' && *text.str != '\n')
-      text.str++, text.len--;
+    // Skip the rest of the line
+    while (str < end && *str != '\r' && *str != '\n')
+      str++;
 
     // Skip one new line
-    if (text.len >= 2 && text.str[0] == '\r' && text.str[1] == '\n')
-      text.str += 2, text.len -= 2;
-    else if (text.len && *text.str == '\n')
-      text.str++, text.len--;
+    if (end - str >= 2 && str[0] == '\r' && str[1] == '\n')
+      str += 2;
+    else if (str < end && *str == '\n')
+      str++;
 
     // Skip tabs on the beginning of the line
-    while (text.len && *text.str == '\t')
-      text.str++, text.len--;
+    while (str < end && *str == '\t')
+      str++;
   }
+  text = string_piece(str, end - str);
 
   if (!s.empty()) {
     // Mark new document if needed
@@ -513,7 +552,154 @@ bool input_format_presegmented_tokenizer::next_sentence(sentence& s, string& err
   return !s.empty();
 }
 
+// Binary input format
+class input_format_binary : public input_format {
+ public:
+  virtual bool read_block(istream& is, string& block) const override;
+  virtual void reset_document(string_piece id = string_piece()) override;
+  virtual void set_text(string_piece text, bool make_copy = false) override;
+  virtual bool next_sentence(sentence& s, string& error) override;
+
+ private:
+  bool read_string(string_piece& data, string& str) const;
+
+  string_piece text;
+  string text_copy;
+  word_recycler recycler;
+  vector<string_piece> strings;
+};
+
+bool input_format_binary::read_block(istream& is, string& block) const {
+  // Read exactly one record
+  block.clear();
+
+  size_t length = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    int byte = is.get();
+    if (byte == EOF) return !block.empty();
+    block.push_back(char(byte));
+    length |= size_t(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) break;
+  }
+
+  size_t offset = block.size();
+  block.resize(offset + length + 1);
+  is.read(&block[offset], length + 1);
+  block.resize(offset + size_t(is.gcount()));
+  if (is.eof()) is.clear(istream::eofbit);
+  return true;
+}
+
+void input_format_binary::reset_document(string_piece /*id*/) {
+  set_text("");
+}
+
+void input_format_binary::set_text(string_piece text, bool make_copy) {
+  if (make_copy) {
+    text_copy.assign(text.str, text.len);
+    text = string_piece(text_copy.c_str(), text_copy.size());
+  }
+  this->text = text;
+}
+
+bool input_format_binary::next_sentence(sentence& s, string& error) {
+  error.clear();
+  recycler.clear(s);
+
+  while (text.len) {
+    // Read the record
+    size_t length;
+    if (!binary_format::read_varint(text, length) || length == 0 || text.len < length + 1 || text.str[length] != '\n')
+      return error.assign("Cannot read a record of the binary format, the data are truncated or corrupted!"), false;
+    string_piece data(text.str + 1, length - 1);
+    char type = text.str[0];
+    text.str += length + 1, text.len -= length + 1;
+
+    if (type == binary_format::HEADER) {
+      if (data != binary_format::version())
+        return error.assign("Unsupported version '").append(data.str, data.len).append("' of the binary format!"), false;
+      continue;
+    }
+    if (type != binary_format::SENTENCE)
+      return error.assign("Unknown record type of the binary format!"), false;
+
+    // Read the string table, without copying the strings
+    size_t count;
+    if (!binary_format::read_varint(data, count) || count > data.len)
+      return error.assign("Cannot read the string table of a binary sentence!"), false;
+    strings.assign(1, string_piece("", 0));
+    for (size_t i = 0, str_len; i < count; i++) {
+      if (!binary_format::read_varint(data, str_len) || str_len > data.len)
+        return error.assign("Cannot read the string table of a binary sentence!"), false;
+      strings.emplace_back(data.str, str_len);
+      data.str += str_len, data.len -= str_len;
+    }
+
+    // Read the sentence
+    size_t words, head = 0, id_first, id_length, id, index;
+    bool ok = binary_format::read_varint(data, count) && count <= data.len;
+    for (size_t i = 0; ok && i < count; i++)
+      s.comments.emplace_back(), ok = read_string(data, s.comments.back());
+
+    ok = ok && binary_format::read_varint(data, words) && words <= data.len;
+    for (size_t i = 0; ok && i < words; i++) {
+      auto& word = recycler.add_word(s);
+      ok = read_string(data, word.form) && read_string(data, word.lemma) && read_string(data, word.upostag) &&
+          read_string(data, word.xpostag) && read_string(data, word.feats) &&
+          binary_format::read_varint(data, head) && head <= words &&
+          read_string(data, word.deprel) && read_string(data, word.deps) && read_string(data, word.misc);
+      word.head = int(head) - 1;
+    }
+
+    ok = ok && binary_format::read_varint(data, count) && count <= data.len;
+    for (size_t i = 0; ok && i < count; i++) {
+      ok = binary_format::read_varint(data, id_first) && binary_format::read_varint(data, id_length) &&
+          id_first >= 1 && id_first + id_length <= words;
+      if (ok) {
+        s.multiword_tokens.emplace_back(int(id_first), int(id_first + id_length));
+        auto& multiword_token = s.multiword_tokens.back();
+        ok = read_string(data, multiword_token.form) && read_string(data, multiword_token.misc) && read_string(data, multiword_token.feats);
+      }
+    }
+
+    ok = ok && binary_format::read_varint(data, count) && count <= data.len;
+    for (size_t i = 0; ok && i < count; i++) {
+      ok = binary_format::read_varint(data, id) && binary_format::read_varint(data, index) && id <= words && index <= data.len;
+      if (ok) {
+        s.empty_nodes.emplace_back(int(id), int(index));
+        auto& empty_node = s.empty_nodes.back();
+        ok = read_string(data, empty_node.form) && read_string(data, empty_node.lemma) && read_string(data, empty_node.upostag) &&
+            read_string(data, empty_node.xpostag) && read_string(data, empty_node.feats) && read_string(data, empty_node.deps) &&
+            read_string(data, empty_node.misc);
+      }
+    }
+
+    if (!ok || data.len)
+      return error.assign("Cannot read a binary sentence, the data are corrupted!"), false;
+
+    // Set heads correctly, appending the children in order
+    for (auto&& word : s.words)
+      if (word.id && word.head >= 0)
+        s.words[word.head].children.push_back(word.id);
+
+    return true;
+  }
+
+  return false;
+}
+
+bool input_format_binary::read_string(string_piece& data, string& str) const {
+  size_t index;
+  if (!binary_format::read_varint(data, index) || index >= strings.size()) return false;
+  str.assign(strings[index].str, strings[index].len);
+  return true;
+}
+
 // Static factory methods
+input_format* input_format::new_binary_input_format(const string& /*options*/) {
+  return new input_format_binary();
+}
+
 input_format* input_format::new_conllu_input_format(const string& options) {
   named_values::map parsed_options;
   string parse_error;
@@ -555,6 +741,7 @@ input_format* input_format::new_input_format(const string& name) {
   size_t name_len = equal != string::npos ? equal : name.size();
   size_t option_offset = equal != string::npos ? equal + 1 : name.size();
 
+  if (name.compare(0, name_len, "binary") == 0) return new_binary_input_format(name.substr(option_offset));
   if (name.compare(0, name_len, "conllu") == 0) return new_conllu_input_format(name.substr(option_offset));
   if (name.compare(0, name_len, "generic_tokenizer") == 0) return new_generic_tokenizer_input_format(name.substr(option_offset));
   if (name.compare(0, name_len, "horizontal") == 0) return new_horizontal_input_format(name.substr(option_offset));
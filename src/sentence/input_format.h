@@ -26,6 +26,7 @@ class input_format {
 
   // Static factory methods
   static input_format* new_input_format(const string& name);
+  static input_format* new_binary_input_format(const string& options = string());
   static input_format* new_conllu_input_format(const string& options = string());
   static input_format* new_generic_tokenizer_input_format(const string& options = string());
   static input_format* new_horizontal_input_format(const string& options = string());
@@ -8,12 +8,14 @@
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include <algorithm>
+#include <cstring>
+#include <sstream>
 
+#include "binary_format.h"
 #include "output_format.h"
 #include "utils/named_values.h"
 #include "utils/parse_int.h"
 #include "utils/split.h"
-#include "utils/xml_encoded.h"
 
 namespace ufal {
 namespace udpipe {
@@ -24,26 +26,60 @@ const string output_format::HORIZONTAL_PARAGRAPHS = "paragraphs";
 const string output_format::PLAINTEXT_NORMALIZED_SPACES = "normalized_spaces";
 const string output_format::VERTICAL_PARAGRAPHS = "paragraphs";
 
+// Common methods
+void output_format::write_sentence(const sentence& s, ostream& os) {
+  write_sentence(s, buffer);
+  if (buffer.size() >= buffer_size) flush(os);
+}
+
+void output_format::finish_document(ostream& os) {
+  finish_document(buffer);
+  flush(os);
+}
+
+void output_format::write_sentence(const sentence& s, string& output) {
+  ostringstream os;
+  write_sentence(s, os);
+  output.append(os.str());
+}
+
+void output_format::set_buffer_size(size_t buffer_size) {
+  this->buffer_size = buffer_size;
+}
+
+void output_format::flush(ostream& os) {
+  os.write(buffer.data(), buffer.size());
+  buffer.clear();
+}
+
+static void append_int(string& output, int value) {
+  char digits[16], *digit = digits + sizeof(digits);
+  unsigned magnitude = value < 0 ? 0U - unsigned(value) : unsigned(value);
+  do *--digit = '0' + magnitude % 10; while (magnitude /= 10);
+  if (value < 0) *--digit = '-';
+  output.append(digit, digits + sizeof(digits) - digit);
+}
+
 // CoNLL-U output format
 class output_format_conllu : public output_format {
  public:
   output_format_conllu(unsigned version) : version(version) {}
 
-  virtual void write_sentence(const sentence& s, ostream& os) override;
+  virtual void write_sentence(const sentence& s, string& output) override;
 
  private:
   unsigned version;
   static const string underscore;
   const string& underscore_on_empty(const string& str) const { return str.empty() ? underscore : str; }
-  ostream& write_with_spaces(ostream& os, const string& str);
+  string& write_with_spaces(string& output, const string& str);
 };
 
 const string output_format_conllu::underscore = "_";
 
-void output_format_conllu::write_sentence(const sentence& s, ostream& os) {
+void output_format_conllu::write_sentence(const sentence& s, string& output) {
   // Comments
   for (auto&& comment : s.comments)
-    os << comment << '\n';
+    output.append(comment).push_back('\n');
 
   // Words and multiword tokens
   size_t multiword_token = 0, empty_node = 0;
@@ -53,60 +89,61 @@ void output_format_conllu::write_sentence(const sentence& s, ostream& os) {
       // Multiword token if present
       if (multiword_token < s.multiword_tokens.size() &&
           i == s.multiword_tokens[multiword_token].id_first) {
-        os << s.multiword_tokens[multiword_token].id_first << '-'
-           << s.multiword_tokens[multiword_token].id_last << '\t';
-        write_with_spaces(os, s.multiword_tokens[multiword_token].form) << "\t_\t_\t_\t"
-           << underscore_on_empty(s.multiword_tokens[multiword_token].feats) << "\t_\t_\t_\t"
-           << underscore_on_empty(s.multiword_tokens[multiword_token].misc) << '\n';
+        append_int(output, s.multiword_tokens[multiword_token].id_first); output.push_back('-');
+        append_int(output, s.multiword_tokens[multiword_token].id_last); output.push_back('\t');
+        write_with_spaces(output, s.multiword_tokens[multiword_token].form).append("\t_\t_\t_\t")
+          .append(underscore_on_empty(s.multiword_tokens[multiword_token].feats)).append("\t_\t_\t_\t")
+          .append(underscore_on_empty(s.multiword_tokens[multiword_token].misc)).push_back('\n');
         multiword_token++;
       }
 
       // Write the word
-      os << i << '\t';
-      write_with_spaces(os, s.words[i].form) << '\t';
-      write_with_spaces(os, underscore_on_empty(s.words[i].lemma)) << '\t'
-         << underscore_on_empty(s.words[i].upostag) << '\t'
-         << underscore_on_empty(s.words[i].xpostag) << '\t'
-         << underscore_on_empty(s.words[i].feats) << '\t';
-      if (s.words[i].head < 0) os << '_'; else os << s.words[i].head; os << '\t'
-         << underscore_on_empty(s.words[i].deprel) << '\t'
-         << underscore_on_empty(s.words[i].deps) << '\t'
-         << underscore_on_empty(s.words[i].misc) << '\n';
+      append_int(output, i); output.push_back('\t');
+      write_with_spaces(output, s.words[i].form).push_back('\t');
+      write_with_spaces(output, underscore_on_empty(s.words[i].lemma)).append(1, '\t')
+        .append(underscore_on_empty(s.words[i].upostag)).append(1, '\t')
+        .append(underscore_on_empty(s.words[i].xpostag)).append(1, '\t')
+        .append(underscore_on_empty(s.words[i].feats)).push_back('\t');
+      if (s.words[i].head < 0) output.push_back('_'); else append_int(output, s.words[i].head); output.append(1, '\t')
+        .append(underscore_on_empty(s.words[i].deprel)).append(1, '\t')
+        .append(underscore_on_empty(s.words[i].deps)).append(1, '\t')
+        .append(underscore_on_empty(s.words[i].misc)).push_back('\n');
     }
 
     // Empty nodes
     if (version >= 2)
       for (; empty_node < s.empty_nodes.size() && i == s.empty_nodes[empty_node].id; empty_node++) {
-        os << i << '.' << s.empty_nodes[empty_node].index << '\t'
-           << s.empty_nodes[empty_node].form << '\t'
-           << underscore_on_empty(s.empty_nodes[empty_node].lemma) << '\t'
-           << underscore_on_empty(s.empty_nodes[empty_node].upostag) << '\t'
-           << underscore_on_empty(s.empty_nodes[empty_node].xpostag) << '\t'
-           << underscore_on_empty(s.empty_nodes[empty_node].feats) << '\t'
-           << "_\t"
-           << "_\t"
-           << underscore_on_empty(s.empty_nodes[empty_node].deps) << '\t'
-           << underscore_on_empty(s.empty_nodes[empty_node].misc) << '\n';
+        append_int(output, i); output.push_back('.');
+        append_int(output, s.empty_nodes[empty_node].index); output.append(1, '\t')
+          .append(s.empty_nodes[empty_node].form).append(1, '\t')
+          .append(underscore_on_empty(s.empty_nodes[empty_node].lemma)).append(1, '\t')
+          .append(underscore_on_empty(s.empty_nodes[empty_node].upostag)).append(1, '\t')
+          .append(underscore_on_empty(s.empty_nodes[empty_node].xpostag)).append(1, '\t')
+          .append(underscore_on_empty(s.empty_nodes[empty_node].feats)).append(1, '\t')
+          .append("_\t")
+          .append("_\t")
+          .append(underscore_on_empty(s.empty_nodes[empty_node].deps)).append(1, '\t')
+          .append(underscore_on_empty(s.empty_nodes[empty_node].misc)).push_back('\n');
       }
   }
-  os << endl;
+  output.push_back('\n');
 }
 
-ostream& output_format_conllu::write_with_spaces(ostream& os, const string& str) {
+string& output_format_conllu::write_with_spaces(string& output, const string& str) {
   if (version >= 2 || str.find(' ') == string::npos)
-    os << str;
+    output.append(str);
   else
     for (auto&& chr : str)
-      os << (chr == ' ' ? '_' : chr);
+      output.push_back(chr == ' ' ? '_' : chr);
 
-  return os;
+  return output;
 }
 
 // EPE output format
 class output_format_epe : public output_format {
  public:
-  virtual void write_sentence(const sentence& s, ostream& os) override;
-  virtual void finish_document(ostream& os) override;
+  virtual void write_sentence(const sentence& s, string& output) override;
+  virtual void finish_document(string& output) override;
 
  private:
   class json_builder {
@@ -166,7 +203,7 @@ class output_format_epe : public output_format {
   size_t sentences = 0;
 };
 
-void output_format_epe::write_sentence(const sentence& s, ostream& os) {
+void output_format_epe::write_sentence(const sentence& s, string& output) {
   json.object().key("id").value(++sentences).key("nodes").array();
 
   for (size_t i = 1; i < s.words.size(); i++) {
@@ -204,98 +241,120 @@ void output_format_epe::write_sentence(const sentence& s, ostream& os) {
   json.close().close();
 
   string_piece current = json.current();
-  os.write(current.str, current.len).put('\n');
+  output.append(current.str, current.len).push_back('\n');
   json.clear();
 }
 
-void output_format_epe::finish_document(ostream& /*os*/) {
+void output_format_epe::finish_document(string& /*output*/) {
   sentences = 0;
 }
 
 // Matxin output format
 class output_format_matxin : public output_format {
  public:
-  virtual void write_sentence(const sentence& s, ostream& os) override;
-  virtual void finish_document(ostream& os) override;
+  virtual void write_sentence(const sentence& s, string& output) override;
+  virtual void finish_document(string& output) override;
 
  private:
-  void write_node(const sentence& s, int node, string& pad, ostream& os);
+  void write_node(const sentence& s, int node, string& pad, string& output);
+  static void append_xml_encoded(string& output, const string& str);
 
   int sentences = 0;
 };
 
-void output_format_matxin::write_sentence(const sentence& s, ostream& os) {
+void output_format_matxin::write_sentence(const sentence& s, string& output) {
   if (!sentences) {
-    os << "<corpus>";
+    output.append("<corpus>");
   }
-  os << "\n<SENTENCE ord=\"" << ++sentences << "\" alloc=\"" << 0 << "\">\n";
+  output.append("\n<SENTENCE ord=\"");
+  append_int(output, ++sentences);
+  output.append("\" alloc=\"0\">\n");
 
   string pad;
   for (auto&& node : s.words[0].children)
-    write_node(s, node, pad, os);
+    write_node(s, node, pad, output);
 
-  os << "</SENTENCE>" << endl;
+  output.append("</SENTENCE>\n");
 }
 
-void output_format_matxin::finish_document(ostream& os) {
-  os << "</corpus>\n";
+void output_format_matxin::finish_document(string& output) {
+  output.append("</corpus>\n");
 
   sentences = 0;
 }
 
-void output_format_matxin::write_node(const sentence& s, int node, string& pad, ostream& os) {
+void output_format_matxin::write_node(const sentence& s, int node, string& pad, string& output) {
   // <NODE ord="%d" alloc="%d" form="%s" lem="%s" mi="%s" si="%s">
   pad.push_back(' ');
 
-  os << pad << "<NODE ord=\"" << node << "\" alloc=\"" << 0
-     << "\" form=\"" << xml_encoded(s.words[node].form, true)
-     << "\" lem=\"" << xml_encoded(s.words[node].lemma, true)
-     << "\" mi=\"" << xml_encoded(s.words[node].feats, true)
-     << "\" si=\"" << xml_encoded(s.words[node].deprel, true) << '"';
+  output.append(pad).append("<NODE ord=\"");
+  append_int(output, node);
+  output.append("\" alloc=\"0\" form=\"");
+  append_xml_encoded(output, s.words[node].form);
+  output.append("\" lem=\"");
+  append_xml_encoded(output, s.words[node].lemma);
+  output.append("\" mi=\"");
+  append_xml_encoded(output, s.words[node].feats);
+  output.append("\" si=\"");
+  append_xml_encoded(output, s.words[node].deprel);
+  output.push_back('"');
 
   if (s.words[node].children.empty()) {
-    os << "/>\n";
+    output.append("/>\n");
   } else {
-    os << ">\n";
+    output.append(">\n");
     for (auto&& child : s.words[node].children)
-      write_node(s, child, pad, os);
-    os << pad << "</NODE>\n";
+      write_node(s, child, pad, output);
+    output.append(pad).append("</NODE>\n");
   }
 
   pad.pop_back();
 }
 
+void output_format_matxin::append_xml_encoded(string& output, const string& str) {
+  for (auto&& chr : str)
+    switch (chr) {
+      case '<': output.append("&lt;"); break;
+      case '>': output.append("&gt;"); break;
+      case '&': output.append("&amp;"); break;
+      case '"': output.append("&quot;"); break;
+      default: output.push_back(chr);
+    }
+}
+
 // Horizontal output format
 class output_format_horizontal : public output_format {
  public:
   output_format_horizontal(bool paragraphs) : paragraphs(paragraphs), empty(true) {}
 
-  virtual void write_sentence(const sentence& s, ostream& os) override;
-  virtual void finish_document(ostream& /*os*/) override { empty = true; }
+  virtual void write_sentence(const sentence& s, string& output) override;
+  virtual void finish_document(string& /*output*/) override { empty = true; }
 
  private:
   bool paragraphs;
   bool empty;
 };
 
-void output_format_horizontal::write_sentence(const sentence& s, ostream& os) {
+void output_format_horizontal::write_sentence(const sentence& s, string& output) {
   if (paragraphs && !empty && (s.get_new_doc() || s.get_new_par()))
-    os << '\n';
+    output.push_back('\n');
   empty = false;
 
-  string line;
   for (size_t i = 1; i < s.words.size(); i++) {
     // Append word, but replace spaces by &nbsp;s
-    for (auto&& chr : s.words[i].form)
-      if (chr == ' ')
-        line.append("\302\240");
-      else
-        line.push_back(chr);
+    if (s.words[i].form.find(' ') == string::npos)
+      output.append(s.words[i].form);
+    else
+      for (auto&& chr : s.words[i].form)
+        if (chr == ' ')
+          output.append("\302\240");
+        else
+          output.push_back(chr);
 
     if (i+1 < s.words.size())
-      line.push_back(' ');
+      output.push_back(' ');
   }
-  os << line << endl;
+  output.push_back('\n');
 }
 
 // Plaintext output format
@@ -303,37 +362,41 @@ class output_format_plaintext : public output_format {
  public:
   output_format_plaintext(bool normalized): normalized(normalized), empty(true) {}
 
-  virtual void write_sentence(const sentence& s, ostream& os) override;
-  virtual void finish_document(ostream& /*os*/) override { empty = true; }
+  virtual void write_sentence(const sentence& s, string& output) override;
+  virtual void finish_document(string& /*output*/) override { empty = true; }
  private:
   bool normalized;
   bool empty;
+  string spaces;
 };
 
-void output_format_plaintext::write_sentence(const sentence& s, ostream& os) {
+void output_format_plaintext::write_sentence(const sentence& s, string& output) {
   if (normalized) {
     if (!empty && (s.get_new_doc() || s.get_new_par()))
-      os << '\n';
+      output.push_back('\n');
     for (size_t i = 1, j = 0; i < s.words.size(); i++) {
       const token& tok = j < s.multiword_tokens.size() && s.multiword_tokens[j].id_first == int(i) ? (const token&)s.multiword_tokens[j] : (const token&)s.words[i];
-      os << tok.form;
+      output.append(tok.form);
       if (i+1 < s.words.size() && tok.get_space_after())
-        os << ' ';
+        output.push_back(' ');
       if (j < s.multiword_tokens.size() && s.multiword_tokens[j].id_first == int(i))
         i = s.multiword_tokens[j++].id_last;
     }
-    os << endl;
+    output.push_back('\n');
   } else {
-    string spaces;
     for (size_t i = 1, j = 0; i < s.words.size(); i++) {
       const token& tok = j < s.multiword_tokens.size() && s.multiword_tokens[j].id_first == int(i) ? (const token&)s.multiword_tokens[j] : (const token&)s.words[i];
-      tok.get_spaces_before(spaces); os << spaces;
-      tok.get_spaces_in_token(spaces); os << (!spaces.empty() ? spaces : tok.form);
-      tok.get_spaces_after(spaces); os << spaces;
+      if (tok.misc.empty()) {
+        // Without any MISC fields, the token is followed by a single space
+        output.append(tok.form).push_back(' ');
+      } else {
+        tok.get_spaces_before(spaces); output.append(spaces);
+        tok.get_spaces_in_token(spaces); output.append(!spaces.empty() ? spaces : tok.form);
+        tok.get_spaces_after(spaces); output.append(spaces);
+      }
       if (j < s.multiword_tokens.size() && s.multiword_tokens[j].id_first == int(i))
         i = s.multiword_tokens[j++].id_last;
     }
-    os << flush;
   }
   empty = false;
 }
@@ -343,25 +406,159 @@ class output_format_vertical : public output_format {
  public:
   output_format_vertical(bool paragraphs) : paragraphs(paragraphs), empty(true) {}
 
-  virtual void write_sentence(const sentence& s, ostream& os) override;
-  virtual void finish_document(ostream& /*os*/) override { empty = true; }
+  virtual void write_sentence(const sentence& s, string& output) override;
+  virtual void finish_document(string& /*output*/) override { empty = true; }
 
  private:
   bool paragraphs;
   bool empty;
 };
 
-void output_format_vertical::write_sentence(const sentence& s, ostream& os) {
+void output_format_vertical::write_sentence(const sentence& s, string& output) {
   if (paragraphs && !empty && (s.get_new_doc() || s.get_new_par()))
-    os << '\n';
+    output.push_back('\n');
   empty = false;
 
   for (size_t i = 1; i < s.words.size(); i++)
-    os << s.words[i].form << '\n';
-  os << endl;
+    output.append(s.words[i].form).push_back('\n');
+  output.push_back('\n');
+}
+
+// Binary output format
+class output_format_binary : public output_format {
+ public:
+  virtual void write_sentence(const sentence& s, string& output) override;
+  virtual void finish_document(string& /*output*/) override { started = false; }
+
+ private:
+  inline size_t intern(const string& str);
+
+  bool started = false;
+  vector<string_piece> strings;
+  vector<unsigned> strings_map, strings_slots;
+  vector<char> fields;
+};
+
+void output_format_binary::write_sentence(const sentence& s, string& output) {
+  if (!started) {
+    string_piece version = binary_format::version();
+    binary_format::append_varint(output, 1 + version.len);
+    output.push_back(binary_format::HEADER);
+    output.append(version.str, version.len).push_back('\n');
+    started = true;
+  }
+
+  // Prepare the string table map, using open addressing with at most half full
+  // table. The map is only enlarged, and only its used slots are cleared after
+  // every sentence.
+  size_t strings_limit = 1 + s.comments.size() + 8 * s.words.size() + 3 * s.multiword_tokens.size() + 7 * s.empty_nodes.size();
+  if (strings_map.size() < 2 * strings_limit) {
+    size_t map_size = 16;
+    while (map_size < 2 * strings_limit) map_size *= 2;
+    strings_map.assign(map_size, 0);
+  }
+
+  // Encode the sentence fields, each taking at most MAX_VARINT_LENGTH bytes
+  size_t fields_limit = 4 + s.comments.size() + 9 * s.words.size() + 5 * s.multiword_tokens.size() + 9 * s.empty_nodes.size();
+  if (fields.size() < fields_limit * binary_format::MAX_VARINT_LENGTH)
+    fields.resize(fields_limit * binary_format::MAX_VARINT_LENGTH);
+  char* fields_end = fields.data();
+
+  binary_format::write_varint(fields_end, s.comments.size());
+  for (auto&& comment : s.comments)
+    binary_format::write_varint(fields_end, intern(comment));
+
+  binary_format::write_varint(fields_end, s.words.size() - 1);
+  for (size_t i = 1; i < s.words.size(); i++) {
+    auto& word = s.words[i];
+    binary_format::write_varint(fields_end, intern(word.form));
+    binary_format::write_varint(fields_end, intern(word.lemma));
+    binary_format::write_varint(fields_end, intern(word.upostag));
+    binary_format::write_varint(fields_end, intern(word.xpostag));
+    binary_format::write_varint(fields_end, intern(word.feats));
+    binary_format::write_varint(fields_end, word.head < 0 ? 0 : word.head + 1);
+    binary_format::write_varint(fields_end, intern(word.deprel));
+    binary_format::write_varint(fields_end, intern(word.deps));
+    binary_format::write_varint(fields_end, intern(word.misc));
+  }
+
+  binary_format::write_varint(fields_end, s.multiword_tokens.size());
+  for (auto&& multiword_token : s.multiword_tokens) {
+    binary_format::write_varint(fields_end, multiword_token.id_first);
+    binary_format::write_varint(fields_end, multiword_token.id_last - multiword_token.id_first);
+    binary_format::write_varint(fields_end, intern(multiword_token.form));
+    binary_format::write_varint(fields_end, intern(multiword_token.misc));
+    binary_format::write_varint(fields_end, intern(multiword_token.feats));
+  }
+
+  binary_format::write_varint(fields_end, s.empty_nodes.size());
+  for (auto&& empty_node : s.empty_nodes) {
+    binary_format::write_varint(fields_end, empty_node.id);
+    binary_format::write_varint(fields_end, empty_node.index);
+    binary_format::write_varint(fields_end, intern(empty_node.form));
+    binary_format::write_varint(fields_end, intern(empty_node.lemma));
+    binary_format::write_varint(fields_end, intern(empty_node.upostag));
+    binary_format::write_varint(fields_end, intern(empty_node.xpostag));
+    binary_format::write_varint(fields_end, intern(empty_node.feats));
+    binary_format::write_varint(fields_end, intern(empty_node.deps));
+    binary_format::write_varint(fields_end, intern(empty_node.misc));
+  }
+
+  // Write the record with the string table and the fields
+  size_t fields_length = fields_end - fields.data();
+  size_t length = 1 + binary_format::varint_length(strings.size()) + fields_length;
+  for (auto&& str : strings)
+    length += binary_format::varint_length(str.len) + str.len;
+
+  size_t record_start = output.size();
+  output.resize(record_start + binary_format::varint_length(length) + length + 1);
+  char* record = &output[record_start];
+  binary_format::write_varint(record, length);
+  *record++ = binary_format::SENTENCE;
+  binary_format::write_varint(record, strings.size());
+  for (auto&& str : strings) {
+    binary_format::write_varint(record, str.len);
+    memcpy(record, str.str, str.len), record += str.len;
+  }
+  memcpy(record, fields.data(), fields_length), record += fields_length;
+  *record = '\n';
+
+  for (auto&& slot : strings_slots)
+    strings_map[slot] = 0;
+  strings_slots.clear();
+  strings.clear();
+}
+
+size_t output_format_binary::intern(const string& str) {
+  if (str.empty()) return 0;
+
+  // Hash the string four bytes at a time
+  uint32_t hash = uint32_t(str.size()), chunk;
+  const char* data = str.data();
+  for (size_t len = str.size(); len; len -= len >= 4 ? 4 : 1)
+    if (len >= 4) {
+      memcpy(&chunk, data, 4), data += 4;
+      hash = (hash ^ chunk) * 2654435761U;
+    } else {
+      hash = (hash ^ (unsigned char)*data++) * 2654435761U;
+    }
+  hash ^= hash >> 16;
+
+  for (size_t mask = strings_map.size() - 1, i = hash & mask; ; i = (i + 1) & mask)
+    if (!strings_map[i]) {
+      strings.emplace_back(str);
+      strings_slots.push_back(unsigned(i));
+      return strings_map[i] = unsigned(strings.size());
+    } else if (strings[strings_map[i] - 1] == str) {
+      return strings_map[i];
+    }
 }
 
 // Static factory methods
+output_format* output_format::new_binary_output_format(const string& /*options*/) {
+  return new output_format_binary();
+}
+
 output_format* output_format::new_conllu_output_format(const string& options) {
   named_values::map parsed_options;
   string parse_error;
@@ -417,6 +614,7 @@ output_format* output_format::new_output_format(const string& name) {
   size_t name_len = equal != string::npos ? equal : name.size();
   size_t option_offset = equal != string::npos ? equal + 1 : name.size();
 
+  if (name.compare(0, name_len, "binary") == 0) return new_binary_output_format(name.substr(option_offset));
   if (name.compare(0, name_len, "conllu") == 0) return new_conllu_output_format(name.substr(option_offset));
   if (name.compare(0, name_len, "epe") == 0) return new_epe_output_format(name.substr(option_offset));
   if (name.compare(0, name_len, "matxin") == 0) return new_matxin_output_format(name.substr(option_offset));
@@ -19,11 +19,26 @@ class output_format {
  public:
   virtual ~output_format() {}
 
-  virtual void write_sentence(const sentence& s, ostream& os) = 0;
-  virtual void finish_document(ostream& /*os*/) {}
+  // Write the output of a sentence or of a document end to the stream.
+  // The output is collected in a buffer and written once it exceeds
+  // the buffer size, in finish_document and in flush; the stream itself
+  // is never flushed. By default, the output of every call is written.
+  virtual void write_sentence(const sentence& s, ostream& os);
+  virtual void finish_document(ostream& os);
+
+  // Append the output of a sentence or of a document end to the given string.
+  // Derived classes must override either these or the stream methods.
+  virtual void write_sentence(const sentence& s, string& output);
+  virtual void finish_document(string& /*output*/) {}
+
+  // Set the output buffer size of the stream methods, and write the buffered
+  // output to the stream.
+  void set_buffer_size(size_t buffer_size);
+  void flush(ostream& os);
 
   // Static factory methods
   static output_format* new_output_format(const string& name);
+  static output_format* new_binary_output_format(const string& options = string());
   static output_format* new_conllu_output_format(const string& options = string());
   static output_format* new_epe_output_format(const string& options = string());
   static output_format* new_matxin_output_format(const string& options = string());
@@ -36,6 +51,10 @@ class output_format {
   static const string HORIZONTAL_PARAGRAPHS;
   static const string PLAINTEXT_NORMALIZED_SPACES;
   static const string VERTICAL_PARAGRAPHS;
+
+ private:
+  string buffer;
+  size_t buffer_size = 0;
 };
 
 } // namespace udpipe
@@ -111,10 +111,10 @@ bool sentence::get_sent_id(string& id) const {
 }
 
 void sentence::set_sent_id(string_piece id) {
-  remove_comment("sent_id");
-
   if (id.len)
     set_comment("sent_id", id);
+  else
+    remove_comment("sent_id");
 }
 
 bool sentence::get_text(string& text) const {
@@ -124,10 +124,10 @@ bool sentence::get_text(string& text) const {
 }
 
 void sentence::set_text(string_piece text) {
-  remove_comment("text");
-
   if (text.len)
     set_comment("text", text);
+  else
+    remove_comment("text");
 }
 
 bool sentence::get_comment(string_piece name, string* value) const {
@@ -174,12 +174,16 @@ void sentence::remove_comment(string_piece name) {
 void sentence::set_comment(string_piece name, string_piece value) {
   remove_comment(name);
 
+  // The value may point into another comment, so the new comment is composed
+  // before it is appended
   string comment;
+  comment.reserve(2 + name.len + (value.len ? 3 + value.len : 0));
   comment.append("# ").append(name.str, name.len);
   if (value.len) {
-    comment.append(" = ");
-    for (size_t i = 0; i < value.len; i++)
-      comment.push_back(value.str[i] == '\r' || value.str[i] == '\n' ? ' ' : value.str[i]);
+    comment.append(" = ").append(value.str, value.len);
+    for (size_t i = comment.size() - value.len; i < comment.size(); i++)
+      if (comment[i] == '\r' || comment[i] == '\n')
+        comment[i] = ' ';
   }
   comments.push_back(std::move(comment));
 }
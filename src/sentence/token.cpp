@@ -7,6 +7,7 @@
 // License, v. 2.0. If a copy of the MPL was not distributed with this
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
+#include <cstring>
 #include <limits>
 
 #include "token.h"
@@ -116,25 +117,35 @@ bool token::get_token_range(size_t& start, size_t& end) const {
   return true;
 }
 
+static void append_offset(string& output, size_t value) {
+  char digits[24], *digit = digits + sizeof(digits);
+  do *--digit = '0' + value % 10; while (value /= 10);
+  output.append(digit, digits + sizeof(digits) - digit);
+}
+
 void token::set_token_range(size_t start, size_t end) {
   if (start == size_t(string::npos))
     remove_misc_field("TokenRange");
-  else
-    start_misc_field("TokenRange").append(to_string(start)).append(1, ':').append(to_string(end));
+  else {
+    string& misc = start_misc_field("TokenRange");
+    append_offset(misc, start);
+    misc.push_back(':');
+    append_offset(misc, end);
+  }
 }
 
 // Private MISC field helpers
 bool token::get_misc_field(string_piece name, string_piece& value) const {
-  for (size_t index = 0; index < misc.size(); ) {
-    if (misc.compare(index, name.len, name.str, name.len) == 0 && misc[index + name.len] == '=') {
-      index += name.len + 1;
-      value.str = misc.c_str() + index;
-      value.len = misc.find('|', index);
-      value.len = (value.len == size_t(string::npos) ? misc.size() : value.len) - index;
+  for (const char* field = misc.c_str(), *misc_end = field + misc.size(); field < misc_end; ) {
+    const char* field_end = (const char*) memchr(field, '|', misc_end - field);
+    if (!field_end) field_end = misc_end;
+
+    if (size_t(field_end - field) > name.len && field[name.len] == '=' && memcmp(field, name.str, name.len) == 0) {
+      value.str = field + name.len + 1;
+      value.len = field_end - value.str;
       return true;
     }
-    index = misc.find('|', index);
-    if (index != size_t(string::npos)) index++;
+    field = field_end + 1;
   }
   return false;
 }
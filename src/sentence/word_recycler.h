@@ -0,0 +1,67 @@
+// This file is part of UDPipe <http://github.com/ufal/udpipe/>.
+//
+// Copyright 2026 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include "common.h"
+#include "sentence.h"
+
+namespace ufal {
+namespace udpipe {
+
+// Keeps the words of a cleared sentence and reuses them when adding words
+// to it, so that the fields of the following sentences do not need to be
+// reallocated. Used by the input formats reading sentences repeatedly.
+class word_recycler {
+ public:
+  // Clear the sentence, keeping its words for reuse and dropping the ones
+  // kept previously, which have been reused or were not needed.
+  void clear(sentence& s) {
+    words.swap(s.words);
+    s.clear();
+  }
+
+  word& add_word(sentence& s, string_piece form = string_piece()) {
+    size_t id = s.words.size();
+    if (id >= words.size() || !owns_memory(words[id]))
+      return s.add_word(form);
+
+    s.words.push_back(std::move(words[id]));
+    auto& word = s.words.back();
+    word.id = int(id);
+    word.form.assign(form.str, form.len);
+    word.misc.clear();
+    word.lemma.clear();
+    word.upostag.clear();
+    word.xpostag.clear();
+    word.feats.clear();
+    word.head = -1;
+    word.deprel.clear();
+    word.deps.clear();
+    word.children.clear();
+    return word;
+  }
+
+ private:
+  vector<word> words;
+
+  // Reusing a word is worth it only if some of its fields are allocated,
+  // otherwise constructing a new one is faster than moving it.
+  static bool owns_memory(const word& w) {
+    const size_t local_capacity = string().capacity();
+    return w.form.capacity() > local_capacity || w.misc.capacity() > local_capacity ||
+        w.lemma.capacity() > local_capacity || w.upostag.capacity() > local_capacity ||
+        w.xpostag.capacity() > local_capacity || w.feats.capacity() > local_capacity ||
+        w.deprel.capacity() > local_capacity || w.deps.capacity() > local_capacity ||
+        w.children.capacity();
+  }
+};
+
+} // namespace udpipe
+} // namespace ufal
@@ -8,17 +8,24 @@
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include <algorithm>
+#include <thread>
 
 #include "detokenizer.h"
 #include "unilib/utf8.h"
 #include "unilib/unicode.h"
+#include "utils/utf8_ascii.h"
 
 namespace ufal {
 namespace udpipe {
 
 detokenizer::detokenizer(const string& plain_text)
     : data_lowercased(perform_lowercase(plain_text)), data_categorized(perform_categorize(plain_text)),
-    sa_lowercased(data_lowercased), sa_categorized(data_categorized) {}
+    sa_lowercased(data_lowercased), sa_categorized(data_categorized) {
+  // Construct both suffix arrays in parallel
+  thread lowercased([this] { sa_lowercased.build(); });
+  sa_categorized.build();
+  lowercased.join();
+}
 
 void detokenizer::detokenize(sentence& s) const {
   token* previous_tok = nullptr;
@@ -47,6 +54,10 @@ void detokenizer::detokenize(sentence& s) const {
   }
 }
 
+size_t detokenizer::memory_usage() const {
+  return data_lowercased.size() + data_categorized.size() + sa_lowercased.memory_usage() + sa_categorized.memory_usage();
+}
+
 int detokenizer::difference(const string& left, const string& right, bool separate, int mode) const {
   auto& func = mode == LOWERCASE ? perform_lowercase : perform_categorize;
   auto& sa = mode == LOWERCASE ? sa_lowercased : sa_categorized;
@@ -67,18 +78,25 @@ int detokenizer::difference(const string& left, const string& right, bool separa
 string detokenizer::perform_lowercase(const string& input) {
   using namespace unilib;
 
+  u32string chrs;
+  utf8_ascii::decode(input, chrs);
+  utf8_ascii::lowercase(chrs.data(), chrs.size(), &chrs[0]);
+
   string output;
-  for (auto&& chr : utf8::decoder(input))
-    utf8::append(output, unicode::lowercase(chr));
+  utf8::encode(chrs, output);
   return output;
 }
 
 string detokenizer::perform_categorize(const string& input) {
   using namespace unilib;
 
+  u32string chrs;
+  utf8_ascii::decode(input, chrs);
+  vector<unicode::category_t> categories(chrs.size());
+  utf8_ascii::category(chrs.data(), chrs.size(), categories.data());
+
   string output;
-  for (auto&& chr : utf8::decoder(input)) {
-    auto category = unicode::category(chr);
+  for (auto&& category : categories) {
     if (category & unicode::C) output.push_back('C');
     if (category & unicode::L) output.push_back('L');
     if (category & unicode::M) output.push_back('M');
@@ -116,19 +134,129 @@ bool detokenizer::only_digits(const string& word) const {
   return true;
 }
 
-detokenizer::suffix_array::suffix_array(const string& str) : suffix_comparator(str), suffix_lower_finder(str), suffix_upper_finder(str) {
-  sa.reserve(str.size());
-  for (unsigned i = 0; i < str.size(); i++)
-    sa.push_back(i);
+// Construct the suffix array of text[0, n) with characters in [0, alphabet)
+// using the SA-IS algorithm of Nong, Zhang and Chan, which runs in linear
+// time. The suffixes are ordered as if the text was followed by a sentinel
+// smaller than all characters, so a suffix precedes all suffixes it is
+// a prefix of. The value ~0U is used to denote empty entries, so n must be
+// smaller than it; the sa array must have n elements.
+template <class T>
+static void sais(const T* text, unsigned* sa, unsigned n, unsigned alphabet) {
+  const unsigned EMPTY = ~0U;
+  if (n <= 1) {
+    if (n) sa[0] = 0;
+    return;
+  }
+
+  // Classify the suffixes as S-type (smaller than the following suffix) and L-type
+  vector<bool> stype(n, false);
+  for (unsigned i = n - 1; i-- > 0; )
+    stype[i] = text[i] < text[i + 1] || (text[i] == text[i + 1] && stype[i + 1]);
+  auto is_lms = [&stype](unsigned i) { return i > 0 && stype[i] && !stype[i - 1]; };
+
+  // Compute the bucket starts or ends
+  vector<unsigned> bucket(alphabet);
+  auto buckets = [&](bool ends) {
+    fill(bucket.begin(), bucket.end(), 0);
+    for (unsigned i = 0; i < n; i++)
+      bucket[text[i]]++;
+    for (unsigned c = 0, sum = 0; c < alphabet; c++)
+      sum += bucket[c], bucket[c] = ends ? sum : sum - bucket[c];
+  };
+
+  // Induce the order of L-type and S-type suffixes from the placed LMS suffixes
+  auto induce = [&]() {
+    buckets(false);
+    sa[bucket[text[n - 1]]++] = n - 1;
+    for (unsigned i = 0; i < n; i++)
+      if (sa[i] != EMPTY && sa[i] > 0 && !stype[sa[i] - 1])
+        sa[bucket[text[sa[i] - 1]]++] = sa[i] - 1;
+    buckets(true);
+    for (unsigned i = n; i-- > 0; )
+      if (sa[i] != EMPTY && sa[i] > 0 && stype[sa[i] - 1])
+        sa[--bucket[text[sa[i] - 1]]] = sa[i] - 1;
+  };
 
-  sort(sa.begin(), sa.end(), suffix_comparator);
+  // Sort the LMS substrings by placing the LMS suffixes in text order and inducing
+  fill(sa, sa + n, EMPTY);
+  buckets(true);
+  for (unsigned i = 1; i < n; i++)
+    if (is_lms(i))
+      sa[--bucket[text[i]]] = i;
+  induce();
+
+  // Compact the sorted LMS substrings and name them; as the LMS positions
+  // are at least two apart, the names can be stored at sa[lms + position / 2].
+  unsigned lms = 0;
+  for (unsigned i = 0; i < n; i++)
+    if (is_lms(sa[i]))
+      sa[lms++] = sa[i];
+  fill(sa + lms, sa + n, EMPTY);
+
+  unsigned names = 0;
+  for (unsigned i = 0, previous = EMPTY; i < lms; i++) {
+    unsigned position = sa[i];
+    bool equal = previous != EMPTY;
+    for (unsigned d = 0; equal; d++) {
+      if (position + d == n || previous + d == n ||
+          text[position + d] != text[previous + d] || stype[position + d] != stype[previous + d]) {
+        equal = false;
+      } else if (d > 0 && (is_lms(position + d) || is_lms(previous + d))) {
+        equal = is_lms(position + d) && is_lms(previous + d);
+        break;
+      }
+    }
+    if (!equal) names++;
+    sa[lms + position / 2] = names - 1;
+    previous = position;
+  }
+
+  // Create the reduced string of names in text order at the end of sa,
+  // and sort its suffixes, recursively if the names are not unique.
+  unsigned* reduced = sa + n - lms;
+  for (unsigned i = n, j = n; i-- > lms; )
+    if (sa[i] != EMPTY)
+      sa[--j] = sa[i];
+
+  if (names < lms)
+    sais(reduced, sa, lms, names);
+  else
+    for (unsigned i = 0; i < lms; i++)
+      sa[reduced[i]] = i;
+
+  // Place the sorted LMS suffixes in their buckets and induce the final order
+  for (unsigned i = 1, j = 0; i < n; i++)
+    if (is_lms(i))
+      reduced[j++] = i;
+  for (unsigned i = 0; i < lms; i++)
+    sa[i] = reduced[sa[i]];
+  fill(sa + lms, sa + n, EMPTY);
+
+  buckets(true);
+  for (unsigned i = lms; i-- > 0; ) {
+    unsigned position = sa[i];
+    sa[i] = EMPTY;
+    sa[--bucket[text[position]]] = position;
+  }
+  induce();
+}
+
+detokenizer::suffix_array::suffix_array(const string& str) : str(str), suffix_lower_finder(str), suffix_upper_finder(str) {}
+
+void detokenizer::suffix_array::build() {
+  sa.resize(str.size());
+  sais((const unsigned char*) str.data(), sa.data(), unsigned(str.size()), 256);
 }
 
 unsigned detokenizer::suffix_array::count(const string& data) const {
   auto lower_it = lower_bound(sa.begin(), sa.end(), data, suffix_lower_finder);
-  auto upper_it = upper_bound(sa.begin(), sa.end(), data, suffix_upper_finder);
+  auto upper_it = upper_bound(lower_it, sa.end(), data, suffix_upper_finder);
   return upper_it - lower_it;
 }
 
+size_t detokenizer::suffix_array::memory_usage() const {
+  return sa.size() * sizeof(unsigned);
+}
+
 } // namespace udpipe
 } // namespace ufal
@@ -20,6 +20,7 @@ class detokenizer {
   detokenizer(const string& plain_text);
 
   void detokenize(sentence& s) const;
+  size_t memory_usage() const;
  private:
   enum { LOWERCASE, CATEGORIZE, TOTAL };
 
@@ -35,18 +36,14 @@ class detokenizer {
     suffix_array(const string& str);
     suffix_array(suffix_array&& other) = default;
 
+    void build();
     unsigned count(const string& data) const;
+    size_t memory_usage() const;
 
    private:
+    const string& str;
     vector<unsigned> sa;
 
-    struct suffix_compare {
-      suffix_compare(const string& str) : str(str) {}
-      bool operator()(unsigned a, unsigned b) const { return str.compare(a, string::npos, str, b, string::npos) < 0; }
-     private:
-      const string& str;
-    } suffix_comparator;
-
     struct suffix_lower_find {
       suffix_lower_find(const string& str) : str(str) {}
       bool operator()(unsigned a, const string& data) const { return str.compare(a, data.size(), data) < 0; }
@@ -8,18 +8,25 @@
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include <algorithm>
+#include <atomic>
+#include <thread>
 
 #include "morphodita_tokenizer_wrapper.h"
 #include "unilib/unicode.h"
 #include "unilib/utf8.h"
 #include "utils/getpara.h"
+#include "utils/utf8_ascii.h"
 
 namespace ufal {
 namespace udpipe {
 
 morphodita_tokenizer_wrapper::morphodita_tokenizer_wrapper(morphodita::tokenizer* tokenizer, const multiword_splitter* splitter,
-                                                           bool normalized_spaces, bool token_ranges)
-  : tokenizer(tokenizer), splitter(splitter), normalized_spaces(normalized_spaces), token_ranges(token_ranges) {}
+                                                           bool normalized_spaces, bool token_ranges,
+                                                           vector<morphodita::tokenizer*> parallel_tokenizers)
+  : tokenizer(tokenizer), splitter(splitter), normalized_spaces(normalized_spaces), token_ranges(token_ranges) {
+  for (auto&& parallel_tokenizer : parallel_tokenizers)
+    this->parallel_tokenizers.emplace_back(parallel_tokenizer);
+}
 
 bool morphodita_tokenizer_wrapper::read_block(istream& is, string& block) const {
   return bool(getpara(is, block));
@@ -57,19 +64,26 @@ void morphodita_tokenizer_wrapper::set_text(string_piece text, bool make_copy) {
     text = string_piece(text_copy.c_str(), text_copy.size());
   }
 
-  // Store the text locally and in the morphodita::tokenizer
+  // Store the text locally and in the morphodita::tokenizer, or prepare
+  // it for sharding when tokenizing in parallel
   this->text = text;
-  tokenizer->set_text(this->text, false);
-
+  if (parallel_tokenizers.empty()) {
+    tokenizer->set_text(this->text, false);
+  } else {
+    shards.clear();
+    shard_index = shard_sentence = 0;
+    unsharded = this->text;
+    unsharded_unicode_offset = 0;
+  }
 }
 
 bool morphodita_tokenizer_wrapper::next_sentence(sentence& s, string& error) {
   unsigned following_newlines = 0;
 
-  s.clear();
+  recycler.clear(s);
   error.clear();
 
-  if (tokenizer->next_sentence(&forms, token_ranges ? &tokens : nullptr)) {
+  if (next_tokenized_sentence()) {
     // The forms returned by GRU tokenizer *should not* start/end with spaces,
     // but we trim them anyway (including all "remove empty forms/sentences" machinery).
     for (size_t i = 0; i < forms.size(); i++) {
@@ -95,14 +109,17 @@ bool morphodita_tokenizer_wrapper::next_sentence(sentence& s, string& error) {
           tok.form.push_back(chr);
       }
 
+      // Start with an empty MISC and set only the nondefault fields below
+      tok.misc.clear();
+
       // Track pre-sentence spaces and store SpacesBefore
       if (i == 0) {
         if (forms[0].str > text.str)
           saved_spaces.append(text.str, forms[0].str - text.str);
         preceeding_newlines += count(saved_spaces.begin(), saved_spaces.end(), '\n');
       }
-      if (!normalized_spaces) {
-        tok.set_spaces_before(i == 0 ? saved_spaces : "");
+      if (!normalized_spaces && i == 0 && !saved_spaces.empty()) {
+        tok.set_spaces_before(saved_spaces);
       }
       saved_spaces.clear();
 
@@ -119,10 +136,14 @@ bool morphodita_tokenizer_wrapper::next_sentence(sentence& s, string& error) {
         following_newlines += count(saved_spaces.begin(), saved_spaces.end(), '\n');
       }
       if (normalized_spaces) {
-        tok.set_space_after(i+1 == forms.size() ? !saved_spaces.empty() : forms[i+1].str > forms[i].str + forms[i].len);
+        if (i+1 == forms.size() ? saved_spaces.empty() : forms[i+1].str == forms[i].str + forms[i].len)
+          tok.set_space_after(false);
       } else {
-        tok.set_spaces_in_token(tok.form.size() != forms[i].len ? forms[i] : "");
-        tok.set_spaces_after(i+1 == forms.size() ? saved_spaces : string_piece(forms[i].str + forms[i].len, forms[i+1].str - forms[i].str - forms[i].len));
+        if (tok.form.size() != forms[i].len)
+          tok.set_spaces_in_token(forms[i]);
+        string_piece spaces_after = i+1 == forms.size() ? saved_spaces : string_piece(forms[i].str + forms[i].len, forms[i+1].str - forms[i].str - forms[i].len);
+        if (!(spaces_after.len == 1 && spaces_after.str[0] == ' '))
+          tok.set_spaces_after(spaces_after);
       }
       saved_spaces.clear();
 
@@ -131,9 +152,9 @@ bool morphodita_tokenizer_wrapper::next_sentence(sentence& s, string& error) {
         tok.set_token_range(unicode_offset + tokens[i].start, unicode_offset + tokens[i].start + tokens[i].length);
 
       if (splitter)
-        splitter->append_token(tok.form, tok.misc, s);
+        splitter->append_token(tok.form, tok.misc, s, recycler);
       else
-        s.add_word(tok.form).misc.assign(tok.misc);
+        recycler.add_word(s, tok.form).misc.assign(tok.misc);
     }
 
     // Mark new document if needed
@@ -173,5 +194,86 @@ bool morphodita_tokenizer_wrapper::next_sentence(sentence& s, string& error) {
   return false;
 }
 
+bool morphodita_tokenizer_wrapper::next_tokenized_sentence() {
+  if (parallel_tokenizers.empty())
+    return tokenizer->next_sentence(&forms, token_ranges ? &tokens : nullptr);
+
+  // Find the next sentence of the shards, tokenizing next shards if needed
+  while (true) {
+    while (shard_index < shards.size() && shard_sentence >= shards[shard_index].sentence_ends.size())
+      shard_index++, shard_sentence = 0;
+    if (shard_index < shards.size()) break;
+    if (!unsharded.len) return false;
+    tokenize_shards();
+  }
+
+  auto& shard = shards[shard_index];
+  size_t start = shard_sentence ? shard.sentence_ends[shard_sentence - 1] : 0, end = shard.sentence_ends[shard_sentence++];
+  forms.assign(shard.forms.begin() + start, shard.forms.begin() + end);
+  if (token_ranges) {
+    tokens.clear();
+    for (size_t i = start; i < end; i++)
+      tokens.emplace_back(shard.unicode_offset + shard.tokens[i].start, shard.tokens[i].length);
+  }
+  return true;
+}
+
+void morphodita_tokenizer_wrapper::tokenize_shards() {
+  using namespace unilib;
+
+  // Split the next batch of shards, each consisting of whole paragraphs
+  shards.clear();
+  shard_index = shard_sentence = 0;
+  while (unsharded.len && shards.size() < SHARDS_PER_TOKENIZER * (parallel_tokenizers.size() + 1)) {
+    size_t length = paragraph_length(unsharded, SHARD_MIN_LENGTH);
+
+    shards.emplace_back();
+    shards.back().text = string_piece(unsharded.str, length);
+    shards.back().unicode_offset = unsharded_unicode_offset;
+    unsharded_unicode_offset += utf8_ascii::length(unsharded.str, length);
+    unsharded.str += length;
+    unsharded.len -= length;
+  }
+
+  // Tokenize the shards in parallel
+  atomic<size_t> next_shard(0);
+  auto tokenize = [this, &next_shard](morphodita::tokenizer* tokenizer) {
+    vector<string_piece> forms;
+    vector<morphodita::token_range> tokens;
+    for (size_t i; (i = next_shard++) < shards.size(); ) {
+      auto& shard = shards[i];
+      tokenizer->set_text(shard.text, false);
+      while (tokenizer->next_sentence(&forms, token_ranges ? &tokens : nullptr)) {
+        shard.forms.insert(shard.forms.end(), forms.begin(), forms.end());
+        if (token_ranges) shard.tokens.insert(shard.tokens.end(), tokens.begin(), tokens.end());
+        shard.sentence_ends.push_back(shard.forms.size());
+      }
+    }
+  };
+
+  vector<thread> workers;
+  for (size_t i = 0; i < parallel_tokenizers.size() && i + 1 < shards.size(); i++)
+    workers.emplace_back(tokenize, parallel_tokenizers[i].get());
+  tokenize(tokenizer.get());
+  for (auto&& worker : workers)
+    worker.join();
+}
+
+size_t morphodita_tokenizer_wrapper::paragraph_length(string_piece text, size_t min_length) {
+  using namespace unilib;
+
+  // Find the first paragraph break (\n\n or \r\n\r\n) ending at least
+  // at min_length and return the length up to the end of its whitespace run
+  for (size_t i = min(min_length, text.len) - 1; i + 1 < text.len; i++)
+    if ((text.str[i] == '\n' && text.str[i + 1] == '\n') ||
+        (i + 3 < text.len && text.str[i] == '\r' && text.str[i + 1] == '\n' && text.str[i + 2] == '\r' && text.str[i + 3] == '\n')) {
+      string_piece rest(text.str + i, text.len - i), following;
+      for (char32_t chr; rest.len && (following = rest, chr = utf8::decode(following.str, following.len),
+                                      (unicode::category(chr) & unicode::Zs) || chr == '\r' || chr == '\n' || chr == '\t'); rest = following) {}
+      return rest.str - text.str;
+    }
+  return text.len;
+}
+
 } // namespace udpipe
 } // namespace ufal
@@ -13,13 +13,19 @@
 #include "morphodita/tokenizer/tokenizer.h"
 #include "multiword_splitter.h"
 #include "sentence/input_format.h"
+#include "sentence/word_recycler.h"
 
 namespace ufal {
 namespace udpipe {
 
 class morphodita_tokenizer_wrapper : public input_format {
  public:
-  morphodita_tokenizer_wrapper(morphodita::tokenizer* tokenizer, const multiword_splitter* splitter, bool normalized_spaces, bool token_ranges);
+  // When parallel_tokenizers are given, the text is split at paragraph breaks
+  // into shards, which are tokenized in parallel using the tokenizer and the
+  // parallel_tokenizers. The tokenizers must therefore tokenize every
+  // paragraph independently of the preceding text.
+  morphodita_tokenizer_wrapper(morphodita::tokenizer* tokenizer, const multiword_splitter* splitter, bool normalized_spaces, bool token_ranges,
+                               vector<morphodita::tokenizer*> parallel_tokenizers = {});
 
   virtual bool read_block(istream& is, string& block) const override;
   virtual void reset_document(string_piece id) override;
@@ -38,11 +44,30 @@ class morphodita_tokenizer_wrapper : public input_format {
 
   string_piece text;
   string text_copy;
+  word_recycler recycler;
   size_t unicode_offset = 0, text_unicode_length = 0;
   string saved_spaces;
   vector<string_piece> forms;
   vector<morphodita::token_range> tokens;
   token tok;
+
+  bool next_tokenized_sentence();
+  void tokenize_shards();
+  static size_t paragraph_length(string_piece text, size_t min_length);
+
+  struct shard {
+    string_piece text;
+    size_t unicode_offset;
+    vector<string_piece> forms;
+    vector<morphodita::token_range> tokens;
+    vector<size_t> sentence_ends;
+  };
+  vector<unique_ptr<morphodita::tokenizer>> parallel_tokenizers;
+  vector<shard> shards;
+  size_t shard_index = 0, shard_sentence = 0;
+  string_piece unsharded;
+  size_t unsharded_unicode_offset = 0;
+  enum { SHARD_MIN_LENGTH = 1 << 14, SHARDS_PER_TOKENIZER = 4 };
 };
 
 } // namespace udpipe
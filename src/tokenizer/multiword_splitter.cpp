@@ -8,57 +8,56 @@
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include <algorithm>
+#include <map>
 
 #include "multiword_splitter.h"
 #include "unilib/unicode.h"
 #include "unilib/utf8.h"
 #include "utils/compressor.h"
 #include "utils/binary_decoder.h"
+#include "utils/utf8_ascii.h"
 
 namespace ufal {
 namespace udpipe {
 
-void multiword_splitter::append_token(string_piece token, string_piece misc, sentence& s) const {
+void multiword_splitter::append_token(string_piece token, string_piece misc, sentence& s, word_recycler& recycler) const {
   using namespace unilib;
 
   // Buffer
-  s.add_word();
+  recycler.add_word(s);
   string& buffer = s.words.back().form;
 
   // Lowercase the token
-  utf8::map(unicode::lowercase, token.str, token.len, buffer);
-  reverse(buffer.begin(), buffer.end());
+  utf8_ascii::lowercase(token.str, token.len, buffer);
 
-  // Try finding lowercased version in the full_rules
+  // Walk the trie from the end of the lowercased token, remembering the
+  // longest suffix rule shorter than the token; a full rule takes precedence.
+  int rule = -1;
   size_t prefix_len = 0;
-  auto it = full_rules.find(buffer);
-
-  if (it == full_rules.end()) {
-    if (version >= 2) {
-      string& suffix = s.words.back().misc;
-      // Try searching suffix_rules if needed
-      while (suffix.size() + 1 < buffer.size()) {
-        suffix.push_back(buffer[suffix.size()]);
-
-        auto suffix_it = suffix_rules.find(suffix);
-        if (suffix_it == suffix_rules.end())
-          break;
-
-        if (!suffix_it->second.words.empty()) {
-          it = suffix_it;
-          prefix_len = buffer.size() - suffix.size();
-        }
-      }
-      suffix.clear();
+  unsigned node = 0;
+  for (size_t length = 0; ; length++) {
+    if (length == buffer.size()) {
+      if (nodes[node].full_rule >= 0) rule = nodes[node].full_rule, prefix_len = 0;
+      break;
     }
+    if (length && nodes[node].suffix_rule >= 0)
+      rule = nodes[node].suffix_rule, prefix_len = buffer.size() - length;
+
+    unsigned char byte = buffer[buffer.size() - 1 - length];
+    auto edges_end = edges.begin() + nodes[node].edges_end;
+    auto edge = lower_bound(edges.begin() + nodes[node].edges_start, edges_end, byte,
+                            [](const trie_edge& edge, unsigned char byte) { return edge.byte < byte; });
+    if (edge == edges_end || edge->byte != byte) break;
+    node = edge->node;
+  }
 
-    if (!prefix_len) {
-      // No match
-      s.words.back().form.assign(token.str, token.len);
-      if (misc.len) s.words.back().misc.assign(misc.str, misc.len);
-      return;
-    }
+  if (rule < 0) {
+    // No match
+    s.words.back().form.assign(token.str, token.len);
+    if (misc.len) s.words.back().misc.assign(misc.str, misc.len);
+    return;
   }
+  const vector<string>& words = rules[rule];
 
   // Determine casing
   enum { UPPER_FIRST, UPPER_ALL, UPPER_OTHER }; int casing = UPPER_OTHER;
@@ -70,7 +69,7 @@ void multiword_splitter::append_token(string_piece token, string_piece misc, sen
   }
 
   // Fill the multiword token
-  s.multiword_tokens.emplace_back(s.words.back().id, s.words.back().id + (int)it->second.words.size() - 1, token, misc);
+  s.multiword_tokens.emplace_back(s.words.back().id, s.words.back().id + (int)words.size() - 1, token, misc);
 
   s.words.back().form.clear();
   if (prefix_len) {
@@ -80,15 +79,15 @@ void multiword_splitter::append_token(string_piece token, string_piece misc, sen
       utf8::append(s.words.back().form, unicode::lowercase(utf8::decode(suffix.str, suffix.len)));
     s.words.back().form.assign(token.str, token.len - suffix.len);
   }
-  for (auto&& chr : utf8::decoder(it->second.words[0]))
+  for (auto&& chr : utf8::decoder(words[0]))
     utf8::append(s.words.back().form, casing == UPPER_ALL || (casing == UPPER_FIRST && s.words.back().form.empty()) ? unicode::uppercase(chr) : chr);
 
-  for (size_t i = 1; i < it->second.words.size(); i++)
+  for (size_t i = 1; i < words.size(); i++)
     if (casing != UPPER_ALL) {
-      s.add_word(it->second.words[i]);
+      recycler.add_word(s, words[i]);
     } else {
-      s.add_word();
-      utf8::map(unicode::uppercase, it->second.words[i], s.words.back().form);
+      recycler.add_word(s);
+      utf8::map(unicode::uppercase, words[i], s.words.back().form);
     }
 }
 
@@ -101,44 +100,69 @@ multiword_splitter* multiword_splitter::load(istream& is) {
   if (!compressor::load(is, data)) return nullptr;
 
   unique_ptr<multiword_splitter> splitter(new multiword_splitter(version));
+
+  // Build the trie with children stored in maps first
+  vector<map<unsigned char, unsigned>> children(1);
+  splitter->nodes.push_back({0, 0, -1, -1});
+  auto add_rule = [&](const string& form, bool full) -> vector<string>& {
+    unsigned node = 0;
+    for (size_t i = form.size(); i--; ) {
+      auto it = children[node].find(form[i]);
+      if (it == children[node].end()) {
+        it = children[node].emplace(form[i], unsigned(splitter->nodes.size())).first;
+        children.emplace_back();
+        splitter->nodes.push_back({0, 0, -1, -1});
+      }
+      node = it->second;
+    }
+
+    int& rule = full ? splitter->nodes[node].full_rule : splitter->nodes[node].suffix_rule;
+    if (rule < 0) {
+      rule = int(splitter->rules.size());
+      splitter->rules.emplace_back();
+    }
+    return splitter->rules[rule];
+  };
+
   try {
     for (unsigned full_rules = data.next_4B(); full_rules; full_rules--) {
       string full_rule;
       data.next_str(full_rule);
-      reverse(full_rule.begin(), full_rule.end());
 
       // Add the full_rule and its words
-      auto& info = splitter->full_rules[full_rule];
-      for (unsigned words = data.next_1B(); words; words--) {
-        info.words.emplace_back();
-        data.next_str(info.words.back());
+      auto& words = add_rule(full_rule, true);
+      for (unsigned rule_words = data.next_1B(); rule_words; rule_words--) {
+        words.emplace_back();
+        data.next_str(words.back());
       }
-      if (info.words.empty()) return nullptr;
+      if (words.empty()) return nullptr;
     }
 
     if (version >= 2)
       for (unsigned suffix_rules = data.next_4B(); suffix_rules; suffix_rules--) {
         string suffix_rule;
         data.next_str(suffix_rule);
-        reverse(suffix_rule.begin(), suffix_rule.end());
 
         // Add the suffix_rule and its words
-        auto& info = splitter->suffix_rules[suffix_rule];
-        for (unsigned words = data.next_1B(); words; words--) {
-          info.words.emplace_back();
-          data.next_str(info.words.back());
+        auto& words = add_rule(suffix_rule, false);
+        for (unsigned rule_words = data.next_1B(); rule_words; rule_words--) {
+          words.emplace_back();
+          data.next_str(words.back());
         }
-        if (info.words.empty()) return nullptr;
-
-        // Add prefixes of the suffix with empty data
-        if (!suffix_rule.empty())
-          for (suffix_rule.pop_back(); !suffix_rule.empty(); suffix_rule.pop_back())
-            splitter->suffix_rules[suffix_rule];
+        if (words.empty()) return nullptr;
       }
   } catch (binary_decoder_error&) {
     return nullptr;
   }
 
+  // Store the edges of every node consecutively
+  for (size_t i = 0; i < children.size(); i++) {
+    splitter->nodes[i].edges_start = unsigned(splitter->edges.size());
+    for (auto&& child : children[i])
+      splitter->edges.push_back({child.first, child.second});
+    splitter->nodes[i].edges_end = unsigned(splitter->edges.size());
+  }
+
   return data.is_end() ? splitter.release() : nullptr;
 }
 
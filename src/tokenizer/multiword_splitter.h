@@ -9,10 +9,9 @@
 
 #pragma once
 
-#include <unordered_map>
-
 #include "common.h"
 #include "sentence/sentence.h"
+#include "sentence/word_recycler.h"
 #include "utils/string_piece.h"
 
 namespace ufal {
@@ -20,7 +19,7 @@ namespace udpipe {
 
 class multiword_splitter {
  public:
-  void append_token(string_piece token, string_piece misc, sentence& s) const;
+  void append_token(string_piece token, string_piece misc, sentence& s, word_recycler& recycler) const;
 
   static multiword_splitter* load(istream& is);
 
@@ -30,10 +29,20 @@ class multiword_splitter {
   enum { VERSION_LATEST = 2 };
   friend class multiword_splitter_trainer;
 
-  struct suffix_info {
-    vector<string> words;
+  // The full and suffix rules are stored in a trie of reversed lowercased
+  // forms, so that the longest matching rule is found in a single pass.
+  // The edges of every node are stored consecutively, sorted by their byte.
+  struct trie_node {
+    unsigned edges_start, edges_end;
+    int full_rule, suffix_rule;
+  };
+  struct trie_edge {
+    unsigned char byte;
+    unsigned node;
   };
-  unordered_map<string, suffix_info> full_rules, suffix_rules;
+  vector<trie_node> nodes;
+  vector<trie_edge> edges;
+  vector<vector<string>> rules;
 };
 
 } // namespace udpipe
@@ -0,0 +1,115 @@
+// This file is part of UDPipe <http://github.com/ufal/udpipe/>.
+//
+// Copyright 2026 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+#include "common.h"
+#include "sentence/input_format.h"
+#include "sentence/output_format.h"
+#include "utils/iostreams.h"
+#include "utils/options.h"
+#include "utils/parse_int.h"
+#include "utils/path_from_utf8.h"
+
+using namespace ufal::udpipe;
+
+// Measure the throughput of reading the given files in the given input format
+// and of writing the read sentences in the given output format.
+int main(int argc, char* argv[]) {
+  iostreams_init();
+
+  options::map options;
+  if (!options::parse({{"input", options::value::any},
+                       {"output", options::value::any},
+                       {"repeat", options::value::any},
+                       {"help", options::value::none}}, argc, argv, options) ||
+      options.count("help") ||
+      argc < 2)
+    runtime_failure("Usage: " << argv[0] << " [options] files...\n"
+                    "Options: --input=input format [conllu]\n"
+                    "         --output=output format [conllu, none to skip writing]\n"
+                    "         --repeat=number of repetitions [1]\n"
+                    "         --help");
+
+  string input_name = options.count("input") ? options["input"] : "conllu";
+  string output_name = options.count("output") ? options["output"] : "conllu";
+  int repeat = options.count("repeat") ? parse_int(options["repeat"], "repeat") : 1;
+
+  // Load the files into memory, so that only the formats are measured
+  vector<string> files;
+  size_t input_size = 0;
+  for (int i = 1; i < argc; i++) {
+    ifstream is(path_from_utf8(argv[i]).c_str(), ifstream::in | ifstream::binary);
+    if (!is.is_open()) runtime_failure("Cannot open file '" << argv[i] << "'!");
+    ostringstream data;
+    data << is.rdbuf();
+    files.push_back(data.str());
+    input_size += files.back().size();
+  }
+
+  unique_ptr<input_format> input(input_format::new_input_format(input_name));
+  if (!input) runtime_failure("Unknown input format '" << input_name << "'!");
+  unique_ptr<output_format> output(output_name == "none" ? nullptr : output_format::new_output_format(output_name));
+  if (!output && output_name != "none") runtime_failure("Unknown output format '" << output_name << "'!");
+
+  // Read all sentences, measuring both read_block and next_sentence
+  auto read = [&](vector<sentence>* sentences) {
+    string block, error;
+    sentence s;
+    for (auto&& file : files) {
+      istringstream is(file);
+      input->reset_document();
+      while (input->read_block(is, block)) {
+        input->set_text(block);
+        while (input->next_sentence(s, error))
+          if (sentences) sentences->push_back(s);
+        if (!error.empty()) runtime_failure("Cannot read input: " << error);
+      }
+    }
+  };
+
+  double read_seconds = 0;
+  for (int r = 0; r < repeat; r++) {
+    auto start = chrono::steady_clock::now();
+    read(nullptr);
+    read_seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  }
+
+  vector<sentence> sentences;
+  read(&sentences);
+  size_t words = 0;
+  for (auto&& s : sentences)
+    words += s.words.size() - 1;
+
+  cout << "Read " << sentences.size() << " sentences, " << words << " words, " << fixed << setprecision(2)
+       << input_size / 1048576. << "MB of " << input_name << " in " << read_seconds / repeat << "s: "
+       << repeat * input_size / 1048576. / read_seconds << "MB/s" << endl;
+
+  if (output) {
+    output->set_buffer_size(1 << 16);
+    size_t output_size = 0;
+    double write_seconds = 0;
+    for (int r = 0; r < repeat; r++) {
+      ostringstream os;
+      auto start = chrono::steady_clock::now();
+      for (auto&& s : sentences)
+        output->write_sentence(s, os);
+      output->finish_document(os);
+      write_seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+      output_size = size_t(os.tellp());
+    }
+
+    cout << "Wrote " << output_size / 1048576. << "MB of " << output_name << " in " << write_seconds / repeat << "s: "
+         << repeat * output_size / 1048576. / write_seconds << "MB/s" << endl;
+  }
+
+  return 0;
+}
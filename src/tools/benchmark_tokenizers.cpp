@@ -0,0 +1,106 @@
+// This file is part of UDPipe <http://github.com/ufal/udpipe/>.
+//
+// Copyright 2026 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+#include "common.h"
+#include "model/model.h"
+#include "morphodita/tokenizer/tokenizer.h"
+#include "utils/iostreams.h"
+#include "utils/options.h"
+#include "utils/parse_int.h"
+#include "utils/path_from_utf8.h"
+#include "utils/split.h"
+
+using namespace ufal::udpipe;
+
+// Measure the throughput of the rule-based tokenizers and optionally
+// of a model tokenizer on the given plain text files.
+int main(int argc, char* argv[]) {
+  iostreams_init();
+
+  options::map options;
+  if (!options::parse({{"tokenizers", options::value::any},
+                       {"model", options::value::any},
+                       {"model_tokenizer", options::value::any},
+                       {"repeat", options::value::any},
+                       {"help", options::value::none}}, argc, argv, options) ||
+      options.count("help") ||
+      argc < 2)
+    runtime_failure("Usage: " << argv[0] << " [options] files...\n"
+                    "Options: --tokenizers=comma-separated rule-based tokenizers [generic,english,czech,vertical]\n"
+                    "         --model=measure also the tokenizer of the given model\n"
+                    "         --model_tokenizer=options of the model tokenizer\n"
+                    "         --repeat=number of repetitions [1]\n"
+                    "         --help");
+
+  vector<string> tokenizers;
+  split(options.count("tokenizers") ? options["tokenizers"] : "generic,english,czech,vertical", ',', tokenizers);
+  int repeat = options.count("repeat") ? parse_int(options["repeat"], "repeat") : 1;
+
+  unique_ptr<model> m;
+  if (options.count("model")) {
+    m.reset(model::load(path_from_utf8(options["model"]).c_str()));
+    if (!m) runtime_failure("Cannot load model from file '" << options["model"] << "'!");
+  }
+
+  for (int i = 1; i < argc; i++) {
+    ifstream is(path_from_utf8(argv[i]).c_str(), ifstream::in | ifstream::binary);
+    if (!is.is_open()) runtime_failure("Cannot open file '" << argv[i] << "'!");
+    ostringstream data;
+    data << is.rdbuf();
+    string text = data.str();
+
+    auto report = [&](const string& name, size_t sentences, size_t tokens, double seconds) {
+      cout << argv[i] << ": " << name << " tokenized " << sentences / repeat << " sentences, " << tokens / repeat
+           << " tokens, " << fixed << setprecision(2) << text.size() / 1048576. << "MB in " << seconds / repeat
+           << "s: " << repeat * text.size() / 1048576. / seconds << "MB/s" << endl;
+    };
+
+    for (auto&& name : tokenizers) {
+      unique_ptr<morphodita::tokenizer> tokenizer(name == "generic" ? morphodita::tokenizer::new_generic_tokenizer() :
+                                                  name == "english" ? morphodita::tokenizer::new_english_tokenizer() :
+                                                  name == "czech" ? morphodita::tokenizer::new_czech_tokenizer() :
+                                                  name == "vertical" ? morphodita::tokenizer::new_vertical_tokenizer() : nullptr);
+      if (!tokenizer) runtime_failure("Unknown tokenizer '" << name << "'!");
+
+      vector<string_piece> forms;
+      size_t sentences = 0, tokens = 0;
+      auto start = chrono::steady_clock::now();
+      for (int r = 0; r < repeat; r++) {
+        tokenizer->set_text(text);
+        for (; tokenizer->next_sentence(&forms, nullptr); sentences++)
+          tokens += forms.size();
+      }
+      report(name, sentences, tokens, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+
+    if (m) {
+      unique_ptr<input_format> tokenizer(m->new_tokenizer(options.count("model_tokenizer") ? options["model_tokenizer"] : model::DEFAULT));
+      if (!tokenizer) runtime_failure("Cannot create a tokenizer of the given model!");
+
+      sentence s;
+      string error;
+      size_t sentences = 0, tokens = 0;
+      auto start = chrono::steady_clock::now();
+      for (int r = 0; r < repeat; r++) {
+        tokenizer->reset_document();
+        tokenizer->set_text(text);
+        for (; tokenizer->next_sentence(s, error); sentences++)
+          tokens += s.words.size() - 1;
+        if (!error.empty()) runtime_failure("Cannot tokenize the input: " << error);
+      }
+      report("model", sentences, tokens, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+  }
+
+  return 0;
+}
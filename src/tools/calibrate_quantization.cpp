@@ -0,0 +1,126 @@
+// This file is part of UDPipe <http://github.com/ufal/udpipe/>.
+//
+// Copyright 2026 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <chrono>
+#include <fstream>
+
+#include "common.h"
+#include "model/model.h"
+#include "model/model_morphodita_parsito.h"
+#include "sentence/input_format.h"
+#include "utils/iostreams.h"
+#include "utils/options.h"
+#include "utils/parse_int.h"
+#include "utils/path_from_utf8.h"
+
+using namespace ufal::udpipe;
+
+// Compare the parser with and without the quantized inference on given
+// CoNLL-U files, reporting UAS, LAS and parsing time of both modes.
+struct parser_accuracy {
+  size_t words = 0, correct_unlabelled = 0, correct_labelled = 0;
+  double seconds = 0;
+
+  void add(const sentence& gold, const sentence& system) {
+    for (size_t i = 1; i < gold.words.size(); i++) {
+      words++;
+      correct_unlabelled += gold.words[i].head == system.words[i].head;
+      correct_labelled += gold.words[i].head == system.words[i].head && gold.words[i].deprel == system.words[i].deprel;
+    }
+  }
+  double uas() const { return words ? 100. * correct_unlabelled / words : 0.; }
+  double las() const { return words ? 100. * correct_labelled / words : 0.; }
+};
+
+bool parse_timed(const model& m, sentence& s, const string& options, parser_accuracy& accuracy, string& error) {
+  auto start = chrono::steady_clock::now();
+  bool result = m.parse(s, options, error);
+  accuracy.seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  return result;
+}
+
+int main(int argc, char* argv[]) {
+  iostreams_init();
+
+  options::map options;
+  if (!options::parse({{"embeddings_cache", options::value::any},
+                       {"parser", options::value::any},
+                       {"help", options::value::none}}, argc, argv, options) ||
+      options.count("help") ||
+      argc < 3)
+    runtime_failure("Usage: " << argv[0] << " [options] udpipe_model conllu_files...\n"
+                    "Options: --embeddings_cache=parser embeddings cache [MB] (default 1000 words per embedding)\n"
+                    "         --parser=parser options used in both modes\n"
+                    "         --help");
+
+  cerr << "Loading UDPipe model: " << flush;
+  unique_ptr<model> m(model::load(argv[1]));
+  if (!m) runtime_failure("Cannot load UDPipe model '" << argv[1] << "'!");
+  cerr << "done." << endl;
+
+  auto morphodita_parsito = dynamic_cast<model_morphodita_parsito*>(m.get());
+  if (morphodita_parsito && options.count("embeddings_cache"))
+    morphodita_parsito->set_parser_cache_size(parse_int(options["embeddings_cache"], "embeddings cache"));
+
+  string parser_options = options["parser"];
+  string quantized_options = parser_options;
+  if (!quantized_options.empty()) quantized_options.push_back(';');
+  quantized_options.append("quantized");
+
+  parser_accuracy total_original, total_quantized;
+  for (int file = 2; file < argc; file++) {
+    ifstream is(path_from_utf8(argv[file]).c_str());
+    if (!is.is_open()) runtime_failure("Cannot open CoNLL-U file '" << argv[file] << "'!");
+
+    unique_ptr<input_format> conllu_input(input_format::new_conllu_input_format());
+    parser_accuracy original, quantized;
+    string block, error;
+    sentence gold, system;
+    while (conllu_input->read_block(is, block)) {
+      conllu_input->set_text(block);
+      while (conllu_input->next_sentence(gold, error)) {
+        system = gold;
+        system.unlink_all_words();
+        if (!parse_timed(*m, system, parser_options, original, error))
+          runtime_failure("Cannot parse sentence: " << error);
+        original.add(gold, system);
+
+        system.unlink_all_words();
+        if (!parse_timed(*m, system, quantized_options, quantized, error))
+          runtime_failure("Cannot parse sentence: " << error);
+        quantized.add(gold, system);
+      }
+      if (!error.empty()) runtime_failure("Cannot read CoNLL-U file '" << argv[file] << "': " << error);
+    }
+
+    cout << argv[file] << ": " << original.words << " words, original UAS " << fixed << setprecision(2) << original.uas()
+         << "%, LAS " << original.las() << "%, " << original.seconds << "s; quantized UAS " << quantized.uas()
+         << "%, LAS " << quantized.las() << "%, " << quantized.seconds << "s; LAS difference "
+         << showpos << quantized.las() - original.las() << noshowpos << "%" << endl;
+
+    total_original.words += original.words; total_quantized.words += quantized.words;
+    total_original.correct_unlabelled += original.correct_unlabelled; total_quantized.correct_unlabelled += quantized.correct_unlabelled;
+    total_original.correct_labelled += original.correct_labelled; total_quantized.correct_labelled += quantized.correct_labelled;
+    total_original.seconds += original.seconds; total_quantized.seconds += quantized.seconds;
+  }
+
+  if (argc > 3)
+    cout << "Total: " << total_original.words << " words, original UAS " << fixed << setprecision(2) << total_original.uas()
+         << "%, LAS " << total_original.las() << "%, " << total_original.seconds << "s; quantized UAS " << total_quantized.uas()
+         << "%, LAS " << total_quantized.las() << "%, " << total_quantized.seconds << "s; LAS difference "
+         << showpos << total_quantized.las() - total_original.las() << noshowpos << "%" << endl;
+
+  parsito::parser::cache_statistics cache;
+  if (morphodita_parsito && morphodita_parsito->parser_cache_statistics(cache))
+    cout << "Embeddings cache: " << cache.entries << " entries using " << fixed << setprecision(2) << cache.memory / 1048576.
+         << "MB (limit " << cache.memory_limit / 1048576. << "MB), hit rate "
+         << (cache.lookups ? 100. * cache.hits / cache.lookups : 0.) << "%" << endl;
+
+  return 0;
+}
@@ -181,6 +181,7 @@ bool trainer_morphodita_parsito::train_tokenizer(const vector<sentence>& trainin
         double dropout = 0.1; if (!option_double(tokenizer, "dropout", dropout, error)) return false;
         double initialization_range = 0.5; if (!option_double(tokenizer, "initialization_range", initialization_range, error)) return false;
         bool early_stopping = !heldout_sentences.empty(); if (!option_bool(tokenizer, "early_stopping", early_stopping, error)) return false;
+        bool heldout_overlap = false; if (!option_bool(tokenizer, "heldout_overlap", heldout_overlap, error)) return false;
 
         if (run >= 1) cerr << "Random search run " << run << ", batch_size=" << batch_size
                            << ", learning_rate=" << fixed << setprecision(8) << learning_rate << endl;
@@ -189,14 +190,15 @@ bool trainer_morphodita_parsito::train_tokenizer(const vector<sentence>& trainin
              << ", allow_spaces=" << (allow_spaces ? 1 : 0) << ", dimension=" << dimension << endl
              << "  epochs=" << epochs << ", batch_size=" << batch_size << ", segment_size=" << segment_size
              << ", learning_rate=" << fixed << setprecision(4) << learning_rate << ", learning_rate_final=" << learning_rate_final << endl
-             << "  dropout=" << dropout << ", early_stopping=" << (early_stopping ? 1 : 0) << endl;
+             << "  dropout=" << dropout << ", early_stopping=" << (early_stopping ? 1 : 0)
+             << ", heldout_overlap=" << (heldout_overlap ? 1 : 0) << endl;
 
         // Train and encode gru_tokenizer
         os.put(morphodita::tokenizer_ids::GRU);
         if (!morphodita::gru_tokenizer_trainer::train(tokenize_url ? morphodita::gru_tokenizer_trainer::URL_EMAIL_LATEST : 0,
                                                       segment_size, allow_spaces, dimension, epochs, batch_size, learning_rate,
                                                       learning_rate_final, dropout, initialization_range, early_stopping,
-                                                      sentences, heldout_sentences, os, error))
+                                                      heldout_overlap, sentences, heldout_sentences, os, error))
           return false;
       } else {
         return error.assign("Unknown tokenizer model '").append(model).append("'!"), false;
@@ -330,6 +332,9 @@ bool trainer_morphodita_parsito::train_parser(const vector<sentence>& training,
       double l2 = run <= 1 ? 0.5 : hyperparameter_uniform(run, 3, 0.2, 0.6);
       if (!option_double(parser, "l2", l2, error)) return false;
       bool early_stopping = !heldout.empty(); if (!option_bool(parser, "early_stopping", early_stopping, error)) return false;
+      int heldout_threads = 1; if (!option_int(parser, "heldout_threads", heldout_threads, error)) return false;
+      if (heldout_threads < 1) return error.assign("The parser heldout_threads must be positive!"), false;
+      bool heldout_overlap = false; if (!option_bool(parser, "heldout_overlap", heldout_overlap, error)) return false;
 
       if (run >= 1) cerr << "Random search run " << run << ", structured_interval=" << structured_interval
                          << ", learning_rate=" << fixed << setprecision(8) << learning_rate
@@ -354,6 +359,7 @@ bool trainer_morphodita_parsito::train_parser(const vector<sentence>& training,
       parameters.dropout_hidden = 0;
       parameters.dropout_input = 0;
       parameters.early_stopping = early_stopping;
+      parameters.heldout_overlap = heldout_overlap;
 
       // Tag the input if required
       unique_ptr<model> tagger;
@@ -413,13 +419,14 @@ bool trainer_morphodita_parsito::train_parser(const vector<sentence>& training,
            << "  lemma mincount=" << embedding_lemma_mincount << ", precomputed lemma embeddings=" << (parser["embedding_lemma_file"].empty() ? "none" : parser["embedding_lemma_file"]) << endl
            << "Parser network options: iterations=" << iterations << ", hidden_layer=" << hidden_layer << ", batch_size=" << batch_size << "," << endl
            << "  learning_rate=" << fixed << setprecision(4) << learning_rate << ", learning_rate_final=" << learning_rate_final
-           << ", l2=" << l2 << ", early_stopping=" << (early_stopping ? 1 : 0) << endl;
+           << ", l2=" << l2 << ", early_stopping=" << (early_stopping ? 1 : 0) << endl
+           << "Parser heldout evaluation options: heldout_threads=" << heldout_threads << ", heldout_overlap=" << (heldout_overlap ? 1 : 0) << endl;
 
       // Train the parser
       binary_encoder enc;
       enc.add_str("nn_versioned");
       parsito::parser_nn_trainer::train(transition_system, transition_oracle, single_root, embeddings, parser_nodes,
-                                        parameters, 1, train_trees, heldout_trees, enc);
+                                        parameters, heldout_threads, train_trees, heldout_trees, enc);
       compressor::save(os, enc);
     }
   }
@@ -759,6 +766,9 @@ bool trainer_morphodita_parsito::train_tagger_model(const vector<sentence>& trai
   int tagger_iterations = 20; if (!option_int(tagger, "iterations", tagger_iterations, error, model)) return false;
   bool tagger_prune_features = false; if (!option_bool(tagger, "prune_features", tagger_prune_features, error, model)) return false;
   bool tagger_early_stopping = true; if (!option_bool(tagger, "early_stopping", tagger_early_stopping, error, model)) return false;
+  int tagger_heldout_threads = 1; if (!option_int(tagger, "heldout_threads", tagger_heldout_threads, error, model)) return false;
+  if (tagger_heldout_threads < 1) return error.assign("The tagger heldout_threads must be positive!"), false;
+  bool tagger_heldout_overlap = false; if (!option_bool(tagger, "heldout_overlap", tagger_heldout_overlap, error, model)) return false;
   const string& tagger_feature_templates =
       option_str(tagger, "templates", model) == "tagger" ? tagger_features_tagger :
       option_str(tagger, "templates", model) == "lemmatizer" ? tagger_features_lemmatizer :
@@ -767,7 +777,8 @@ bool trainer_morphodita_parsito::train_tagger_model(const vector<sentence>& trai
   if (heldout.empty()) tagger_early_stopping = false;
 
   cerr << "Tagger model " << model+1 << " options: iterations=" << tagger_iterations
-       << ", early_stopping=" << (tagger_early_stopping ? 1 : 0) << ", templates="
+       << ", early_stopping=" << (tagger_early_stopping ? 1 : 0) << ", heldout_threads=" << tagger_heldout_threads
+       << ", heldout_overlap=" << (tagger_heldout_overlap ? 1 : 0) << ", templates="
        << (tagger_feature_templates == tagger_features_tagger ? "tagger" :
            tagger_feature_templates == tagger_features_lemmatizer ? "lemmatizer" : "custom") << endl;
 
@@ -791,7 +802,7 @@ bool trainer_morphodita_parsito::train_tagger_model(const vector<sentence>& trai
   }
 
   os.put(tagger_id);
-  morphodita::tagger_trainer<morphodita::perceptron_tagger_trainer<morphodita::train_feature_sequences<morphodita::conllu_elementary_features>>>::train(morphodita::tagger_ids::decoding_order(tagger_id), morphodita::tagger_ids::window_size(tagger_id), tagger_iterations, morpho_description, true, feature_templates_input, tagger_prune_features, input, heldout_input, tagger_early_stopping, os);
+  morphodita::tagger_trainer<morphodita::perceptron_tagger_trainer<morphodita::train_feature_sequences<morphodita::conllu_elementary_features>>>::train(morphodita::tagger_ids::decoding_order(tagger_id), morphodita::tagger_ids::window_size(tagger_id), tagger_iterations, morpho_description, true, feature_templates_input, tagger_prune_features, input, heldout_input, tagger_early_stopping, tagger_heldout_threads, tagger_heldout_overlap, os);
 
   return true;
 }
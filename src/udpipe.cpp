@@ -21,6 +21,7 @@
 #include "utils/getpara.h"
 #include "utils/iostreams.h"
 #include "utils/options.h"
+#include "utils/parse_int.h"
 #include "utils/path_from_utf8.h"
 #include "utils/process_args.h"
 #include "version/version.h"
@@ -56,6 +57,7 @@ int main(int argc, char* argv[]) {
                        {"parser", options::value::any},
                        {"tag", options::value::none},
                        {"tagger", options::value::any},
+                       {"threads", options::value::any},
                        {"tokenize", options::value::none},
                        {"tokenizer", options::value::any},
                        {"train", options::value::none},
@@ -67,16 +69,17 @@ int main(int argc, char* argv[]) {
                     "       " << argv[0] << " --train [training_opts] model_file [input_files]\n"
                     "       " << argv[0] << " --detokenize [detokenize_opts] raw_text_file [input_files]\n"
                     "Running opts: --accuracy (measure accuracy only)\n"
-                    "              --input=[conllu|generic_tokenizer|horizontal|vertical]\n"
+                    "              --input=[binary|conllu|generic_tokenizer|horizontal|vertical]\n"
                     "              --immediate (process sentences immediately during loading)\n"
                     "              --outfile=output file template\n"
-                    "              --output=[conllu|epe|matxin|horizontal|plaintext|vertical]\n"
+                    "              --output=[binary|conllu|epe|matxin|horizontal|plaintext|vertical]\n"
                     "              --tokenize (perform tokenization)\n"
                     "              --tokenizer=tokenizer options, implies --tokenize\n"
                     "              --tag (perform tagging)\n"
                     "              --tagger=tagger options, implies --tag\n"
                     "              --parse (perform parsing)\n"
                     "              --parser=parser options, implies --parse\n"
+                    "              --threads=number of threads used by --accuracy [1]\n"
                     "Training opts: --method=[morphodita_parsito] which method to use\n"
                     "               --heldout=heldout data file name\n"
                     "               --tokenizer=tokenizer options\n"
@@ -130,15 +133,17 @@ int main(int argc, char* argv[]) {
     ifstream raw_text_file(path_from_utf8(argv[1]).c_str());
     if (!raw_text_file.is_open()) runtime_failure("Cannot load raw text from file '" << argv[1] << "'.");
 
-    string raw_text;
-    for (char c; raw_text_file.get(c); )
-      raw_text.push_back(c);
+    cerr << "Loading detokenizer raw text: " << flush;
+    ostringstream raw_text;
+    raw_text << raw_text_file.rdbuf();
     raw_text_file.close();
 
-    detokenizer detokenizer(raw_text);
+    detokenizer detokenizer(raw_text.str());
+    cerr << "done, using " << detokenizer.memory_usage() / 1048576 << "MB of memory." << endl;
     process_args_with_output_template(2, argc, argv, options["outfile"], [&detokenizer](istream& is, ostream& os, string, string) {
       unique_ptr<input_format> conllu_input(input_format::new_conllu_input_format());
       unique_ptr<output_format> conllu_output(output_format::new_conllu_output_format());
+      conllu_output->set_buffer_size(1 << 16);
 
       sentence s;
       string block, error;
@@ -148,7 +153,7 @@ int main(int argc, char* argv[]) {
           detokenizer.detokenize(s);
           conllu_output->write_sentence(s, os);
         }
-        if (!error.empty()) runtime_failure("An error occurred during UDPipe execution: " << error);
+        if (!error.empty()) { conllu_output->flush(os); runtime_failure("An error occurred during UDPipe execution: " << error); }
       }
       conllu_output->finish_document(os);
     });
@@ -175,6 +180,11 @@ int main(int argc, char* argv[]) {
       evaluator evaluator(model.get(), options.count("tokenizer") ? options["tokenizer"] : options.count("tokenize") ? pipeline::DEFAULT : pipeline::NONE,
                           options.count("tagger") ? options["tagger"] : options.count("tag") ? pipeline::DEFAULT : pipeline::NONE,
                           options.count("parser") ? options["parser"] : options.count("parse") ? pipeline::DEFAULT : pipeline::NONE);
+      if (options.count("threads")) {
+        int threads = parse_int(options["threads"], "threads");
+        if (threads < 1) runtime_failure("The number of threads must be positive!");
+        evaluator.set_threads(threads);
+      }
 
       // Process the data
       process_args_with_output_template(2, argc, argv, options["outfile"], [&evaluator](istream& is, ostream& os, string, string) {
@@ -10,9 +10,12 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <functional>
 #include <mutex>
-#include <queue>
+#include <thread>
 
 #include "common.h"
 
@@ -24,36 +27,87 @@ namespace utils {
 // Declarations
 //
 
+// Loader of resources keeping at most concurrent_limit of them loaded, and
+// optionally also keeping their total memory under memory_limit. When room
+// is needed, the least recently used resources which are not in use and not
+// pinned are released. Different resources are loaded in parallel; waiting
+// requests are served in FIFO order, but a request which fits may bypass
+// the first waiting one a limited number of times. Optionally, the resources
+// frequently requested recently are prefetched by a background thread.
 template <class T>
 class threadsafe_resource_loader {
  public:
-  threadsafe_resource_loader(unsigned concurrent_limit) : concurrent_limit(concurrent_limit) {}
+  threadsafe_resource_loader(unsigned concurrent_limit, size_t memory_limit = 0)
+      : concurrent_limit(concurrent_limit), memory_limit(memory_limit) {}
   ~threadsafe_resource_loader();
 
-  unsigned add(T* resource);
+  unsigned add(T* resource, size_t memory = 0);
+  void pin(unsigned id);
+  void start_prefetching();
 
   T* load(unsigned id);
   void release(unsigned id);
 
+  struct statistics {
+    unsigned concurrent_limit, loaded, used;
+    size_t memory, memory_limit;
+    size_t loads, load_failures, evictions, prefetches, waits, saturated_waits;
+    double load_seconds, wait_seconds;
+  };
+  struct resource_statistics {
+    bool loaded, pinned;
+    unsigned used_count;
+    size_t memory, loads, evictions;
+  };
+  void get_statistics(statistics& stats, vector<resource_statistics>* resources_stats = nullptr);
+
  private:
   unsigned concurrent_limit;
+  size_t memory_limit;
 
   struct resource_info {
     enum resource_state { NOT_LOADED, LOADING, LOADED};
 
     T* resource;
+    size_t memory;
     unsigned used_count;
     resource_state state;
+    bool pinned;
+    unsigned requests;
+    size_t loads, evictions;
 
-    resource_info(T* resource) : resource(resource), used_count(0), state(NOT_LOADED) {}
+    resource_info(T* resource, size_t memory)
+        : resource(resource), memory(memory), used_count(0), state(NOT_LOADED), pinned(false), requests(0), loads(0), evictions(0) {}
   };
   vector<resource_info> resources;
-  vector<unsigned> loaded_resources;
+  vector<unsigned> loaded_resources; // loaded or loading, least recently used first
+  size_t loaded_memory = 0;
   unsigned used_resources = 0;
-  queue<unsigned> queued_resources;
+  deque<unsigned> queued_resources;
+  unsigned queue_bypasses = 0;
+
+  bool evictable(unsigned id) const;
+  bool fits(unsigned id) const;
+  bool admissible(unsigned id) const;
+  void make_room(unsigned id);
+  void evict(size_t index);
+  bool load_resource(unique_lock<mutex>& lock, unsigned id);
+
+  unsigned requests = 0;
+  void observe_request(unsigned id);
+
+  thread prefetcher;
+  bool stopping = false;
+  void prefetch();
+
+  size_t load_failures = 0, prefetches = 0, waits = 0, saturated_waits = 0;
+  double load_seconds = 0, wait_seconds = 0;
+  void wait(unique_lock<mutex>& lock, bool saturated, const function<bool()>& done);
 
   mutex resource_mutex;
-  condition_variable resource_cv;
+  condition_variable resource_cv, prefetch_cv;
+
+  enum { REQUESTS_DECAY_INTERVAL = 256 };
 };
 
 //
@@ -62,6 +116,15 @@ class threadsafe_resource_loader {
 
 template <class T>
 threadsafe_resource_loader<T>::~threadsafe_resource_loader() {
+  if (prefetcher.joinable()) {
+    {
+      unique_lock<mutex> lock(resource_mutex);
+      stopping = true;
+    }
+    prefetch_cv.notify_all();
+    prefetcher.join();
+  }
+
   unique_lock<mutex> lock(resource_mutex);
 
   for (auto&& loaded_resource : loaded_resources)
@@ -72,74 +135,60 @@ threadsafe_resource_loader<T>::~threadsafe_resource_loader() {
 }
 
 template <class T>
-unsigned threadsafe_resource_loader<T>::add(T* resource) {
-  resources.push_back(resource);
+unsigned threadsafe_resource_loader<T>::add(T* resource, size_t memory) {
+  resources.emplace_back(resource, memory);
   return resources.size() - 1;
 }
 
 template <class T>
-T* threadsafe_resource_loader<T>::load(unsigned id) {
+void threadsafe_resource_loader<T>::pin(unsigned id) {
   if (id < resources.size()) {
     unique_lock<mutex> lock(resource_mutex);
+    resources[id].pinned = true;
+  }
+}
 
-    if (!resources[id].used_count++) {
-      if (resources[id].state == resource_info::LOADED) {
-        loaded_resources.erase(remove(loaded_resources.begin(), loaded_resources.end(), id), loaded_resources.end());
-        loaded_resources.push_back(id);
-        used_resources++;
-        return resources[id].resource;
-      }
+template <class T>
+void threadsafe_resource_loader<T>::start_prefetching() {
+  if (!prefetcher.joinable())
+    prefetcher = thread(&threadsafe_resource_loader<T>::prefetch, this);
+}
 
-      // Load the resource
-      resources[id].state = resource_info::LOADING;
-      queued_resources.push(id);
-      while (used_resources >= concurrent_limit || queued_resources.front() != id)
-        resource_cv.wait(lock);
-
-      queued_resources.pop();
-      if (loaded_resources.size() == concurrent_limit)
-        for (size_t i = 0; i < loaded_resources.size(); i++)
-          if (!resources[loaded_resources[i]].used_count) {
-            resources[loaded_resources[i]].resource->release();
-            resources[loaded_resources[i]].state = resource_info::NOT_LOADED;
-            loaded_resources.erase(loaded_resources.begin() + i);
-            break;
-          }
-      loaded_resources.push_back(id);
-      used_resources++;
+template <class T>
+T* threadsafe_resource_loader<T>::load(unsigned id) {
+  if (id < resources.size()) {
+    unique_lock<mutex> lock(resource_mutex);
 
-      lock.unlock();
-      bool loaded = resources[id].resource->load();
-      lock.lock();
+    auto& resource = resources[id];
+    observe_request(id);
+    if (!resource.used_count++) used_resources++;
 
-      if (loaded) {
-        resources[id].state = resource_info::LOADED;
-      } else {
-        resources[id].state = resource_info::NOT_LOADED;
-        resources[id].used_count--;
-        used_resources--;
-        loaded_resources.erase(remove(loaded_resources.begin(), loaded_resources.end(), id), loaded_resources.end());
-      }
+    if (resource.state == resource_info::NOT_LOADED) {
+      // Wait until there is room for the resource and load it
+      resource.state = resource_info::LOADING;
+      queued_resources.push_back(id);
+      wait(lock, !fits(id), [this, id]{ return admissible(id); });
 
-      lock.unlock();
-      resource_cv.notify_all();
+      if (queued_resources.front() == id) queue_bypasses = 0; else queue_bypasses++;
+      queued_resources.erase(find(queued_resources.begin(), queued_resources.end(), id));
+      if (!queued_resources.empty()) resource_cv.notify_all();
 
-      return loaded ? resources[id].resource : nullptr;
+      make_room(id);
+      load_resource(lock, id);
+      prefetch_cv.notify_all();
     } else {
-      // Wait until the model is loaded if required
-      while (resources[id].state == resource_info::LOADING)
-        resource_cv.wait(lock);
-
-      if (resources[id].state == resource_info::LOADED) {
-        // Move the resource to the end of the resource_queue
-        loaded_resources.erase(remove(loaded_resources.begin(), loaded_resources.end(), id), loaded_resources.end());
-        loaded_resources.push_back(id);
-      } else {
-        resources[id].used_count--;
-      }
+      // Wait until the resource is loaded if required
+      wait(lock, false, [this, id]{ return resources[id].state != resource_info::LOADING; });
+    }
 
-      return resources[id].state == resource_info::LOADED ? resources[id].resource : nullptr;
+    if (resource.state == resource_info::LOADED) {
+      // Move the resource to the end of the loaded_resources
+      loaded_resources.erase(find(loaded_resources.begin(), loaded_resources.end(), id));
+      loaded_resources.push_back(id);
+      return resource.resource;
     }
+
+    if (!--resource.used_count) used_resources--;
   }
 
   return nullptr;
@@ -153,14 +202,188 @@ void threadsafe_resource_loader<T>::release(unsigned id) {
     unique_lock<mutex> lock(resource_mutex);
 
     if (resources[id].used_count)
-      if (!--resources[id].used_count)
-        notify_all = used_resources-- == concurrent_limit;
+      if (!--resources[id].used_count) {
+        used_resources--;
+        notify_all = !queued_resources.empty();
+      }
   }
 
   if (notify_all)
     resource_cv.notify_all();
 }
 
+template <class T>
+void threadsafe_resource_loader<T>::get_statistics(statistics& stats, vector<resource_statistics>* resources_stats) {
+  unique_lock<mutex> lock(resource_mutex);
+
+  stats.concurrent_limit = concurrent_limit;
+  stats.loaded = loaded_resources.size();
+  stats.used = used_resources;
+  stats.memory = loaded_memory;
+  stats.memory_limit = memory_limit;
+  stats.loads = 0;
+  stats.evictions = 0;
+  for (auto&& resource : resources) {
+    stats.loads += resource.loads;
+    stats.evictions += resource.evictions;
+  }
+  stats.load_failures = load_failures;
+  stats.prefetches = prefetches;
+  stats.waits = waits;
+  stats.saturated_waits = saturated_waits;
+  stats.load_seconds = load_seconds;
+  stats.wait_seconds = wait_seconds;
+
+  if (resources_stats) {
+    resources_stats->clear();
+    for (auto&& resource : resources)
+      resources_stats->push_back({resource.state == resource_info::LOADED, resource.pinned, resource.used_count,
+                                  resource.memory, resource.loads, resource.evictions});
+  }
+}
+
+template <class T>
+bool threadsafe_resource_loader<T>::evictable(unsigned id) const {
+  return !resources[id].used_count && !resources[id].pinned && resources[id].state == resource_info::LOADED;
+}
+
+template <class T>
+bool threadsafe_resource_loader<T>::fits(unsigned id) const {
+  // Check that the resource fits after releasing all evictable resources.
+  // If only pinned resources remain, waiting would not help, so the limits
+  // are exceeded in that case.
+  unsigned count = 1;
+  size_t memory = resources[id].memory;
+  bool only_pinned = true;
+  for (auto&& loaded_resource : loaded_resources)
+    if (!evictable(loaded_resource)) {
+      count++;
+      memory += resources[loaded_resource].memory;
+      only_pinned &= resources[loaded_resource].pinned && !resources[loaded_resource].used_count &&
+          resources[loaded_resource].state == resource_info::LOADED;
+    }
+
+  return only_pinned || (count <= concurrent_limit && (!memory_limit || memory <= memory_limit));
+}
+
+template <class T>
+bool threadsafe_resource_loader<T>::admissible(unsigned id) const {
+  return fits(id) && (queued_resources.front() == id || queue_bypasses < concurrent_limit);
+}
+
+template <class T>
+void threadsafe_resource_loader<T>::make_room(unsigned id) {
+  for (size_t i = 0; i < loaded_resources.size() && (loaded_resources.size() >= concurrent_limit ||
+       (memory_limit && loaded_memory + resources[id].memory > memory_limit)); )
+    if (evictable(loaded_resources[i]))
+      evict(i);
+    else
+      i++;
+}
+
+template <class T>
+void threadsafe_resource_loader<T>::evict(size_t index) {
+  auto& resource = resources[loaded_resources[index]];
+  resource.resource->release();
+  resource.state = resource_info::NOT_LOADED;
+  resource.evictions++;
+  loaded_memory -= resource.memory;
+  loaded_resources.erase(loaded_resources.begin() + index);
+}
+
+template <class T>
+bool threadsafe_resource_loader<T>::load_resource(unique_lock<mutex>& lock, unsigned id) {
+  auto& resource = resources[id];
+  resource.state = resource_info::LOADING;
+  loaded_resources.push_back(id);
+  loaded_memory += resource.memory;
+
+  lock.unlock();
+  auto load_start = chrono::steady_clock::now();
+  bool loaded = resource.resource->load();
+  auto load_end = chrono::steady_clock::now();
+  lock.lock();
+
+  load_seconds += chrono::duration<double>(load_end - load_start).count();
+  if (loaded) {
+    resource.state = resource_info::LOADED;
+    resource.loads++;
+  } else {
+    resource.state = resource_info::NOT_LOADED;
+    load_failures++;
+    loaded_memory -= resource.memory;
+    loaded_resources.erase(find(loaded_resources.begin(), loaded_resources.end(), id));
+  }
+
+  lock.unlock();
+  resource_cv.notify_all();
+  lock.lock();
+
+  return loaded;
+}
+
+template <class T>
+void threadsafe_resource_loader<T>::observe_request(unsigned id) {
+  resources[id].requests++;
+  if (++requests >= REQUESTS_DECAY_INTERVAL) {
+    for (auto&& resource : resources)
+      resource.requests /= 2;
+    requests = 0;
+  }
+}
+
+template <class T>
+void threadsafe_resource_loader<T>::prefetch() {
+  unique_lock<mutex> lock(resource_mutex);
+  while (!stopping) {
+    prefetch_cv.wait_for(lock, chrono::seconds(1));
+    if (stopping) break;
+
+    // Requests waiting for a resource have priority
+    if (!queued_resources.empty()) continue;
+
+    // Find the most requested resource which is not loaded
+    unsigned candidate = resources.size();
+    for (unsigned i = 0; i < resources.size(); i++)
+      if (resources[i].state == resource_info::NOT_LOADED && resources[i].requests &&
+          (candidate == resources.size() || resources[i].requests > resources[candidate].requests))
+        candidate = i;
+    if (candidate == resources.size()) continue;
+
+    // Load it if there is free room, possibly releasing a much less requested resource
+    auto free_room = [this, candidate] {
+      return loaded_resources.size() < concurrent_limit && (!memory_limit || loaded_memory + resources[candidate].memory <= memory_limit);
+    };
+    if (!free_room()) {
+      size_t victim = loaded_resources.size();
+      for (size_t i = 0; i < loaded_resources.size(); i++)
+        if (evictable(loaded_resources[i]) &&
+            (victim == loaded_resources.size() || resources[loaded_resources[i]].requests < resources[loaded_resources[victim]].requests))
+          victim = i;
+      if (victim == loaded_resources.size() || 2 * resources[loaded_resources[victim]].requests >= resources[candidate].requests) continue;
+      if (loaded_resources.size() - 1 >= concurrent_limit ||
+          (memory_limit && loaded_memory - resources[loaded_resources[victim]].memory + resources[candidate].memory > memory_limit)) continue;
+      evict(victim);
+    }
+
+    if (load_resource(lock, candidate))
+      prefetches++;
+  }
+}
+
+template <class T>
+void threadsafe_resource_loader<T>::wait(unique_lock<mutex>& lock, bool saturated, const function<bool()>& done) {
+  if (done()) return;
+
+  auto wait_start = chrono::steady_clock::now();
+  while (!done())
+    resource_cv.wait(lock);
+
+  waits++;
+  if (saturated) saturated_waits++;
+  wait_seconds += chrono::duration<double>(chrono::steady_clock::now() - wait_start).count();
+}
+
 } // namespace utils
 } // namespace udpipe
 } // namespace ufal
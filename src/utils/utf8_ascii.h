@@ -0,0 +1,117 @@
+// This file is part of UDPipe <http://github.com/ufal/udpipe/>.
+//
+// Copyright 2026 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <cstring>
+
+#include "common.h"
+#include "unilib/unicode.h"
+#include "unilib/utf8.h"
+
+namespace ufal {
+namespace udpipe {
+namespace utils {
+
+// UTF-8 processing with a fast path for runs of ASCII characters, which
+// are handled without the per-character decoding of unilib::utf8. As in
+// unilib::utf8, the overloads taking a string stop at the first null byte.
+class utf8_ascii {
+ public:
+  // Length of the prefix consisting of ASCII characters only
+  static inline size_t prefix(const char* str, size_t len);
+
+  // Number of characters of a valid UTF-8 string
+  static inline size_t length(const char* str, size_t len);
+  static inline size_t length(const string& str);
+
+  static inline void decode(const char* str, size_t len, u32string& decoded);
+  static inline void decode(const string& str, u32string& decoded);
+
+  // Equivalent to utf8::map with unicode::lowercase
+  static inline void lowercase(const char* str, size_t len, string& lowercased);
+  static inline void lowercase(const string& str, string& lowercased);
+
+  // Equivalents of unicode::category and unicode::lowercase on arrays
+  static inline void category(const char32_t* chrs, size_t len, unilib::unicode::category_t* categories);
+  static inline void lowercase(const char32_t* chrs, size_t len, char32_t* lowercased);
+};
+
+size_t utf8_ascii::prefix(const char* str, size_t len) {
+  // Examine eight bytes at a time first. The ASCII runs are mostly short,
+  // so wider SIMD loads do not speed up the callers.
+  size_t prefix = 0;
+  for (uint64_t block; prefix + 8 <= len; prefix += 8) {
+    memcpy(&block, str + prefix, 8);
+    if (block & 0x8080808080808080ULL) break;
+  }
+  while (prefix < len && ((unsigned char)str[prefix]) < 0x80) prefix++;
+  return prefix;
+}
+
+size_t utf8_ascii::length(const char* str, size_t len) {
+  size_t length = 0;
+  while (len) {
+    size_t ascii = prefix(str, len);
+    str += ascii; len -= ascii; length += ascii;
+    if (len) unilib::utf8::decode(str, len), length++;
+  }
+  return length;
+}
+
+size_t utf8_ascii::length(const string& str) {
+  return length(str.c_str(), strlen(str.c_str()));
+}
+
+void utf8_ascii::decode(const char* str, size_t len, u32string& decoded) {
+  decoded.clear();
+
+  while (len) {
+    for (size_t ascii = prefix(str, len); ascii; ascii--, len--)
+      decoded.push_back((unsigned char)*str++);
+    if (len) decoded.push_back(unilib::utf8::decode(str, len));
+  }
+}
+
+void utf8_ascii::decode(const string& str, u32string& decoded) {
+  decode(str.c_str(), strlen(str.c_str()), decoded);
+}
+
+void utf8_ascii::lowercase(const char* str, size_t len, string& lowercased) {
+  lowercased.clear();
+
+  while (len) {
+    for (size_t ascii = prefix(str, len); ascii; ascii--, len--, str++)
+      lowercased.push_back(*str >= 'A' && *str <= 'Z' ? *str + ('a' - 'A') : *str);
+    if (len) unilib::utf8::append(lowercased, unilib::unicode::lowercase(unilib::utf8::decode(str, len)));
+  }
+}
+
+void utf8_ascii::lowercase(const string& str, string& lowercased) {
+  lowercase(str.c_str(), strlen(str.c_str()), lowercased);
+}
+
+void utf8_ascii::category(const char32_t* chrs, size_t len, unilib::unicode::category_t* categories) {
+  static const struct ascii_categories_t {
+    unilib::unicode::category_t categories[0x80];
+    ascii_categories_t() { for (char32_t chr = 0; chr < 0x80; chr++) categories[chr] = unilib::unicode::category(chr); }
+  } ascii_categories;
+
+  for (size_t i = 0; i < len; i++)
+    categories[i] = chrs[i] < 0x80 ? ascii_categories.categories[chrs[i]] : unilib::unicode::category(chrs[i]);
+}
+
+void utf8_ascii::lowercase(const char32_t* chrs, size_t len, char32_t* lowercased) {
+  for (size_t i = 0; i < len; i++)
+    lowercased[i] = chrs[i] < 0x80 ? chrs[i] + (chrs[i] - 'A' < 26 ? 'a' - 'A' : 0) : unilib::unicode::lowercase(chrs[i]);
+}
+
+} // namespace utils
+} // namespace udpipe
+} // namespace ufal
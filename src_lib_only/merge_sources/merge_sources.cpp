@@ -21,6 +21,7 @@ vector<string> namespaces_closing;
 
 set<string> system_includes;
 set<string> local_includes;
+vector<string> conditional_includes;
 
 struct bundle_file {
   string file_name;
@@ -43,6 +44,7 @@ void add_file(list<bundle_file>::iterator it, const string& top_directory, const
   // - comments
   // - system includes
   // - local includes
+  // - conditional blocks of system includes and defines, kept verbatim
   // - #pragma once
   string line;
   while (getline(is, line)) {
@@ -61,6 +63,20 @@ void add_file(list<bundle_file>::iterator it, const string& top_directory, const
       }
       if (header_path.empty()) cerr << "Cannot find include " << line << " from file " << file << "!" << endl, exit(1);
       add_file(bundle, top_directory, header_path);
+    } else if (line.find("#if") == 0) {
+      string block = line;
+      int depth = 1;
+      while (depth && getline(is, line)) {
+        if (line.find("#if") == 0) depth++;
+        else if (line.find("#endif") == 0) depth--;
+        else if (line.find("#elif") != 0 && line.find("#else") != 0 && line.find("#define ") != 0 &&
+                 !(line.find("#include <") == 0 && line.substr(line.size() - 1) == ">"))
+          cerr << "Unsupported line " << line << " in conditional block in file " << file << "!" << endl, exit(1);
+        block.append("\n").append(line);
+      }
+      if (depth) cerr << "Unterminated conditional block in file " << file << "!" << endl, exit(1);
+      if (find(conditional_includes.begin(), conditional_includes.end(), block) == conditional_includes.end())
+        conditional_includes.push_back(block);
     } else {
       break;
     }
@@ -120,6 +136,8 @@ int main(int argc, char* argv[]) {
   cout << endl;
   for (auto&& system_include : system_includes)
     cout << "#include <" << system_include << ">" << endl;
+  for (auto&& conditional_include : conditional_includes)
+    cout << endl << conditional_include << endl;
 
   cout << endl;
   for (auto&& namespace_opening : namespaces_opening)
@@ -136,6 +136,7 @@ class input_format {
 
   // Static factory methods
   static input_format* new_input_format(const std::string& name);
+  static input_format* new_binary_input_format(const std::string& options = std::string());
   static input_format* new_conllu_input_format(const std::string& options = std::string());
   static input_format* new_generic_tokenizer_input_format(const std::string& options = std::string());
   static input_format* new_horizontal_input_format(const std::string& options = std::string());
@@ -154,11 +155,18 @@ class output_format {
  public:
   virtual ~output_format() {}
 
-  virtual void write_sentence(const sentence& s, std::ostream& os) = 0;
-  virtual void finish_document(std::ostream& /*os*/) {};
+  virtual void write_sentence(const sentence& s, std::ostream& os);
+  virtual void finish_document(std::ostream& os);
+
+  virtual void write_sentence(const sentence& s, std::string& output);
+  virtual void finish_document(std::string& /*output*/) {}
+
+  void set_buffer_size(size_t buffer_size);
+  void flush(std::ostream& os);
 
   // Static factory methods
   static output_format* new_output_format(const std::string& name);
+  static output_format* new_binary_output_format(const std::string& options = std::string());
   static output_format* new_conllu_output_format(const std::string& options = std::string());
   static output_format* new_epe_output_format(const std::string& options = std::string());
   static output_format* new_matxin_output_format(const std::string& options = std::string());
@@ -171,6 +179,10 @@ class output_format {
   static const std::string HORIZONTAL_PARAGRAPHS;
   static const std::string PLAINTEXT_NORMALIZED_SPACES;
   static const std::string VERTICAL_PARAGRAPHS;
+
+ private:
+  std::string buffer;
+  size_t buffer_size;
 };
 
 class model {
@@ -233,6 +245,7 @@ class evaluator {
   void set_tokenizer(const std::string& tokenizer);
   void set_tagger(const std::string& tagger);
   void set_parser(const std::string& parser);
+  void set_threads(unsigned threads);
 
   bool evaluate(std::istream& is, std::ostream& os, std::string& error) const;
 
@@ -242,6 +255,7 @@ class evaluator {
  private:
   const model* m;
   std::string tokenizer, tagger, parser;
+  unsigned threads;
 };
 
 class version {